@@ -155,6 +155,14 @@ cGT_parameter(void* ptr, const char* obj, const char* name)
 				return (void*)handle;
 			}
 		}
+		if (boost::iequals(obj, "session"))
+			return cGT_sessionParameter(ptr, name);
+		if (boost::iequals(obj, "streaming"))
+			return cGT_streamingParameter(ptr, name);
+		if (boost::iequals(obj, "reconstructor"))
+			return cGT_reconstructorParameter(ptr, name);
+		if (boost::iequals(obj, "images_writer"))
+			return cGT_imagesWriterParameter(ptr, name);
 		if (boost::iequals(obj, "gadget")) {
 			aGadget& g = objectFromHandle<aGadget>(ptr);
 			std::string value = g.value_of(name);
@@ -172,6 +180,10 @@ cGT_setParameter(void* ptr, const char* obj, const char* par, const void* val)
 	try {
 		if (boost::iequals(obj, "coil_sensitivity"))
 			return cGT_setCSParameter(ptr, par, val);
+		if (boost::iequals(obj, "reconstructor"))
+			return cGT_setReconstructorParameter(ptr, par, val);
+		if (boost::iequals(obj, "gadget_chain"))
+			return cGT_setGadgetChainParameter(ptr, par, val);
 		return unknownObject("object", obj, __FILE__, __LINE__);
 	}
 	CATCH;
@@ -211,6 +223,39 @@ cGT_setCSParameter(void* ptr, const char* par, const void* val)
 	return new DataHandle;
 }
 
+extern "C"
+void*
+cGT_setGadgetChainParameter(void* ptr, const char* par, const void* val)
+{
+	CAST_PTR(DataHandle, h_gc, ptr);
+	GadgetChain& gc = objectFromHandle<GadgetChain>(h_gc);
+	if (boost::iequals(par, "native"))
+		gc.set_native(dataFromHandle<int>(val) != 0);
+	else
+		return unknownObject("parameter", par, __FILE__, __LINE__);
+	return new DataHandle;
+}
+
+extern "C"
+void*
+cGT_setReconstructorParameter(void* ptr, const char* par, const void* val)
+{
+	CAST_PTR(DataHandle, h_recon, ptr);
+	ImagesReconstructor& recon = 
+		objectFromHandle<ImagesReconstructor>(h_recon);
+	if (boost::iequals(par, "endpoints"))
+		recon.set_endpoints(charDataFromDataHandle((const DataHandle*)val));
+	else if (boost::iequals(par, "shard_by"))
+		recon.set_shard_by(charDataFromDataHandle((const DataHandle*)val));
+	else if (boost::iequals(par, "preprocessor"))
+		recon.set_preprocessor(objectSptrFromHandle<AcquisitionsProcessor>(val));
+	else if (boost::iequals(par, "return_acquisitions"))
+		recon.set_return_acquisitions(dataFromHandle<int>(val) != 0);
+	else
+		return unknownObject("parameter", par, __FILE__, __LINE__);
+	return new DataHandle;
+}
+
 extern "C"
 void*
 cGT_computeCoilImages(void* ptr_cis, void* ptr_acqs)
@@ -391,6 +436,20 @@ cGT_setAcquisitionsStorageScheme(const char* scheme)
 	CATCH;
 }
 
+extern "C"
+void*
+cGT_setImagesStorageScheme(const char* scheme)
+{
+	try{
+		if (strcmp(scheme, "block") == 0)
+			ImagesBlock::set_as_template();
+		else
+			ImagesVector::set_as_template();
+		return (void*)new DataHandle;
+	}
+	CATCH;
+}
+
 extern "C"
 void*
 cGT_orderAcquisitions(void* ptr_acqs)
@@ -497,6 +556,40 @@ cGT_getAcquisitionsFlags(void* ptr_acqs, unsigned int n, size_t ptr_f)
 	CATCH;
 }
 
+// copies ISMRMRD::AcquisitionHeader structures of all acquisitions into
+// the buffer, returns the number of acquisitions
+extern "C"
+void*
+cGT_getAcquisitionsHeaders(void* ptr_acqs, size_t ptr_h)
+{
+	try {
+		CAST_PTR(DataHandle, h_acqs, ptr_acqs);
+		AcquisitionsContainer& acqs =
+			objectFromHandle<AcquisitionsContainer>(h_acqs);
+		int n = acqs.get_acquisitions_headers
+			((ISMRMRD::AcquisitionHeader*)ptr_h);
+		return dataHandle(n);
+	}
+	CATCH;
+}
+
+// replaces the headers of all acquisitions with ISMRMRD::AcquisitionHeader
+// structures from the buffer, in the order of cGT_getAcquisitionsHeaders
+extern "C"
+void*
+cGT_setAcquisitionsHeaders(void* ptr_acqs, size_t ptr_h)
+{
+	try {
+		CAST_PTR(DataHandle, h_acqs, ptr_acqs);
+		AcquisitionsContainer& acqs =
+			objectFromHandle<AcquisitionsContainer>(h_acqs);
+		acqs.set_acquisitions_headers
+			((const ISMRMRD::AcquisitionHeader*)ptr_h);
+		return new DataHandle;
+	}
+	CATCH;
+}
+
 extern "C"
 void*
 cGT_getAcquisitionsData
@@ -538,6 +631,47 @@ size_t ptr_re, size_t ptr_im)
 	CATCH;
 }
 
+// same as cGT_getAcquisitionsData for interleaved complex data
+extern "C"
+void*
+cGT_getAcquisitionsComplexData
+(void* ptr_acqs, unsigned int slice, size_t ptr_z)
+{
+	try {
+		complex_float_t* z = (complex_float_t*)ptr_z;
+		CAST_PTR(DataHandle, h_acqs, ptr_acqs);
+		AcquisitionsContainer& acqs =
+			objectFromHandle<AcquisitionsContainer>(h_acqs);
+		int n = acqs.get_acquisitions_data(slice, z);
+		return dataHandle(n);
+	}
+	CATCH;
+}
+
+// same as cGT_setAcquisitionsData for interleaved complex data
+extern "C"
+void*
+cGT_setAcquisitionsComplexData
+(void* ptr_acqs, unsigned int na, unsigned int nc, unsigned int ns,
+size_t ptr_z)
+{
+	try {
+		const complex_float_t* z = (const complex_float_t*)ptr_z;
+		CAST_PTR(DataHandle, h_acqs, ptr_acqs);
+		AcquisitionsContainer& acqs =
+			objectFromHandle<AcquisitionsContainer>(h_acqs);
+		int err = acqs.set_acquisition_data(na, nc, ns, z);
+		DataHandle* handle = new DataHandle;
+		if (err) {
+			std::string error = "Mismatching acquisition dimensions";
+			ExecutionStatus status(error.c_str(), __FILE__, __LINE__);
+			handle->set(0, &status);
+		}
+		return (void*)handle;
+	}
+	CATCH;
+}
+
 extern "C"
 void*
 cGT_acquisitionParameter(void* ptr_acq, const char* name)
@@ -577,6 +711,90 @@ cGT_acquisitionsParameter(void* ptr_acqs, const char* name)
 	CATCH;
 }
 
+extern "C"
+void*
+cGT_sessionParameter(void* ptr_gc, const char* name)
+{
+	try {
+		CAST_PTR(DataHandle, h_gc, ptr_gc);
+		GadgetChain& gc = objectFromHandle<GadgetChain>(h_gc);
+		const GadgetronClientSessionStats& stats = gc.session_stats();
+		// times in seconds, counts as double to avoid int overflow
+		if (boost::iequals(name, "connect_time"))
+			return dataHandle(stats.connect_us*1e-6);
+		if (boost::iequals(name, "config_time"))
+			return dataHandle(stats.config_us*1e-6);
+		if (boost::iequals(name, "bytes_sent"))
+			return dataHandle((double)stats.bytes_sent);
+		if (boost::iequals(name, "bytes_received"))
+			return dataHandle((double)stats.bytes_received);
+		if (boost::iequals(name, "messages_sent"))
+			return dataHandle((double)stats.messages_sent);
+		if (boost::iequals(name, "messages_received"))
+			return dataHandle((double)stats.messages_received);
+		if (boost::iequals(name, "first_result_latency"))
+			return dataHandle(stats.first_result_us*1e-6);
+		if (boost::iequals(name, "last_result_latency"))
+			return dataHandle(stats.last_result_us*1e-6);
+		if (boost::iequals(name, "write_blocked_time"))
+			return dataHandle(stats.write_blocked_us*1e-6);
+		if (boost::iequals(name, "read_blocked_time"))
+			return dataHandle(stats.read_blocked_us*1e-6);
+		return parameterNotFound(name, __FILE__, __LINE__);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_streamingParameter(void* ptr_gc, const char* name)
+{
+	try {
+		CAST_PTR(DataHandle, h_gc, ptr_gc);
+		GadgetChain& gc = objectFromHandle<GadgetChain>(h_gc);
+		const GadgetronClientStreamingStats& stats = gc.streaming_stats();
+		// times in seconds
+		if (boost::iequals(name, "acquisitions"))
+			return dataHandle((double)stats.acquisitions);
+		if (boost::iequals(name, "batches"))
+			return dataHandle((double)stats.batches);
+		if (boost::iequals(name, "max_queue_depth"))
+			return dataHandle((double)stats.max_queue_depth);
+		if (boost::iequals(name, "mean_queue_depth"))
+			return dataHandle(stats.mean_queue_depth);
+		if (boost::iequals(name, "reader_stalls"))
+			return dataHandle((double)stats.reader_stalls);
+		if (boost::iequals(name, "sender_stalls"))
+			return dataHandle((double)stats.sender_stalls);
+		if (boost::iequals(name, "reader_stall_time"))
+			return dataHandle(stats.reader_stall_us*1e-6);
+		if (boost::iequals(name, "sender_stall_time"))
+			return dataHandle(stats.sender_stall_us*1e-6);
+		return parameterNotFound(name, __FILE__, __LINE__);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_reconstructorParameter(void* ptr_recon, const char* name)
+{
+	try {
+		CAST_PTR(DataHandle, h_recon, ptr_recon);
+		ImagesReconstructor& recon = 
+			objectFromHandle<ImagesReconstructor>(h_recon);
+		if (boost::iequals(name, "processed_acquisitions")) {
+			shared_ptr<AcquisitionsContainer> sptr_acqs =
+				recon.get_processed_acquisitions();
+			if (!sptr_acqs.get())
+				THROW("no processed acquisitions kept by the reconstructor");
+			return newObjectHandle<AcquisitionsContainer>(sptr_acqs);
+		}
+		return parameterNotFound(name, __FILE__, __LINE__);
+	}
+	CATCH;
+}
+
 extern "C"
 void*
 cGT_reconstructImages(void* ptr_recon, void* ptr_input)
@@ -666,6 +884,49 @@ cGT_writeImages(void* ptr_imgs, const char* out_file, const char* out_group)
 	return (void*)new DataHandle;
 }
 
+extern "C"
+void*
+cGT_writeImagesAsync(void* ptr_imgs, 
+	const char* out_file, const char* out_group, int batch_size)
+{
+	try {
+		CAST_PTR(DataHandle, h_imgs, ptr_imgs);
+		ImagesContainer& list = objectFromHandle<ImagesContainer>(h_imgs);
+		shared_ptr<ImagesWriter> sptr_w
+			(new ImagesWriter(list, out_file, out_group, batch_size));
+		return newObjectHandle<ImagesWriter>(sptr_w);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_waitForImagesWriter(void* ptr_w)
+{
+	try {
+		CAST_PTR(DataHandle, h_w, ptr_w);
+		ImagesWriter& w = objectFromHandle<ImagesWriter>(h_w);
+		w.wait();
+	}
+	CATCH;
+
+	return (void*)new DataHandle;
+}
+
+extern "C"
+void*
+cGT_imagesWriterParameter(void* ptr_w, const char* name)
+{
+	try {
+		CAST_PTR(DataHandle, h_w, ptr_w);
+		ImagesWriter& w = objectFromHandle<ImagesWriter>(h_w);
+		if (boost::iequals(name, "done"))
+			return dataHandle((int)w.done());
+		return parameterNotFound(name, __FILE__, __LINE__);
+	}
+	CATCH;
+}
+
 extern "C"
 void*
 cGT_imageWrapFromContainer(void* ptr_imgs, unsigned int img_num)
@@ -726,6 +987,34 @@ cGT_setComplexImagesData(void* ptr_imgs, size_t ptr_re, size_t ptr_im)
 	return (void*)new DataHandle;
 }
 
+extern "C"
+void*
+cGT_getImagesComplexData(void* ptr_imgs, size_t ptr_z)
+{
+	try {
+		complex_float_t* z = (complex_float_t*)ptr_z;
+		CAST_PTR(DataHandle, h_imgs, ptr_imgs);
+		ImagesContainer& list = objectFromHandle<ImagesContainer>(h_imgs);
+		list.get_images_data_as_complex_array(z);
+	}
+	CATCH;
+	return (void*)new DataHandle;
+}
+
+extern "C"
+void*
+cGT_setImagesComplexData(void* ptr_imgs, size_t ptr_z)
+{
+	try {
+		const complex_float_t* z = (const complex_float_t*)ptr_z;
+		CAST_PTR(DataHandle, h_imgs, ptr_imgs);
+		ImagesContainer& list = objectFromHandle<ImagesContainer>(h_imgs);
+		list.set_complex_images_data(z);
+	}
+	CATCH;
+	return (void*)new DataHandle;
+}
+
 extern "C"
 void*
 cGT_imageTypes(const void* ptr_x)
@@ -758,6 +1047,21 @@ cGT_imageDataType(const void* ptr_x, int im_num)
 	CATCH;
 }
 
+// copies ISMRMRD::ImageHeader structures of all images into the buffer,
+// returns the number of images
+extern "C"
+void*
+cGT_getImagesHeaders(void* ptr_imgs, size_t ptr_h)
+{
+	try {
+		CAST_PTR(DataHandle, h_imgs, ptr_imgs);
+		ImagesContainer& images = objectFromHandle<ImagesContainer>(h_imgs);
+		int n = images.get_images_headers((ISMRMRD::ImageHeader*)ptr_h);
+		return dataHandle(n);
+	}
+	CATCH;
+}
+
 extern "C"
 void*
 cGT_dataItems(const void* ptr_x)
@@ -1082,28 +1386,11 @@ cGT_sendAcquisitions(void* ptr_con, void* ptr_dat)
 	
 		GTConnector& conn = objectFromHandle<GTConnector>(h_con);
 		GadgetronClientConnector& con = conn();
-		Mutex mutex;
-		boost::mutex& mtx = mutex();
 		ISMRMRD::Dataset& ismrmrd_dataset = 
 			objectFromHandle<ISMRMRD::Dataset>(h_dat);
-	
-		uint32_t acquisitions = 0;
-		{
-			mtx.lock();
-			acquisitions = ismrmrd_dataset.getNumberOfAcquisitions();
-			mtx.unlock();
-		}
 
-		//std::cout << acquisitions << " acquisitions" << std::endl;
-	
-		ISMRMRD::Acquisition acq_tmp;
-		for (uint32_t i = 0; i < acquisitions; i++) {
-			{
-				boost::mutex::scoped_lock scoped_lock(mtx);
-				ismrmrd_dataset.readAcquisition(i, acq_tmp);
-			}
-			con.send_ismrmrd_acquisition(acq_tmp);
-		}
+		GadgetronClientAcquisitionStreamer streamer(con);
+		streamer.send(ismrmrd_dataset);
 	}
 	CATCH;
 
@@ -49,6 +49,7 @@ extern "C" {
 	void* cGT_AcquisitionModelBackward(void* ptr_am, const void* ptr_acqs);
 
 	void* cGT_setAcquisitionsStorageScheme(const char* scheme);
+	void* cGT_setImagesStorageScheme(const char* scheme);
 	void* cGT_ISMRMRDAcquisitionsFromFile(const char* file);
 	void* cGT_ISMRMRDAcquisitionsFile(const char* file);
 	void* cGT_processAcquisitions(void* ptr_proc, void* ptr_input);
@@ -56,11 +57,18 @@ extern "C" {
 	void* cGT_orderAcquisitions(void* ptr_acqs);
 	void* cGT_getAcquisitionsDimensions(void* ptr_acqs, PTR_INT ptr_dim);
 	void* cGT_getAcquisitionsFlags(void* ptr_acqs, unsigned int n, PTR_INT ptr_f);
+	void* cGT_getAcquisitionsHeaders(void* ptr_acqs, PTR_INT ptr_h);
+	void* cGT_setAcquisitionsHeaders(void* ptr_acqs, PTR_INT ptr_h);
 	void* cGT_getAcquisitionsData
 		(void* ptr_acqs, unsigned int slice, PTR_FLOAT ptr_re, PTR_FLOAT ptr_im);
 	void* cGT_setAcquisitionsData
 		(void* ptr_acqs, unsigned int na, unsigned int nc, unsigned int ns,
 		PTR_FLOAT ptr_re, PTR_FLOAT ptr_im);
+	void* cGT_getAcquisitionsComplexData
+		(void* ptr_acqs, unsigned int slice, PTR_FLOAT ptr_z);
+	void* cGT_setAcquisitionsComplexData
+		(void* ptr_acqs, unsigned int na, unsigned int nc, unsigned int ns,
+		PTR_FLOAT ptr_z);
 
 	void* cGT_reconstructImages(void* ptr_recon, void* ptr_input);
 	void* cGT_reconstructedImages(void* ptr_recon);
@@ -69,9 +77,13 @@ extern "C" {
 	void* cGT_imagesCopy(const void* ptr_imgs);
 	void* cGT_writeImages
 		(void* ptr_imgs, const char* out_file, const char* out_group);
+	void* cGT_writeImagesAsync(void* ptr_imgs, 
+		const char* out_file, const char* out_group, int batch_size);
+	void* cGT_waitForImagesWriter(void* ptr_w);
 	void* cGT_imageWrapFromContainer(void* ptr_imgs, unsigned int img_num);
 	void* cGT_imageTypes(const void* ptr_x);
 	void* cGT_imageDataType(const void* ptr_x, int im_num);
+	void* cGT_getImagesHeaders(void* ptr_imgs, PTR_INT ptr_h);
 
 	void cGT_getCoilDataDimensions(void* ptr_csms, int csm_num, PTR_INT ptr_dim);
 	void cGT_getCoilData
@@ -82,6 +94,8 @@ extern "C" {
 	void cGT_getImagesDataAsComplexArray
 		(void* ptr_imgs, PTR_FLOAT ptr_re, PTR_FLOAT ptr_im);
 	void* cGT_setComplexImagesData(void* ptr_imgs, PTR_FLOAT ptr_re, PTR_FLOAT ptr_im);
+	void* cGT_getImagesComplexData(void* ptr_imgs, PTR_FLOAT ptr_z);
+	void* cGT_setImagesComplexData(void* ptr_imgs, PTR_FLOAT ptr_z);
 
 	void* cGT_dataItems(const void* ptr_x);
 	void* cGT_norm(const void* ptr_x);
@@ -27,7 +27,25 @@ void* cGT_acquisitionParameter(void* ptr_acq, const char* name);
 extern "C"
 void* cGT_acquisitionsParameter(void* ptr_acq, const char* name);
 
+extern "C"
+void* cGT_sessionParameter(void* ptr_gc, const char* name);
+
+extern "C"
+void* cGT_streamingParameter(void* ptr_gc, const char* name);
+
+extern "C"
+void* cGT_reconstructorParameter(void* ptr_recon, const char* name);
+
+extern "C"
+void* cGT_imagesWriterParameter(void* ptr_w, const char* name);
+
 extern "C"
 void* cGT_setCSParameter(void* ptr, const char* par, const void* val);
 
+extern "C"
+void* cGT_setGadgetChainParameter(void* ptr, const char* par, const void* val);
+
+extern "C"
+void* cGT_setReconstructorParameter(void* ptr, const char* par, const void* val);
+
 #endif
@@ -21,16 +21,23 @@ limitations under the License.
 #ifndef GADGETS_LIBRARY
 #define GADGETS_LIBRARY
 
+#include <cstdlib>
 #include <map>
 #include <boost/algorithm/string.hpp>
 
 //#include "an_object.h"
+#include "gadgetron_native.h"
 
 class aGadget { // : public anObject {
 public:
 	virtual void set_property(const char* prop, const char* value) = 0;
 	virtual std::string value_of(const char* prop) = 0;
 	virtual std::string xml() const = 0;
+	// in-process implementation of the gadget, if available
+	virtual shared_ptr<aNativeGadget> native() const
+	{
+		return shared_ptr<aNativeGadget>();
+	}
 };
 
 class Gadget : public aGadget {
@@ -77,6 +84,12 @@ protected:
 	std::string dll_;
 	std::string class_;
 	std::map<std::string, std::string> par_;
+
+	float float_property_(const char* prop) const
+	{
+		std::map<std::string, std::string>::const_iterator it = par_.find(prop);
+		return it == par_.end() ? 0.0f : (float)atof(it->second.c_str());
+	}
 };
 
 class IsmrmrdAcqMsgReader : public aGadget {
@@ -191,6 +204,10 @@ public:
 	{
 		return "NoiseAdjustGadget";
 	}
+	virtual shared_ptr<aNativeGadget> native() const
+	{
+		return shared_ptr<aNativeGadget>(new NativeNoiseAdjustGadget);
+	}
 };
 
 class AsymmetricEchoAdjustROGadget : public Gadget {
@@ -215,6 +232,10 @@ public:
 	{
 		return "RemoveROOversamplingGadget";
 	}
+	virtual shared_ptr<aNativeGadget> native() const
+	{
+		return shared_ptr<aNativeGadget>(new NativeRemoveROOversamplingGadget);
+	}
 };
 
 class AcquisitionAccumulateTriggerGadget : public Gadget {
@@ -359,6 +380,11 @@ public:
 	{
 		return "ExtractGadget";
 	}
+	virtual shared_ptr<aNativeGadget> native() const
+	{
+		return shared_ptr<aNativeGadget>(new NativeExtractGadget
+			((unsigned int)float_property_("extract_mask")));
+	}
 };
 
 class ComplexToFloatGadget : public Gadget {
@@ -370,6 +396,10 @@ public:
 	{
 		return "ComplexToFloatGadget";
 	}
+	virtual shared_ptr<aNativeGadget> native() const
+	{
+		return shared_ptr<aNativeGadget>(new NativeComplexToFloatGadget);
+	}
 };
 
 class FloatToShortGadget : public Gadget {
@@ -386,6 +416,12 @@ public:
 	{
 		return "FloatToShortGadget";
 	}
+	virtual shared_ptr<aNativeGadget> native() const
+	{
+		return shared_ptr<aNativeGadget>(new NativeFloatToShortGadget
+			(float_property_("min_intensity"), float_property_("max_intensity"),
+			float_property_("intensity_offset")));
+	}
 };
 
 class ImageFinishGadget : public Gadget {
@@ -397,6 +433,10 @@ public:
 	{
 		return "ImageFinishGadget";
 	}
+	virtual shared_ptr<aNativeGadget> native() const
+	{
+		return shared_ptr<aNativeGadget>(new NativePassThroughGadget);
+	}
 };
 
 class AcquisitionFinishGadget : public Gadget {
@@ -408,6 +448,10 @@ public:
 	{
 		return "AcquisitionFinishGadget";
 	}
+	virtual shared_ptr<aNativeGadget> native() const
+	{
+		return shared_ptr<aNativeGadget>(new NativePassThroughGadget);
+	}
 };
 
 class SimpleReconGadgetSet : public aGadget {
@@ -29,152 +29,456 @@ limitations under the License.
 
 #include "gadgetron_client.h"
 
-void
-GadgetronClientAcquisitionMessageCollector::read(tcp::socket* stream)
+static long long int
+microseconds_since(const std::chrono::steady_clock::time_point& t)
 {
-	ISMRMRD::Acquisition acq;
-	ISMRMRD::AcquisitionHeader h;
-	boost::asio::read
-		(*stream, boost::asio::buffer(&h, sizeof(ISMRMRD::AcquisitionHeader)));
-	acq.setHead(h);
-	unsigned long trajectory_elements =
-		acq.getHead().trajectory_dimensions * acq.getHead().number_of_samples;
-	unsigned long data_elements =
-		acq.getHead().active_channels * acq.getHead().number_of_samples;
+	return (long long int)std::chrono::duration_cast<std::chrono::microseconds>
+		(std::chrono::steady_clock::now() - t).count();
+}
 
-	if (trajectory_elements) {
-		boost::asio::read
-			(*stream, boost::asio::buffer
+void
+GadgetronClientAcquisitionMessageCollector::async_read
+(tcp::socket& s, Handler handler)
+{
+	// if all batches are waiting to be stored, reading is resumed on the
+	// io thread once one has been, rather than blocking the io thread
+	if (!writer_.ready([this, &s, handler]()
+	{
+		GadgetronClientEventLoop::io_service().post([this, &s, handler]()
+		{
+			async_read(s, handler);
+		});
+	}))
+		return;
+	boost::asio::async_read
+		(s, boost::asio::buffer(&head_, sizeof(ISMRMRD::AcquisitionHeader)),
+		[this, &s, handler](const boost::system::error_code& error, size_t)
+	{
+		if (error) {
+			handler(error);
+			return;
+		}
+		// read straight into a pooled acquisition, which keeps its memory
+		// if the next one to be read into it is of the same size
+		ISMRMRD::Acquisition& acq = writer_.next();
+		acq.setHead(head_);
+		unsigned long trajectory_elements =
+			head_.trajectory_dimensions * head_.number_of_samples;
+		unsigned long data_elements =
+			head_.active_channels * head_.number_of_samples;
+
+		std::vector<boost::asio::mutable_buffer> buffers;
+		if (trajectory_elements)
+			buffers.push_back(boost::asio::buffer
 			(&acq.getTrajPtr()[0], sizeof(float)*trajectory_elements));
-	}
-	if (data_elements) {
-		boost::asio::read
-			(*stream,
-			boost::asio::buffer
+		if (data_elements)
+			buffers.push_back(boost::asio::buffer
 			(&acq.getDataPtr()[0], 2 * sizeof(float)*data_elements));
-	}
 
-	ptr_acqs_->append_acquisition(acq);
+		boost::asio::async_read(s, buffers,
+			[this, handler](const boost::system::error_code& error, size_t)
+		{
+			if (!error && !writer_.commit()) {
+				std::cout << "Failed to store acquisitions" << std::endl;
+				handler(boost::asio::error::no_memory);
+				return;
+			}
+			handler(error);
+		});
+	});
 }
 
 void 
-GadgetronClientImageMessageCollector::read(tcp::socket* stream)
+GadgetronClientImageMessageCollector::async_read
+(tcp::socket& s, Handler handler)
 {
-	//Read the image headerfrom the socket
-	ISMRMRD::ImageHeader h;
-	boost::asio::read
-		(*stream, boost::asio::buffer(&h, sizeof(ISMRMRD::ImageHeader)));
-	void* ptr = 0;
-	IMAGE_PROCESSING_SWITCH
-		(h.data_type, read_data_attributes, ptr, h, &ptr, stream);
-	if (ptr) {
-		ptr_images_->append(h.data_type, ptr);
-		ptr_images_->count(h.image_index);
-	}
-	else {
-		throw GadgetronClientException("Invalid image data type");
-	}
+	// drop an image left over from an interrupted connection
+	discard_();
+	// see GadgetronClientAcquisitionMessageCollector::async_read
+	if (!writer_.ready([this, &s, handler]()
+	{
+		GadgetronClientEventLoop::io_service().post([this, &s, handler]()
+		{
+			async_read(s, handler);
+		});
+	}))
+		return;
+	//Read the image header from the socket
+	boost::asio::async_read
+		(s, boost::asio::buffer(&head_, sizeof(ISMRMRD::ImageHeader)),
+		[this, &s, handler](const boost::system::error_code& error, size_t)
+	{
+		if (error) {
+			handler(error);
+			return;
+		}
+		IMAGE_PROCESSING_SWITCH(head_.data_type, new_image_, 0);
+		if (!ptr_) {
+			std::cout << "Invalid image data type" << std::endl;
+			handler(boost::asio::error::invalid_argument);
+			return;
+		}
+		read_attributes_(s, handler);
+	});
 }
 
-void 
-GadgetronClientConnector::read_task()
+void
+GadgetronClientImageMessageCollector::read_attributes_
+(tcp::socket& s, Handler handler)
 {
-	if (!socket_) {
-		throw GadgetronClientException("Unable to create socket.");
-	}
-
-	GadgetMessageIdentifier id;
-	while (socket_->is_open()) {
-		try {
-			boost::asio::read
-				(*socket_, boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
-
-			if (id.id == GADGET_MESSAGE_CLOSE) {
-				break;
+	//Read meta attributes
+	boost::asio::async_read(s, boost::asio::buffer
+		(&meta_attrib_length_, sizeof(meta_attrib_length_)),
+		[this, &s, handler](const boost::system::error_code& error, size_t)
+	{
+		if (error) {
+			handler(error);
+			return;
+		}
+		if (meta_attrib_length_ < 1) {
+			read_data_(s, handler);
+			return;
+		}
+		meta_attrib_.assign(meta_attrib_length_, 0);
+		boost::asio::async_read(s, boost::asio::buffer
+			(&meta_attrib_[0], meta_attrib_length_),
+			[this, &s, handler](const boost::system::error_code& error, size_t)
+		{
+			if (error) {
+				handler(error);
+				return;
 			}
+			IMAGE_PROCESSING_SWITCH(head_.data_type, set_attributes_, ptr_);
+			read_data_(s, handler);
+		});
+	});
+}
 
-			GadgetronClientMessageReader* r = find_reader(id.id);
-
-			if (!r) {
-				std::cout << "Message received with ID: " << id.id << std::endl;
-				throw GadgetronClientException("Unknown Message ID");
-			}
-			else {
-				r->read(socket_);
+void
+GadgetronClientImageMessageCollector::read_data_
+(tcp::socket& s, Handler handler)
+{
+	//Read image data
+	boost::asio::async_read(s, boost::asio::buffer(data_, data_size_),
+		[this, handler](const boost::system::error_code& error, size_t)
+	{
+		if (!error) {
+			ReceivedImage& image = writer_.next();
+			image.sptr_iw.reset(new ImageWrap(head_.data_type, ptr_));
+			image.index = head_.image_index;
+			ptr_ = 0; // now owned by the image wrap
+			if (!writer_.commit()) {
+				std::cout << "Failed to store images" << std::endl;
+				handler(boost::asio::error::no_memory);
+				return;
 			}
 		}
-		catch (...) {
-			std::cout << "Input stream has terminated" << std::endl;
-			return;
-		}
-	}
+		handler(error);
+	});
 }
 
 void 
 GadgetronClientConnector::connect(std::string hostname, std::string port)
 {
-	tcp::resolver resolver(io_service);
+	shutdown_();
+
+	std::chrono::steady_clock::time_point start = 
+		std::chrono::steady_clock::now();
+	stats_.reset();
+
+	tcp::resolver resolver(io_service_);
 	tcp::resolver::query query(tcp::v4(), hostname.c_str(), port.c_str());
 	tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
-	tcp::resolver::iterator end;
 
-	socket_ = new tcp::socket(io_service);
+	socket_ = new tcp::socket(io_service_);
 	if (!socket_) {
 		throw GadgetronClientException("Unable to create socket.");
 	}
+	deadline_.reset(new boost::asio::steady_timer(io_service_));
+	queued_bytes_ = 0;
+	writing_ = false;
+	write_error_ = boost::system::error_code();
+	reading_ = false;
+	closed_by_server_ = false;
+	connecting_ = true;
+
+	boost::mutex mtx;
+	boost::condition_variable cv;
+	bool done = false;
+	boost::system::error_code error;
+
+	// the socket and the timer are only used on the io thread
+	io_service_.post(track_([&, this, endpoint_iterator]()
+	{
+		deadline_->expires_from_now(std::chrono::milliseconds(timeout_ms_));
+		deadline_->async_wait(track_([this](const boost::system::error_code& e)
+		{
+			// closing the socket aborts async_connect
+			if (e != boost::asio::error::operation_aborted && connecting_)
+				socket_->close();
+		}));
+		boost::asio::async_connect(*socket_, endpoint_iterator, track_
+			([&, this](const boost::system::error_code& e, tcp::resolver::iterator)
+		{
+			connecting_ = false;
+			deadline_->cancel();
+			stats_.connect_us = microseconds_since(start);
+			session_start_ = std::chrono::steady_clock::now();
+			if (!e) {
+				boost::mutex::scoped_lock lock(in_mutex_);
+				reading_ = true;
+				read_next_();
+			}
+			boost::mutex::scoped_lock lock(mtx);
+			error = e;
+			done = true;
+			cv.notify_all();
+		}));
+	}));
 
-	std::condition_variable cv;
-	std::mutex cv_m;
-
-	boost::system::error_code error = boost::asio::error::host_not_found;
-	std::thread t([&](){
-		//TODO:
-		//For newer versions of Boost, we should use
-		//   boost::asio::connect(*socket_, iterator);
-		while (error && endpoint_iterator != end) {
-			socket_->close();
-			socket_->connect(*endpoint_iterator++, error);
-		}
-		cv.notify_all();
-	});
+	{
+		boost::mutex::scoped_lock lock(mtx);
+		while (!done)
+			cv.wait(lock);
+	}
+
+	if (error) {
+		shutdown_();
+		throw GadgetronClientException("Error connecting using socket.");
+	}
+}
+
+void
+GadgetronClientConnector::wait()
+{
+	{
+		std::chrono::steady_clock::time_point start =
+			std::chrono::steady_clock::now();
+		boost::mutex::scoped_lock lock(in_mutex_);
+		while (reading_)
+			in_cv_.wait(lock);
+		stats_.read_blocked_us += microseconds_since(start);
+	}
+	shutdown_();
+	// wait for the messages received to be stored
+	for (maptype::iterator it = readers_.begin(); it != readers_.end(); it++)
+		it->second->finish();
+}
+
+void
+GadgetronClientConnector::shutdown_()
+{
+	if (!socket_)
+		return;
+	// closing the socket makes pending operations complete with an error
+	io_service_.post(track_([this]()
+	{
+		connecting_ = false;
+		boost::system::error_code error;
+		deadline_->cancel(error);
+		socket_->close(error);
+	}));
+	{
+		boost::mutex::scoped_lock lock(ops_mutex_);
+		while (pending_)
+			ops_cv_.wait(lock);
+	}
+	delete socket_;
+	socket_ = 0;
+	deadline_.reset();
+	{
+		boost::mutex::scoped_lock lock(out_mutex_);
+		out_queue_.clear();
+		queued_bytes_ = 0;
+		writing_ = false;
+		if (!write_error_)
+			write_error_ = boost::asio::error::not_connected;
+		out_cv_.notify_all();
+	}
+	boost::mutex::scoped_lock lock(in_mutex_);
+	reading_ = false;
+	in_cv_.notify_all();
+}
 
+void 
+GadgetronClientConnector::read_next_()
+{
+	boost::asio::async_read(*socket_, 
+		boost::asio::buffer(&in_id_, sizeof(GadgetMessageIdentifier)),
+		track_([this](const boost::system::error_code& error, size_t)
 	{
-		std::unique_lock<std::mutex> lk(cv_m);
-		if (std::cv_status::timeout ==
-			cv.wait_until(lk, std::chrono::system_clock::now() +
-			std::chrono::milliseconds(timeout_ms_))) {
-			socket_->close();
+		handle_message_id_(error);
+	}));
+}
+
+void
+GadgetronClientConnector::handle_message_id_
+(const boost::system::error_code& error)
+{
+	if (error) {
+		std::cout << "Input stream has terminated" << std::endl;
+		finish_reading_();
+		return;
+	}
+	if (in_id_.id == GADGET_MESSAGE_CLOSE) {
+		stats_.bytes_received += sizeof(GadgetMessageIdentifier);
+		closed_by_server_ = true;
+		finish_reading_();
+		return;
+	}
+
+	GadgetronClientMessageReader* r = find_reader(in_id_.id);
+	if (!r) {
+		std::cout << "Message received with ID: " << in_id_.id << std::endl;
+		std::cout << "Unknown Message ID" << std::endl;
+		socket_->close();
+		finish_reading_();
+		return;
+	}
+	r->async_read(*socket_, track_
+		([this, r](const boost::system::error_code& error)
+	{
+		if (!error) {
+			long long int t = microseconds_since(session_start_);
+			if (stats_.first_result_us < 0)
+				stats_.first_result_us = t;
+			stats_.last_result_us = t;
+			stats_.messages_received++;
+			stats_.bytes_received += 
+				sizeof(GadgetMessageIdentifier) + r->message_size();
 		}
+		handle_message_(error);
+	}));
+}
+
+void
+GadgetronClientConnector::handle_message_
+(const boost::system::error_code& error)
+{
+	if (error) {
+		std::cout << "Input stream has terminated" << std::endl;
+		socket_->close();
+		finish_reading_();
+		return;
 	}
+	read_next_();
+}
+
+void
+GadgetronClientConnector::finish_reading_()
+{
+	boost::mutex::scoped_lock lock(in_mutex_);
+	reading_ = false;
+	in_cv_.notify_all();
+}
 
-	t.join();
+void
+GadgetronClientConnector::post_message_(shared_ptr<std::vector<char> > msg)
+{
+	if (!socket_)
+		throw GadgetronClientException("Invalid socket.");
 
-	if (error)
-		throw GadgetronClientException("Error connecting using socket.");
+	boost::mutex::scoped_lock lock(out_mutex_);
+	// backpressure: wait until the server has taken enough of queued data,
+	// but always let a message through into an empty queue
+	if (!write_error_ && queued_bytes_ > 0 &&
+		queued_bytes_ + msg->size() > high_water_mark_) {
+		std::chrono::steady_clock::time_point start =
+			std::chrono::steady_clock::now();
+		while (!write_error_ && queued_bytes_ > 0 &&
+			queued_bytes_ + msg->size() > high_water_mark_)
+			out_cv_.wait(lock);
+		stats_.write_blocked_us += microseconds_since(start);
+	}
+	if (write_error_)
+		throw GadgetronClientException("Error writing to socket.");
+	out_queue_.push_back(msg);
+	queued_bytes_ += msg->size();
+	if (!writing_) {
+		writing_ = true;
+		io_service_.post(track_([this]()
+		{
+			write_next_();
+		}));
+	}
+}
 
-	reader_thread_ =
-		boost::thread(boost::bind(&GadgetronClientConnector::read_task, this));
+void
+GadgetronClientConnector::write_next_()
+{
+	shared_ptr<std::vector<char> > msg;
+	{
+		boost::mutex::scoped_lock lock(out_mutex_);
+		msg = out_queue_.front();
+	}
+	if (write_timeout_ms_) {
+		deadline_->expires_from_now(std::chrono::milliseconds(write_timeout_ms_));
+		deadline_->async_wait(track_([this](const boost::system::error_code& e)
+		{
+			if (e != boost::asio::error::operation_aborted)
+				socket_->close();
+		}));
+	}
+	// msg is captured to keep the buffer alive until the write completes
+	boost::asio::async_write(*socket_, boost::asio::buffer(*msg),
+		track_([this, msg](const boost::system::error_code& error, size_t)
+	{
+		handle_write_(error);
+	}));
+}
+
+void
+GadgetronClientConnector::handle_write_(const boost::system::error_code& error)
+{
+	if (write_timeout_ms_)
+		deadline_->cancel();
+	bool more = false;
+	{
+		boost::mutex::scoped_lock lock(out_mutex_);
+		if (error) {
+			write_error_ = error;
+			out_queue_.clear();
+			queued_bytes_ = 0;
+			writing_ = false;
+		}
+		else {
+			const std::vector<char>& msg = *out_queue_.front();
+			const GadgetMessageIdentifier& id =
+				*(const GadgetMessageIdentifier*)&msg[0];
+			if (id.id == GADGET_MESSAGE_CONFIG_FILE ||
+				id.id == GADGET_MESSAGE_CONFIG_SCRIPT)
+				stats_.config_us = microseconds_since(config_start_);
+			if (id.id != GADGET_MESSAGE_CLOSE)
+				stats_.messages_sent++;
+			stats_.bytes_sent += msg.size();
+			queued_bytes_ -= msg.size();
+			out_queue_.pop_front();
+			more = !out_queue_.empty();
+			writing_ = more;
+		}
+		out_cv_.notify_all();
+	}
+	if (error) {
+		std::cout << "Output stream has terminated" << std::endl;
+		socket_->close();
+	}
+	else if (more)
+		write_next_();
 }
 
 void 
 GadgetronClientConnector::send_gadgetron_close()
 {
-	if (!socket_) {
-		throw GadgetronClientException("Invalid socket.");
-	}
 	GadgetMessageIdentifier id;
 	id.id = GADGET_MESSAGE_CLOSE;
-	boost::asio::write
-		(*socket_, boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
+	shared_ptr<std::vector<char> > msg(new std::vector<char>);
+	put_(*msg, &id, sizeof(GadgetMessageIdentifier));
+	post_message_(msg);
 }
 
 void 
 GadgetronClientConnector::send_gadgetron_configuration_file(std::string config_xml_name)
 {
-	if (!socket_) {
-		throw GadgetronClientException("Invalid socket.");
-	}
-
 	GadgetMessageIdentifier id;
 	id.id = GADGET_MESSAGE_CONFIG_FILE;
 
@@ -183,86 +487,68 @@ GadgetronClientConnector::send_gadgetron_configuration_file(std::string config_x
 	strncpy
 		(ini.configuration_file, config_xml_name.c_str(), config_xml_name.size());
 
-	boost::asio::write
-		(*socket_, boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
-	boost::asio::write
-		(*socket_,
-		boost::asio::buffer(&ini, sizeof(GadgetMessageConfigurationFile)));
+	shared_ptr<std::vector<char> > msg(new std::vector<char>);
+	put_(*msg, &id, sizeof(GadgetMessageIdentifier));
+	put_(*msg, &ini, sizeof(GadgetMessageConfigurationFile));
+	config_start_ = std::chrono::steady_clock::now();
+	post_message_(msg);
 }
 
 void 
 GadgetronClientConnector::send_gadgetron_configuration_script(std::string xml_string)
 {
-	if (!socket_) {
-		throw GadgetronClientException("Invalid socket.");
-	}
-
 	GadgetMessageIdentifier id;
 	id.id = GADGET_MESSAGE_CONFIG_SCRIPT;
 
 	GadgetMessageScript conf;
 	conf.script_length = (uint32_t)xml_string.size() + 1;
 
-	boost::asio::write
-		(*socket_, boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
-	boost::asio::write
-		(*socket_, boost::asio::buffer(&conf, sizeof(GadgetMessageScript)));
-	boost::asio::write
-		(*socket_, boost::asio::buffer(xml_string.c_str(), conf.script_length));
+	shared_ptr<std::vector<char> > msg(new std::vector<char>);
+	put_(*msg, &id, sizeof(GadgetMessageIdentifier));
+	put_(*msg, &conf, sizeof(GadgetMessageScript));
+	put_(*msg, xml_string.c_str(), conf.script_length);
+	config_start_ = std::chrono::steady_clock::now();
+	post_message_(msg);
 }
 
 void 
 GadgetronClientConnector::send_gadgetron_parameters(std::string xml_string)
 {
-	if (!socket_) {
-		throw GadgetronClientException("Invalid socket.");
-	}
-
 	GadgetMessageIdentifier id;
 	id.id = GADGET_MESSAGE_PARAMETER_SCRIPT;
 
 	GadgetMessageScript conf;
 	conf.script_length = (uint32_t)xml_string.size() + 1;
 
-	boost::asio::write
-		(*socket_, boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
-	boost::asio::write
-		(*socket_, boost::asio::buffer(&conf, sizeof(GadgetMessageScript)));
-	boost::asio::write
-		(*socket_, boost::asio::buffer(xml_string.c_str(), conf.script_length));
+	shared_ptr<std::vector<char> > msg(new std::vector<char>);
+	put_(*msg, &id, sizeof(GadgetMessageIdentifier));
+	put_(*msg, &conf, sizeof(GadgetMessageScript));
+	put_(*msg, xml_string.c_str(), conf.script_length);
+	post_message_(msg);
 }
 
 void 
 GadgetronClientConnector::send_ismrmrd_acquisition(ISMRMRD::Acquisition& acq)
 {
-	if (!socket_)
-		throw GadgetronClientException("Invalid socket.");
-
 	GadgetMessageIdentifier id;
 	id.id = GADGET_MESSAGE_ISMRMRD_ACQUISITION;
 
-	boost::asio::write
-		(*socket_, boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
-	boost::asio::write
-		(*socket_,
-		boost::asio::buffer(&acq.getHead(), sizeof(ISMRMRD::AcquisitionHeader)));
-
 	unsigned long trajectory_elements =
 		acq.getHead().trajectory_dimensions*acq.getHead().number_of_samples;
 	unsigned long data_elements =
 		acq.getHead().active_channels*acq.getHead().number_of_samples;
 
-	if (trajectory_elements) {
-		boost::asio::write
-			(*socket_, boost::asio::buffer
-			(&acq.getTrajPtr()[0], sizeof(float)*trajectory_elements));
-	}
-	if (data_elements) {
-		boost::asio::write
-			(*socket_,
-			boost::asio::buffer
-			(&acq.getDataPtr()[0], 2 * sizeof(float)*data_elements));
-	}
+	shared_ptr<std::vector<char> > msg(new std::vector<char>);
+	msg->reserve(sizeof(GadgetMessageIdentifier) + 
+		sizeof(ISMRMRD::AcquisitionHeader) +
+		sizeof(float)*(trajectory_elements + 2 * data_elements));
+	put_(*msg, &id, sizeof(GadgetMessageIdentifier));
+	put_(*msg, &acq.getHead(), sizeof(ISMRMRD::AcquisitionHeader));
+	if (trajectory_elements)
+		put_(*msg, &acq.getTrajPtr()[0], sizeof(float)*trajectory_elements);
+	if (data_elements)
+		put_(*msg, &acq.getDataPtr()[0], 2 * sizeof(float)*data_elements);
+	post_message_(msg);
 }
 
 GadgetronClientMessageReader* 
@@ -276,3 +562,168 @@ GadgetronClientConnector::find_reader(unsigned short r)
 	return ret;
 }
 
+GadgetronClientAcquisitionStreamer::GadgetronClientAcquisitionStreamer
+(GadgetronClientConnector& con, unsigned int batch_size, 
+unsigned int queue_depth) :
+con_(con), batch_size_(batch_size ? batch_size : 1), 
+ring_(queue_depth ? queue_depth : 1), head_(0), tail_(0),
+reader_done_(false), abort_(false)
+{
+	for (unsigned int i = 0; i < ring_.size(); i++) {
+		ring_[i].acqs.resize(batch_size_);
+		ring_[i].size = 0;
+	}
+}
+
+void
+GadgetronClientAcquisitionStreamer::send(AcquisitionsContainer& acquisitions)
+{
+	// AcquisitionsFile::get_acquisition locks the HDF5 mutex itself
+	send(acquisitions.number(), 
+		[&](uint32_t i, ISMRMRD::Acquisition& acq)
+	{
+		acquisitions.get_acquisition(i, acq);
+	});
+}
+
+void
+GadgetronClientAcquisitionStreamer::send(ISMRMRD::Dataset& dataset)
+{
+	Mutex mutex;
+	boost::mutex& mtx = mutex();
+	uint32_t n;
+	{
+		boost::mutex::scoped_lock scoped_lock(mtx);
+		n = dataset.getNumberOfAcquisitions();
+	}
+	send(n, [&](uint32_t i, ISMRMRD::Acquisition& acq)
+	{
+		boost::mutex::scoped_lock scoped_lock(mtx);
+		dataset.readAcquisition(i, acq);
+	});
+}
+
+void
+GadgetronClientAcquisitionStreamer::read_task_(uint32_t n, Source& source)
+{
+	const size_t depth = ring_.size();
+	try {
+		for (uint32_t i = 0; i < n && !abort_;) {
+			size_t tail = tail_.load(std::memory_order_relaxed);
+			if (tail - head_.load(std::memory_order_acquire) >= depth) {
+				std::chrono::steady_clock::time_point t =
+					std::chrono::steady_clock::now();
+				stats_.reader_stalls++;
+				wait_([&]()
+				{
+					return tail - head_.load(std::memory_order_acquire) < depth
+						|| abort_;
+				});
+				stats_.reader_stall_us += microseconds_since(t);
+				if (abort_)
+					break;
+			}
+			Batch& batch = ring_[tail % depth];
+			uint32_t size = 0;
+			for (; size < batch_size_ && i < n; size++, i++)
+				source(i, batch.acqs[size]);
+			batch.size = size;
+			tail_.store(tail + 1, std::memory_order_release);
+			notify_();
+		}
+	}
+	catch (...) {
+		reader_error_ = std::current_exception();
+	}
+	reader_done_.store(true, std::memory_order_release);
+	notify_();
+}
+
+void
+GadgetronClientAcquisitionStreamer::wait_(const std::function<bool()>& ready)
+{
+	// the other side usually catches up quickly
+	const int spins = 100;
+	for (int i = 0; i < spins; i++) {
+		if (ready())
+			return;
+		std::this_thread::yield();
+	}
+	boost::mutex::scoped_lock lock(mutex_);
+	while (!ready())
+		cv_.wait(lock);
+}
+
+void
+GadgetronClientAcquisitionStreamer::notify_()
+{
+	// taking the mutex ensures that a waiter is either yet to check
+	// its condition or already waiting, so the wake-up is not lost
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+	}
+	cv_.notify_all();
+}
+
+void
+GadgetronClientAcquisitionStreamer::send(uint32_t n, Source source)
+{
+	const size_t depth = ring_.size();
+	stats_.reset();
+	head_ = 0;
+	tail_ = 0;
+	reader_done_ = false;
+	abort_ = false;
+	reader_error_ = std::exception_ptr();
+
+	std::thread reader(&GadgetronClientAcquisitionStreamer::read_task_,
+		this, n, std::ref(source));
+	double depth_sum = 0;
+	try {
+		for (;;) {
+			size_t head = head_.load(std::memory_order_relaxed);
+			size_t tail = tail_.load(std::memory_order_acquire);
+			if (head == tail) {
+				if (reader_done_.load(std::memory_order_acquire)) {
+					// the reader may have published its last batch
+					// just before signalling completion
+					if (head == tail_.load(std::memory_order_acquire))
+						break;
+					continue;
+				}
+				std::chrono::steady_clock::time_point t =
+					std::chrono::steady_clock::now();
+				stats_.sender_stalls++;
+				wait_([&]()
+				{
+					return head != tail_.load(std::memory_order_acquire) ||
+						reader_done_.load(std::memory_order_acquire);
+				});
+				stats_.sender_stall_us += microseconds_since(t);
+				continue;
+			}
+			unsigned int queued = (unsigned int)(tail - head);
+			if (queued > stats_.max_queue_depth)
+				stats_.max_queue_depth = queued;
+			depth_sum += queued;
+			Batch& batch = ring_[head % depth];
+			for (uint32_t i = 0; i < batch.size; i++)
+				con_.send_ismrmrd_acquisition(batch.acqs[i]);
+			stats_.acquisitions += batch.size;
+			stats_.batches++;
+			head_.store(head + 1, std::memory_order_release);
+			notify_();
+		}
+	}
+	catch (...) {
+		abort_ = true;
+		notify_();
+		reader.join();
+		throw;
+	}
+	reader.join();
+	if (stats_.batches)
+		stats_.mean_queue_depth = depth_sum / stats_.batches;
+	if (reader_error_)
+		std::rethrow_exception(reader_error_);
+}
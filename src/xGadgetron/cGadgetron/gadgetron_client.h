@@ -22,7 +22,9 @@ limitations under the License.
 #define GADGETRON_CLIENT
 
 #include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
 
@@ -30,12 +32,16 @@ limitations under the License.
 #include <ismrmrd/ismrmrd.h>
 #include <ismrmrd/meta.h>
 
+#include <atomic>
 #include <chrono>
-#include <condition_variable>
+#include <deque>
 #include <exception>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <string>
 #include <thread>
+#include <vector>
 
 using boost::asio::ip::tcp;
 
@@ -86,88 +92,474 @@ protected:
 
 class GadgetronClientMessageReader {
 public:
+	typedef std::function<void(const boost::system::error_code&)> Handler;
+
 	virtual ~GadgetronClientMessageReader() {}
 	/**
-	Function must be implemented to read a specific message.
+	Function must be implemented to read a specific message asynchronously
+	(the message id has already been read); handler must be called once
+	the message has been read completely or reading has failed.
+	*/
+	virtual void async_read(tcp::socket& s, Handler handler) = 0;
+	/**
+	Called once the connection has been closed: must not return before
+	all messages read so far have been stored, and must throw if storing
+	any of them has failed.
 	*/
-	virtual void read(tcp::socket* s) = 0;
+	virtual void finish() {}
+	// size in bytes of the last message read (excluding the message id)
+	virtual size_t message_size() const
+	{
+		return 0;
+	}
+};
+
+/*!
+\ingroup SIRF Gadgetron client
+\brief Hands items received on the io thread over to a storing thread.
+
+Messages are read into items of a pool of pre-allocated batches, which are
+reused once stored, so that no memory is allocated per message. Full
+batches are passed to a writer thread that stores each of them with one
+call to the flush function, so that reading from the socket is not held up
+by per-message storage overheads (such as HDF5 appends). If all batches
+are in use, ready() does not wait for the writer (which would hold up the
+io thread shared by all connections) but leaves the reading to be resumed
+once the writer has freed a batch, so that only this connection stops
+reading from the socket until the storage catches up.
+*/
+
+template<class Item>
+class GadgetronClientBatchWriter {
+public:
+	// stores the first n items of a batch
+	typedef std::function<void(std::vector<Item>&, size_t)> Flush;
+
+	GadgetronClientBatchWriter
+		(Flush flush, size_t batch_size = 64, size_t batches = 4) :
+		flush_(flush), batch_size_(batch_size ? batch_size : 1),
+		running_(false), stopping_(false), failed_(false)
+	{
+		for (size_t i = 0; i < (batches ? batches : 1); i++)
+			free_.push_back(shared_ptr<Batch>(new Batch(batch_size_)));
+	}
+	~GadgetronClientBatchWriter()
+	{
+		stop_();
+	}
+
+	// returns true if next() can be called; otherwise returns false and
+	// calls resume (on the writer thread) once a batch has been freed
+	bool ready(std::function<void()> resume)
+	{
+		if (current_.get())
+			return true;
+		boost::mutex::scoped_lock lock(mutex_);
+		if (free_.empty()) {
+			resume_ = resume;
+			return false;
+		}
+		current_ = free_.front();
+		free_.pop_front();
+		return true;
+	}
+	// pooled item to read the next message into, once ready() is true
+	Item& next()
+	{
+		return current_->items[current_->size];
+	}
+	// the item returned by next() is complete;
+	// returns false if storing has failed
+	bool commit()
+	{
+		current_->size++;
+		if (current_->size == batch_size_) {
+			submit_(current_);
+			current_.reset();
+		}
+		return !failed_;
+	}
+	// stores the items committed so far and waits for the writer to finish
+	void finish()
+	{
+		if (current_.get()) {
+			if (current_->size)
+				submit_(current_);
+			else
+				give_back_(current_);
+			current_.reset();
+		}
+		stop_();
+		if (failed_) {
+			failed_ = false;
+			throw GadgetronClientException("Failed to store received data");
+		}
+	}
+
+private:
+	struct Batch {
+		Batch(size_t n) : items(n), size(0) {}
+		std::vector<Item> items;
+		size_t size;
+	};
+
+	Flush flush_;
+	size_t batch_size_;
+	shared_ptr<Batch> current_;
+	std::deque<shared_ptr<Batch> > free_;
+	std::deque<shared_ptr<Batch> > full_;
+	boost::mutex mutex_;
+	boost::condition_variable cv_;
+	boost::thread thread_;
+	bool running_;
+	bool stopping_;
+	std::atomic<bool> failed_;
+	// resumes reading paused by ready()
+	std::function<void()> resume_;
+
+	void give_back_(shared_ptr<Batch> batch)
+	{
+		std::function<void()> resume;
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			free_.push_back(batch);
+			resume.swap(resume_);
+		}
+		if (resume)
+			resume();
+	}
+	void submit_(shared_ptr<Batch> batch)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		full_.push_back(batch);
+		if (!running_) {
+			running_ = true;
+			stopping_ = false;
+			thread_ = boost::thread(&GadgetronClientBatchWriter::write_, this);
+		}
+		cv_.notify_all();
+	}
+	void stop_()
+	{
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			if (!running_)
+				return;
+			stopping_ = true;
+			cv_.notify_all();
+		}
+		thread_.join();
+		running_ = false;
+	}
+	void write_()
+	{
+		for (;;) {
+			shared_ptr<Batch> batch;
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				while (full_.empty() && !stopping_)
+					cv_.wait(lock);
+				if (full_.empty())
+					return;
+				batch = full_.front();
+				full_.pop_front();
+			}
+			// after a failure, batches are discarded to keep the reader going
+			if (!failed_) {
+				try {
+					flush_(batch->items, batch->size);
+				}
+				catch (...) {
+					failed_ = true;
+				}
+			}
+			batch->size = 0;
+			give_back_(batch);
+		}
+	}
 };
 
 class GadgetronClientAcquisitionMessageCollector : 
 	public GadgetronClientMessageReader {
 public:
 	GadgetronClientAcquisitionMessageCollector
-		(shared_ptr<AcquisitionsContainer> ptr_acqs) : ptr_acqs_(ptr_acqs) {}
+		(shared_ptr<AcquisitionsContainer> ptr_acqs) : ptr_acqs_(ptr_acqs),
+		writer_([ptr_acqs](std::vector<ISMRMRD::Acquisition>& acqs, size_t n)
+	{
+		ptr_acqs->append_acquisitions(acqs, n);
+	})
+	{}
 	virtual ~GadgetronClientAcquisitionMessageCollector() {}
 
-	virtual void read(tcp::socket* stream);
+	virtual void async_read(tcp::socket& s, Handler handler);
+	virtual void finish()
+	{
+		writer_.finish();
+	}
+	virtual size_t message_size() const
+	{
+		return sizeof(ISMRMRD::AcquisitionHeader) + sizeof(float)*
+			(head_.trajectory_dimensions + 2 * head_.active_channels)*
+			head_.number_of_samples;
+	}
 
 private:
 	shared_ptr<AcquisitionsContainer> ptr_acqs_;
+	ISMRMRD::AcquisitionHeader head_;
+	GadgetronClientBatchWriter<ISMRMRD::Acquisition> writer_;
 };
 
 class GadgetronClientImageMessageCollector : 
 	public GadgetronClientMessageReader {
 public:
 	GadgetronClientImageMessageCollector
-		(shared_ptr<ImagesContainer> ptr_images) : ptr_images_(ptr_images) {}
-	virtual ~GadgetronClientImageMessageCollector() {}
-
-	template <typename T>
-	void read_data_attributes
-		(ISMRMRD::Image<T>* ptr, const ISMRMRD::ImageHeader& h, void** ptr_ptr, 
-		tcp::socket* stream)
-	{
-		ISMRMRD::Image < T >* ptr_im = new ISMRMRD::Image < T > ;
-		*ptr_ptr = (void*)ptr_im;
-		ISMRMRD::Image<T>& im = *ptr_im;
-		im.setHead(h);
-		im.setImageType(ISMRMRD::ISMRMRD_IMTYPE_MAGNITUDE);
-
-		//Read meta attributes
-		typedef unsigned long long size_t_type;
-		size_t_type meta_attrib_length;
-		boost::asio::read
-			(*stream, boost::asio::buffer(&meta_attrib_length, sizeof(size_t_type)));
-		if (meta_attrib_length>0) {
-			std::string meta_attrib(meta_attrib_length, 0);
-			boost::asio::read(*stream, boost::asio::buffer(const_cast<char*>
-				(meta_attrib.c_str()), meta_attrib_length));
-			im.setAttributeString(meta_attrib);
+		(shared_ptr<ImagesContainer> ptr_images) : 
+		ptr_images_(ptr_images), ptr_(0), data_(0), data_size_(0),
+		writer_([ptr_images](std::vector<ReceivedImage>& images, size_t n)
+	{
+		for (size_t i = 0; i < n; i++) {
+			ptr_images->append(images[i].sptr_iw);
+			images[i].sptr_iw.reset();
+			ptr_images->count(images[i].index);
 		}
-		//Read image data
-		boost::asio::read
-			(*stream, boost::asio::buffer(im.getDataPtr(), im.getDataSize()));
+	})
+	{}
+	virtual ~GadgetronClientImageMessageCollector()
+	{
+		discard_();
 	}
 
-	virtual void read(tcp::socket* stream);
+	virtual void async_read(tcp::socket& s, Handler handler);
+	virtual void finish()
+	{
+		writer_.finish();
+	}
+	virtual size_t message_size() const
+	{
+		return sizeof(ISMRMRD::ImageHeader) + sizeof(meta_attrib_length_) +
+			(size_t)meta_attrib_length_ + data_size_;
+	}
 
 private:
+	struct ReceivedImage {
+		shared_ptr<ImageWrap> sptr_iw;
+		uint32_t index;
+	};
+
 	shared_ptr<ImagesContainer> ptr_images_;
+	ISMRMRD::ImageHeader head_;
+	unsigned long long meta_attrib_length_;
+	std::string meta_attrib_;
+	// image being read
+	void* ptr_;
+	void* data_;
+	size_t data_size_;
+	GadgetronClientBatchWriter<ReceivedImage> writer_;
+
+	void read_attributes_(tcp::socket& s, Handler handler);
+	void read_data_(tcp::socket& s, Handler handler);
+	void discard_()
+	{
+		if (ptr_) {
+			IMAGE_PROCESSING_SWITCH(head_.data_type, delete_image_, ptr_);
+			ptr_ = 0;
+		}
+	}
+	template <typename T>
+	void new_image_(ISMRMRD::Image<T>*)
+	{
+		ISMRMRD::Image<T>* ptr_im = new ISMRMRD::Image<T>;
+		ptr_im->setHead(head_);
+		ptr_im->setImageType(ISMRMRD::ISMRMRD_IMTYPE_MAGNITUDE);
+		ptr_ = (void*)ptr_im;
+		data_ = (void*)ptr_im->getDataPtr();
+		data_size_ = ptr_im->getDataSize();
+	}
+	template <typename T>
+	void set_attributes_(ISMRMRD::Image<T>* ptr_im)
+	{
+		ptr_im->setAttributeString(meta_attrib_);
+	}
+	template <typename T>
+	void delete_image_(ISMRMRD::Image<T>* ptr_im)
+	{
+		delete ptr_im;
+	}
+};
+
+/*!
+\ingroup SIRF Gadgetron client
+\brief Gadgetron client session statistics.
+
+Collected by GadgetronClientConnector for one connection (times in
+microseconds): time taken to connect, time from queueing the configuration
+until it has been written to the socket, bytes and messages sent and
+received (bytes include message ids and the closing message, which is
+not counted as a message), the times
+from the connection being established to the first and last result
+received, time spent by the caller waiting for queued messages to be
+written (backpressure) and waiting for the server to finish.
+*/
+
+struct GadgetronClientSessionStats {
+	GadgetronClientSessionStats()
+	{
+		reset();
+	}
+	void reset()
+	{
+		connect_us = 0;
+		config_us = 0;
+		bytes_sent = 0;
+		bytes_received = 0;
+		messages_sent = 0;
+		messages_received = 0;
+		first_result_us = -1;
+		last_result_us = -1;
+		write_blocked_us = 0;
+		read_blocked_us = 0;
+	}
+	// adds up the statistics of concurrent sessions
+	void accumulate(const GadgetronClientSessionStats& stats)
+	{
+		connect_us += stats.connect_us;
+		config_us += stats.config_us;
+		bytes_sent += stats.bytes_sent;
+		bytes_received += stats.bytes_received;
+		messages_sent += stats.messages_sent;
+		messages_received += stats.messages_received;
+		if (stats.first_result_us >= 0 && (first_result_us < 0 ||
+			stats.first_result_us < first_result_us))
+			first_result_us = stats.first_result_us;
+		if (stats.last_result_us > last_result_us)
+			last_result_us = stats.last_result_us;
+		write_blocked_us += stats.write_blocked_us;
+		read_blocked_us += stats.read_blocked_us;
+	}
+	long long int connect_us;
+	long long int config_us;
+	unsigned long long int bytes_sent;
+	unsigned long long int bytes_received;
+	unsigned long long int messages_sent;
+	unsigned long long int messages_received;
+	// -1 if no results have been received
+	long long int first_result_us;
+	long long int last_result_us;
+	long long int write_blocked_us;
+	long long int read_blocked_us;
 };
 
+/*!
+\ingroup SIRF Gadgetron client
+\brief Event loop shared by all Gadgetron client connections.
+
+One io_service, run by one thread started on first use, drives the socket
+operations of all connections, so that concurrent sessions (e.g. those of
+a sharded reconstruction) do not take a thread each.
+*/
+
+class GadgetronClientEventLoop {
+public:
+	static boost::asio::io_service& io_service()
+	{
+		static GadgetronClientEventLoop loop;
+		return loop.io_service_;
+	}
+private:
+	GadgetronClientEventLoop() :
+		work_(new boost::asio::io_service::work(io_service_))
+	{
+		thread_ = boost::thread(&GadgetronClientEventLoop::run_, this);
+	}
+	~GadgetronClientEventLoop()
+	{
+		work_.reset();
+		io_service_.stop();
+		if (thread_.joinable())
+			thread_.join();
+	}
+	void run_()
+	{
+		for (;;) {
+			try {
+				io_service_.run();
+				return;
+			}
+			catch (...) {
+				// a failed handler must not stop the other sessions
+			}
+		}
+	}
+
+	boost::asio::io_service io_service_;
+	shared_ptr<boost::asio::io_service::work> work_;
+	boost::thread thread_;
+};
+
+/*!
+\ingroup SIRF Gadgetron client
+\brief Gadgetron client connector.
+
+All socket operations (connecting, writing, reading) are asynchronous and
+run on the thread of the shared GadgetronClientEventLoop, so a process
+may drive several connections without extra threads per connection.
+Handlers in flight are counted, and shutting the connection down waits
+for them, as they refer to the connector.
+Connecting is subject to a steady-timer deadline (see set_timeout()),
+and so is each write if set_write_timeout() has been given a non-zero
+value. The send_* methods serialise the message and queue it for
+writing; a caller is only held back before queueing a whole message, when
+the amount of queued data exceeds the high-water mark, so a slow server
+applies backpressure without the client blocking mid-message.
+*/
+
 class GadgetronClientConnector {
 public:
-	GadgetronClientConnector() : socket_(0), timeout_ms_(2000)
+	GadgetronClientConnector() :
+		io_service_(GadgetronClientEventLoop::io_service()),
+		pending_(0), socket_(0), timeout_ms_(2000),
+		write_timeout_ms_(0), high_water_mark_(64*1024*1024),
+		queued_bytes_(0), writing_(false), reading_(false),
+		closed_by_server_(false), connecting_(false)
 	{}
 	virtual ~GadgetronClientConnector()
 	{
-		if (socket_) {
-			socket_->close();
-			delete socket_;
-		}
+		shutdown_();
 	}
 
+	// connection timeout
 	void set_timeout(unsigned int t)
 	{
 		timeout_ms_ = t;
 	}
+	// timeout for writing one message, 0 for none
+	void set_write_timeout(unsigned int t)
+	{
+		write_timeout_ms_ = t;
+	}
+	// maximal amount of queued outgoing data in bytes
+	void set_high_water_mark(size_t bytes)
+	{
+		high_water_mark_ = bytes;
+	}
 
-	void read_task();
-
-	void wait() 
+	// waits for the server to close the connection, then shuts it down
+	void wait();
+	// aborts the current session, if any
+	void disconnect()
 	{
-		reader_thread_.join();
+		shutdown_();
+	}
+	// statistics of the current or last session, complete after wait()
+	const GadgetronClientSessionStats& session_stats() const
+	{
+		return stats_;
+	}
+	// true if the server has closed the connection properly, i.e. 
+	// all results have been received
+	bool closed_by_server() const
+	{
+		return closed_by_server_;
 	}
 
 	void connect(std::string hostname, std::string port);
@@ -183,20 +575,9 @@ public:
 	void send_ismrmrd_acquisition(ISMRMRD::Acquisition& acq);
 
 	template<typename T>
-	void send_ismrmrd_image(ISMRMRD::Image<T>* ptr_im)
+	void send_ismrmrd_image(const ISMRMRD::Image<T>* ptr_im)
 	{
-		ISMRMRD::Image<T>& im = *ptr_im;
-		if (!socket_)
-			throw GadgetronClientException("Invalid socket.");
-
-		GadgetMessageIdentifier id;
-		id.id = GADGET_MESSAGE_ISMRMRD_IMAGE;
-
-		boost::asio::write
-			(*socket_, boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
-		boost::asio::write
-			(*socket_,
-			boost::asio::buffer(&im.getHead(), sizeof(ISMRMRD::ImageHeader)));
+		const ISMRMRD::Image<T>& im = *ptr_im;
 
 		size_t meta_attrib_length = im.getAttributeStringLength();
 		std::string meta_attrib(meta_attrib_length + 1, 0);
@@ -210,18 +591,25 @@ public:
 			meta_attrib.erase(l);
 		}
 
-		boost::asio::write
-			(*socket_, boost::asio::buffer(&meta_attrib_length, sizeof(size_t)));
-		boost::asio::write
-			(*socket_, boost::asio::buffer(meta_attrib.c_str(), meta_attrib_length));
+		GadgetMessageIdentifier id;
+		id.id = GADGET_MESSAGE_ISMRMRD_IMAGE;
 
-		boost::asio::write
-			(*socket_, boost::asio::buffer(im.getDataPtr(), im.getDataSize()));
+		shared_ptr<std::vector<char> > msg(new std::vector<char>);
+		msg->reserve(sizeof(GadgetMessageIdentifier) + 
+			sizeof(ISMRMRD::ImageHeader) + sizeof(size_t) +
+			meta_attrib_length + im.getDataSize());
+		put_(*msg, &id, sizeof(GadgetMessageIdentifier));
+		put_(*msg, &im.getHead(), sizeof(ISMRMRD::ImageHeader));
+		put_(*msg, &meta_attrib_length, sizeof(size_t));
+		put_(*msg, meta_attrib.c_str(), meta_attrib_length);
+		put_(*msg, im.getDataPtr(), im.getDataSize());
+		post_message_(msg);
 	}
 
-	void send_wrapped_image(ImageWrap& iw)
+	void send_wrapped_image(const ImageWrap& iw)
 	{
-		IMAGE_PROCESSING_SWITCH(iw.type(), send_ismrmrd_image, iw.ptr_image());
+		IMAGE_PROCESSING_SWITCH_CONST
+			(iw.type(), send_ismrmrd_image, iw.ptr_image());
 	}
 
 	void register_reader
@@ -237,11 +625,205 @@ protected:
 
 	GadgetronClientMessageReader* find_reader(unsigned short r);
 
-	boost::asio::io_service io_service;
+	static void put_(std::vector<char>& msg, const void* ptr, size_t size)
+	{
+		const char* ptr_c = (const char*)ptr;
+		msg.insert(msg.end(), ptr_c, ptr_c + size);
+	}
+	void post_message_(shared_ptr<std::vector<char> > msg);
+	void shutdown_();
+
+	// wraps an asynchronous operation handler to count it as pending;
+	// the operation is done once the last copy of its handler has been
+	// destroyed, whether the handler has been run or dropped unrun
+	// (e.g. by a stopped io_service)
+	template<class F>
+	class Tracked {
+	public:
+		Tracked(GadgetronClientConnector* con, F f) : 
+			token_(new Token(con)), f_(f) {}
+		template<typename... Args>
+		void operator()(Args&&... args)
+		{
+			f_(std::forward<Args>(args)...);
+		}
+	private:
+		struct Token {
+			Token(GadgetronClientConnector* con) : con(con) {}
+			~Token()
+			{
+				con->op_done_();
+			}
+			GadgetronClientConnector* con;
+		};
+		shared_ptr<Token> token_;
+		F f_;
+	};
+	template<class F>
+	Tracked<F> track_(F f)
+	{
+		boost::mutex::scoped_lock lock(ops_mutex_);
+		pending_++;
+		return Tracked<F>(this, f);
+	}
+	void op_done_()
+	{
+		boost::mutex::scoped_lock lock(ops_mutex_);
+		pending_--;
+		ops_cv_.notify_all();
+	}
+
+	// io thread handlers
+	void read_next_();
+	void handle_message_id_(const boost::system::error_code& error);
+	void handle_message_(const boost::system::error_code& error);
+	void finish_reading_();
+	void write_next_();
+	void handle_write_(const boost::system::error_code& error);
+
+	boost::asio::io_service& io_service_;
+	// handlers not yet run or dropped
+	unsigned int pending_;
+	boost::mutex ops_mutex_;
+	boost::condition_variable ops_cv_;
+	shared_ptr<boost::asio::steady_timer> deadline_;
 	tcp::socket* socket_;
-	boost::thread reader_thread_;
 	maptype readers_;
 	unsigned int timeout_ms_;
+	unsigned int write_timeout_ms_;
+
+	// outgoing messages
+	size_t high_water_mark_;
+	size_t queued_bytes_;
+	bool writing_;
+	std::deque<shared_ptr<std::vector<char> > > out_queue_;
+	boost::system::error_code write_error_;
+	boost::mutex out_mutex_;
+	boost::condition_variable out_cv_;
+
+	// incoming messages
+	GadgetMessageIdentifier in_id_;
+	bool reading_;
+	bool closed_by_server_;
+	boost::mutex in_mutex_;
+	boost::condition_variable in_cv_;
+
+	bool connecting_;
+
+	// session statistics
+	GadgetronClientSessionStats stats_;
+	std::chrono::steady_clock::time_point session_start_;
+	std::chrono::steady_clock::time_point config_start_;
+};
+
+/*!
+\ingroup SIRF Gadgetron client
+\brief Acquisitions streaming statistics.
+
+Collected by GadgetronClientAcquisitionStreamer: queue depth is sampled
+each time the sender takes a batch off the queue, reader stalls are
+the occasions when the queue was full, sender stalls those when it was
+empty (times in microseconds).
+*/
+
+struct GadgetronClientStreamingStats {
+	GadgetronClientStreamingStats()
+	{
+		reset();
+	}
+	void reset()
+	{
+		acquisitions = 0;
+		batches = 0;
+		max_queue_depth = 0;
+		mean_queue_depth = 0;
+		reader_stalls = 0;
+		sender_stalls = 0;
+		reader_stall_us = 0;
+		sender_stall_us = 0;
+	}
+	// adds up the statistics of concurrent streams
+	void accumulate(const GadgetronClientStreamingStats& stats)
+	{
+		double depth_sum = mean_queue_depth*batches +
+			stats.mean_queue_depth*stats.batches;
+		acquisitions += stats.acquisitions;
+		batches += stats.batches;
+		if (stats.max_queue_depth > max_queue_depth)
+			max_queue_depth = stats.max_queue_depth;
+		mean_queue_depth = batches ? depth_sum / batches : 0;
+		reader_stalls += stats.reader_stalls;
+		sender_stalls += stats.sender_stalls;
+		reader_stall_us += stats.reader_stall_us;
+		sender_stall_us += stats.sender_stall_us;
+	}
+	unsigned int acquisitions;
+	unsigned int batches;
+	unsigned int max_queue_depth;
+	double mean_queue_depth;
+	unsigned int reader_stalls;
+	unsigned int sender_stalls;
+	long long int reader_stall_us;
+	long long int sender_stall_us;
+};
+
+/*!
+\ingroup SIRF Gadgetron client
+\brief Pipelined sender of acquisitions.
+
+A reader thread prefetches acquisitions in batches into a bounded
+single-producer/single-consumer ring of pre-allocated batches, while
+the calling thread drains the ring into the socket, so that reading
+acquisitions from storage overlaps with sending them to the server.
+The ring is lock-free: the reader only advances tail_, the sender
+only advances head_. A side that finds the ring full (reader) or empty
+(sender) spins briefly and then sleeps on a condition variable until
+the other side has made progress, so that waiting on the slower side
+does not keep a core busy.
+*/
+
+class GadgetronClientAcquisitionStreamer {
+public:
+	typedef std::function<void(uint32_t, ISMRMRD::Acquisition&)> Source;
+
+	GadgetronClientAcquisitionStreamer(GadgetronClientConnector& con,
+		unsigned int batch_size = 32, unsigned int queue_depth = 8);
+
+	// sends all acquisitions in the container
+	void send(AcquisitionsContainer& acquisitions);
+	// sends all acquisitions in the dataset (reads are mutex-protected)
+	void send(ISMRMRD::Dataset& dataset);
+	// sends n acquisitions, i-th of which is read by source(i, acq)
+	void send(uint32_t n, Source source);
+
+	const GadgetronClientStreamingStats& stats() const
+	{
+		return stats_;
+	}
+
+private:
+	struct Batch {
+		std::vector<ISMRMRD::Acquisition> acqs;
+		uint32_t size;
+	};
+
+	void read_task_(uint32_t n, Source& source);
+	// returns once ready() is true
+	void wait_(const std::function<bool()>& ready);
+	// wakes up the other side after head_, tail_ or a flag has changed
+	void notify_();
+
+	GadgetronClientConnector& con_;
+	unsigned int batch_size_;
+	std::vector<Batch> ring_;
+	std::atomic<size_t> head_;
+	std::atomic<size_t> tail_;
+	std::atomic<bool> reader_done_;
+	std::atomic<bool> abort_;
+	std::exception_ptr reader_error_;
+	boost::mutex mutex_;
+	boost::condition_variable cv_;
+	GadgetronClientStreamingStats stats_;
 };
 
 #endif
@@ -27,8 +27,14 @@ limitations under the License.
 \author CCP PETMR
 */
 
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
 #include "gadgetron_data_containers.h"
+#include "gadgetron_native.h"
 #include "cgadgetron_shared_ptr.h"
+#include "localised_exception.h"
 using namespace gadgetron;
 
 shared_ptr<AcquisitionsContainer> 
@@ -142,6 +148,22 @@ AcquisitionsContainer::get_acquisitions_flags(unsigned int n, int* flags)
 	}
 }
 
+unsigned int
+AcquisitionsContainer::get_acquisitions_headers
+(ISMRMRD::AcquisitionHeader* headers)
+{
+	const unsigned int batch_size = 64;
+	std::vector<ISMRMRD::Acquisition> acqs(batch_size);
+	unsigned int na = number();
+	for (unsigned int a = 0; a < na; a += batch_size) {
+		unsigned int nb = std::min(batch_size, na - a);
+		get_acquisitions(a, nb, acqs);
+		for (unsigned int b = 0; b < nb; b++)
+			headers[a + b] = acqs[b].getHead();
+	}
+	return na;
+}
+
 unsigned int 
 AcquisitionsContainer::get_acquisitions_data(unsigned int slice, float* re, float* im)
 {
@@ -168,12 +190,11 @@ AcquisitionsContainer::get_acquisitions_data(unsigned int slice, float* re, floa
 		}
 		return n;
 	}
-	int* dim = new int[3];
-	size_t ptr_dim = (size_t)dim;
-	get_acquisitions_dimensions(ptr_dim);
+	// get_acquisitions_dimensions() sets up to 4 values
+	int dim[4] = { 0, 0, 0, 0 };
+	get_acquisitions_dimensions((size_t)dim);
 	unsigned int ny = dim[2]; //e.reconSpace.matrixSize.y;
 							  //unsigned int ny = dim[1]; //e.reconSpace.matrixSize.y;
-	delete[] dim;
 	unsigned int y = 0;
 	for (; y + ny*slice < na;) {
 		get_acquisition(y + ny*slice, acq);
@@ -181,7 +202,7 @@ AcquisitionsContainer::get_acquisitions_data(unsigned int slice, float* re, floa
 			break;
 		y++;
 	}
-	for (; y + ny*slice < na; n++) {
+	for (; y + ny*slice < na;) {
 		get_acquisition(y + ny*slice, acq);
 		unsigned int nc = acq.active_channels();
 		unsigned int ns = acq.number_of_samples();
@@ -192,6 +213,7 @@ AcquisitionsContainer::get_acquisitions_data(unsigned int slice, float* re, floa
 				im[s + ns*(n + ny*c)] = std::imag(z);
 			}
 		}
+		n++;
 		y++;
 		if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_LAST_IN_SLICE))
 			break;
@@ -199,6 +221,60 @@ AcquisitionsContainer::get_acquisitions_data(unsigned int slice, float* re, floa
 	return n;
 }
 
+unsigned int
+AcquisitionsContainer::get_acquisitions_data
+(unsigned int slice, complex_float_t* z)
+{
+	unsigned int na = number();
+	if (slice < na) {
+		// same layout as for real and imaginary parts, filled in place
+		int dim[4] = { 0, 0, 0, 0 };
+		get_acquisitions_dimensions((size_t)dim);
+		unsigned int ny = dim[2];
+		ISMRMRD::Acquisition acq;
+		unsigned int y = 0;
+		for (; y + ny*slice < na;) {
+			get_acquisition(y + ny*slice, acq);
+			if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_FIRST_IN_SLICE))
+				break;
+			y++;
+		}
+		unsigned int n = 0;
+		for (; y + ny*slice < na;) {
+			get_acquisition(y + ny*slice, acq);
+			unsigned int nc = acq.active_channels();
+			unsigned int ns = acq.number_of_samples();
+			for (unsigned int c = 0; c < nc; c++)
+				for (unsigned int s = 0; s < ns; s++)
+					z[s + ns*(n + ny*c)] = acq.data(s, c);
+			n++;
+			y++;
+			if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_LAST_IN_SLICE))
+				break;
+		}
+		return n;
+	}
+	// readouts are stored coil after coil as in ISMRMRD::Acquisition,
+	// hence are copied as a whole, a batch of them at a time
+	const unsigned int batch_size = 64;
+	std::vector<ISMRMRD::Acquisition> acqs(batch_size);
+	unsigned int n = 0;
+	for (unsigned int a = 0; a < na; a += batch_size) {
+		unsigned int nb = std::min(batch_size, na - a);
+		get_acquisitions(a, nb, acqs);
+		for (unsigned int b = 0; b < nb; b++) {
+			ISMRMRD::Acquisition& acq = acqs[b];
+			if (TO_BE_IGNORED(acq) && slice > na) {
+				std::cout << "ignoring acquisition " << a + b << '\n';
+				continue;
+			}
+			n++;
+			z = std::copy(acq.data_begin(), acq.data_end(), z);
+		}
+	}
+	return n;
+}
+
 void 
 AcquisitionsContainer::axpby
 (complex_float_t a, const ISMRMRD::Acquisition& acq_x,
@@ -480,6 +556,26 @@ AcquisitionsFile::get_acquisition(unsigned int num, ISMRMRD::Acquisition& acq)
 	mtx.unlock();
 }
 
+void
+AcquisitionsFile::get_acquisitions(unsigned int first, unsigned int n,
+	std::vector<ISMRMRD::Acquisition>& acqs)
+{
+	if (acqs.size() < n)
+		acqs.resize(n);
+	// one lock for the whole batch
+	Mutex mtx;
+	mtx.lock();
+	try {
+		for (unsigned int i = 0; i < n; i++)
+			dataset_->readAcquisition(index(first + i), acqs[i]);
+	}
+	catch (...) {
+		mtx.unlock();
+		throw;
+	}
+	mtx.unlock();
+}
+
 void 
 AcquisitionsFile::append_acquisition(ISMRMRD::Acquisition& acq)
 {
@@ -489,6 +585,24 @@ AcquisitionsFile::append_acquisition(ISMRMRD::Acquisition& acq)
 	mtx.unlock();
 }
 
+void
+AcquisitionsFile::append_acquisitions
+(std::vector<ISMRMRD::Acquisition>& acqs, size_t n)
+{
+	// one lock for the whole batch
+	Mutex mtx;
+	mtx.lock();
+	try {
+		for (size_t i = 0; i < n; i++)
+			dataset_->appendAcquisition(acqs[i]);
+	}
+	catch (...) {
+		mtx.unlock();
+		throw;
+	}
+	mtx.unlock();
+}
+
 void 
 AcquisitionsFile::copy_acquisitions_info(const AcquisitionsContainer& ac)
 {
@@ -511,6 +625,51 @@ AcquisitionsFile::write_acquisitions_info()
 int
 AcquisitionsFile::set_acquisition_data
 (int na, int nc, int ns, const float* re, const float* im)
+{
+	return set_acquisition_data_(na, nc, ns,
+		[=](ISMRMRD::Acquisition& acq, size_t i)
+	{
+		for (int c = 0; c < nc; c++)
+			for (int s = 0; s < ns; s++, i++)
+				acq.data(s, c) = complex_float_t((float)re[i], (float)im[i]);
+	});
+}
+
+int
+AcquisitionsFile::set_acquisition_data
+(int na, int nc, int ns, const complex_float_t* z)
+{
+	return set_acquisition_data_(na, nc, ns,
+		[=](ISMRMRD::Acquisition& acq, size_t i)
+	{
+		std::copy(z + i, z + i + (size_t)nc*ns, acq.data_begin());
+	});
+}
+
+void
+AcquisitionsFile::set_acquisitions_headers
+(const ISMRMRD::AcquisitionHeader* headers)
+{
+	// headers are stored with the data, hence all acquisitions are
+	// rewritten, a batch at a time, in the order of the headers
+	AcquisitionsFile af(acqs_info_);
+	af.set_ordered(true);
+	const unsigned int batch_size = 64;
+	std::vector<ISMRMRD::Acquisition> acqs(batch_size);
+	unsigned int na = number();
+	for (unsigned int a = 0; a < na; a += batch_size) {
+		unsigned int nb = std::min(batch_size, na - a);
+		get_acquisitions(a, nb, acqs);
+		for (unsigned int b = 0; b < nb; b++)
+			acqs[b].setHead(headers[a + b]);
+		af.append_acquisitions(acqs, nb);
+	}
+	take_over(af);
+}
+
+int
+AcquisitionsFile::set_acquisition_data_
+(int na, int nc, int ns, ReadoutSetter set)
 {
 	shared_ptr<AcquisitionsContainer> sptr_ac =
 		this->new_acquisitions_container();
@@ -518,22 +677,32 @@ AcquisitionsFile::set_acquisition_data
 	ptr_ac->set_acquisitions_info(acqs_info_);
 	ptr_ac->write_acquisitions_info();
 	ptr_ac->set_ordered(true);
-	ISMRMRD::Acquisition acq;
+	// acquisitions are read and written a batch at a time
+	const unsigned int batch_size = 64;
+	std::vector<ISMRMRD::Acquisition> acqs(batch_size);
+	std::vector<ISMRMRD::Acquisition> out;
+	out.reserve(batch_size);
 	int ma = number();
-	for (int a = 0, i = 0; a < ma; a++) {
-		get_acquisition(a, acq);
-		if (TO_BE_IGNORED(acq) && ma > na) {
-			std::cout << "ignoring acquisition " << a << '\n';
-			continue;
+	size_t i = 0;
+	for (int a = 0; a < ma; a += batch_size) {
+		unsigned int nb = std::min(batch_size, (unsigned int)(ma - a));
+		get_acquisitions(a, nb, acqs);
+		out.clear();
+		for (unsigned int b = 0; b < nb; b++) {
+			ISMRMRD::Acquisition& acq = acqs[b];
+			if (TO_BE_IGNORED(acq) && ma > na) {
+				std::cout << "ignoring acquisition " << a + b << '\n';
+				continue;
+			}
+			unsigned int mc = acq.active_channels();
+			unsigned int ms = acq.number_of_samples();
+			if (mc != nc || ms != ns)
+				return -1;
+			set(acq, i);
+			i += (size_t)nc*ns;
+			out.push_back(acq);
 		}
-		unsigned int mc = acq.active_channels();
-		unsigned int ms = acq.number_of_samples();
-		if (mc != nc || ms != ns)
-			return -1;
-		for (int c = 0; c < nc; c++)
-			for (int s = 0; s < ns; s++, i++)
-				acq.data(s, c) = complex_float_t((float)re[i], (float)im[i]);
-		sptr_ac->append_acquisition(acq);
+		sptr_ac->append_acquisitions(out, out.size());
 	}
 	take_over(*sptr_ac);
 	return 0;
@@ -543,8 +712,36 @@ int
 AcquisitionsVector::set_acquisition_data
 (int na, int nc, int ns, const float* re, const float* im)
 {
+	return set_acquisition_data_(na, nc, ns,
+		[=](ISMRMRD::Acquisition& acq, size_t i)
+	{
+		for (int c = 0; c < nc; c++)
+			for (int s = 0; s < ns; s++, i++)
+				acq.data(s, c) = complex_float_t((float)re[i], (float)im[i]);
+	});
+}
+
+int 
+AcquisitionsVector::set_acquisition_data
+(int na, int nc, int ns, const complex_float_t* z)
+{
+	return set_acquisition_data_(na, nc, ns,
+		[=](ISMRMRD::Acquisition& acq, size_t i)
+	{
+		std::copy(z + i, z + i + (size_t)nc*ns, acq.data_begin());
+	});
+}
+
+int 
+AcquisitionsVector::set_acquisition_data_
+(int na, int nc, int ns, ReadoutSetter set)
+{
+	// the readouts to set and their positions in the input are found
+	// first, then the readouts are set in parallel
+	std::vector<std::pair<ISMRMRD::Acquisition*, size_t> > readouts;
 	int ma = number();
-	for (int a = 0, i = 0; a < ma; a++) {
+	size_t i = 0;
+	for (int a = 0; a < ma; a++) {
 		ISMRMRD::Acquisition& acq = *acqs_[a];
 		if (TO_BE_IGNORED(acq) && ma > na) {
 			std::cout << "ignoring acquisition " << a << '\n';
@@ -554,10 +751,14 @@ AcquisitionsVector::set_acquisition_data
 		unsigned int ms = acq.number_of_samples();
 		if (mc != nc || ms != ns)
 			return -1;
-		for (int c = 0; c < nc; c++)
-			for (int s = 0; s < ns; s++, i++)
-				acq.data(s, c) = complex_float_t((float)re[i], (float)im[i]);
+		readouts.push_back(std::make_pair(&acq, i));
+		i += (size_t)nc*ns;
 	}
+	native_parallel_for(readouts.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t r = begin; r < end; r++)
+			set(*readouts[r].first, readouts[r].second);
+	}, 256);
 	return 0;
 }
 
@@ -606,22 +807,61 @@ ImagesContainer::norm()
 	return r;
 }
 
-ImagesVector::ImagesVector(const ImagesVector& list, const char* attr, const char* target)
+void
+ImagesContainer::get_images_data_as_complex_array(complex_float_t* data)
 {
-#ifdef _MSC_VER
-	std::vector<shared_ptr<ImageWrap> >::const_iterator i;
-#else
-	typename std::vector<shared_ptr<ImageWrap> >::const_iterator i;
-#endif
-	for (i = list.images_.begin(); i != list.images_.end(); i++) {
-		const shared_ptr<ImageWrap>& sptr_iw = *i;
-		std::string atts = sptr_iw->attributes();
-		ISMRMRD::MetaContainer mc;
-		ISMRMRD::deserialize(atts.c_str(), mc);
-		std::string value = mc.as_str(attr);
-		if (boost::iequals(value, target))
-			append(*sptr_iw);
+	const ImagesContainer& images = *this;
+	int dim[4];
+	for (unsigned int i = 0; i < number(); i++) {
+		const ImageWrap& iw = images.image_wrap(i);
+		size_t n = iw.get_dim(dim);
+		iw.get_complex_data(data);
+		data += n;
+	}
+}
+
+void
+ImagesContainer::set_complex_images_data(const complex_float_t* data)
+{
+	int dim[4];
+	for (unsigned int i = 0; i < number(); i++) {
+		ImageWrap& iw = image_wrap(i);
+		size_t n = iw.get_dim(dim);
+		iw.set_complex_data(data);
+		data += n;
+	}
+}
+
+ImagesVector::ImagesVector
+(const ImagesVector& list, const char* attr, const char* target) : nimages_(0)
+{
+	std::vector<unsigned int> selected = list.images_with_(attr, target);
+	// copies share the images until either is changed
+	for (unsigned int i = 0; i < selected.size(); i++)
+		append(*list.images_[selected[i]]);
+}
+
+std::vector<unsigned int>
+ImagesVector::images_with_(const char* attr, const char* target) const
+{
+	std::lock_guard<std::mutex> lock(attr_index_mutex_);
+	std::map<std::string, AttributeIndex>::iterator i = attr_index_.find(attr);
+	if (i == attr_index_.end()) {
+		AttributeIndex index;
+		for (unsigned int j = 0; j < images_.size(); j++) {
+			std::string atts = images_[j]->attributes();
+			ISMRMRD::MetaContainer mc;
+			ISMRMRD::deserialize(atts.c_str(), mc);
+			std::string value = mc.as_str(attr);
+			index[boost::to_lower_copy(value)].push_back(j);
+		}
+		i = attr_index_.insert(std::make_pair(std::string(attr), index)).first;
 	}
+	AttributeIndex::const_iterator k = 
+		i->second.find(boost::to_lower_copy(std::string(target)));
+	if (k == i->second.end())
+		return std::vector<unsigned int>();
+	return k->second;
 }
 
 ImagesVector::ImagesVector(const ImagesVector& list, unsigned int inc, unsigned int off)
@@ -648,22 +888,7 @@ ImagesVector::ImagesVector(const ImagesVector& list, unsigned int inc, unsigned
 void
 ImagesVector::write(std::string filename, std::string groupname)
 {
-	if (images_.size() < 1)
-		return;
-	Mutex mtx;
-	mtx.lock();
-	ISMRMRD::Dataset dataset(filename.c_str(), groupname.c_str());
-	mtx.unlock();
-#ifdef _MSC_VER
-	std::vector<shared_ptr<ImageWrap> >::iterator i;
-#else
-	typename std::vector<shared_ptr<ImageWrap> >::iterator i;
-#endif
-	for (i = images_.begin(); i != images_.end(); i++) {
-		shared_ptr<ImageWrap>& sptr_iw = *i;
-		ImageWrap& iw = *sptr_iw;
-		iw.write(dataset);
-	}
+	ImagesWriter::write(images_, filename, groupname);
 }
 
 void
@@ -737,6 +962,421 @@ ImagesVector::set_complex_images_data(const float* re, const float* im)
 	}
 }
 
+shared_ptr<ImagesContainer>
+ImagesContainer::imgs_templ_(new ImagesVector);
+
+shared_ptr<ImagesContainer>
+ImagesContainer::new_default()
+{
+	return imgs_templ_->new_images_container();
+}
+
+// pixel values of these types are held exactly by complex floats
+static bool
+block_data_type(int type)
+{
+	return type == ISMRMRD::ISMRMRD_USHORT || type == ISMRMRD::ISMRMRD_SHORT ||
+		type == ISMRMRD::ISMRMRD_FLOAT || type == ISMRMRD::ISMRMRD_CXFLOAT;
+}
+
+template<typename T>
+static void*
+new_block_image(const int* dim, const ISMRMRD::ImageHeader& head, 
+	const std::string& attr)
+{
+	ISMRMRD::Image<T>* ptr_img = 
+		new ISMRMRD::Image<T>(dim[0], dim[1], dim[2], dim[3]);
+	ptr_img->setHead(head);
+	ptr_img->setAttributeString(attr);
+	return ptr_img;
+}
+
+ImagesBlock::ImagesBlock
+(const ImagesBlock& list, const char* attr, const char* target) :
+	nimages_(0), size_(0)
+{
+	dim_[0] = dim_[1] = dim_[2] = dim_[3] = 0;
+	list.sync_();
+	for (unsigned int i = 0; i < list.headers_.size(); i++) {
+		ISMRMRD::MetaContainer mc;
+		ISMRMRD::deserialize(list.attributes_[i].c_str(), mc);
+		std::string value = mc.as_str(attr);
+		if (boost::iequals(value, target))
+			append_(list, i);
+	}
+}
+
+ImagesBlock::ImagesBlock
+(const ImagesBlock& list, unsigned int inc, unsigned int off) :
+	nimages_(0), size_(0)
+{
+	dim_[0] = dim_[1] = dim_[2] = dim_[3] = 0;
+	list.sync_();
+	int n = 0;
+	for (unsigned int i = off; i < list.headers_.size(); i += inc, n++)
+		append_(list, i);
+	nimages_ = n;
+}
+
+void
+ImagesBlock::append(const ImageWrap& iw)
+{
+	if (!block_data_type(iw.type()))
+		throw LocalisedException
+		("images of this data type cannot be stored in a block", 
+		__FILE__, __LINE__);
+	int dim[4];
+	size_t n = iw.get_dim(dim);
+	if (headers_.size() < 1) {
+		for (int i = 0; i < 4; i++)
+			dim_[i] = dim[i];
+		size_ = n;
+	}
+	else if (dim[0] != dim_[0] || dim[1] != dim_[1] || 
+		dim[2] != dim_[2] || dim[3] != dim_[3])
+		throw LocalisedException
+		("images of different dimensions cannot share one block", 
+		__FILE__, __LINE__);
+	unsigned int im_num = (unsigned int)headers_.size();
+	data_.resize((im_num + 1)*size_);
+	iw.get_complex_data(data_ptr_(im_num));
+	headers_.push_back(iw.head());
+	attributes_.push_back(iw.attributes());
+}
+
+void
+ImagesBlock::append_(const ImagesBlock& list, unsigned int im_num)
+{
+	if (headers_.size() < 1) {
+		for (int i = 0; i < 4; i++)
+			dim_[i] = list.dim_[i];
+		size_ = list.size_;
+	}
+	const complex_float_t* ptr = list.data_ptr_(im_num);
+	data_.insert(data_.end(), ptr, ptr + size_);
+	headers_.push_back(list.headers_[im_num]);
+	attributes_.push_back(list.attributes_[im_num]);
+}
+
+shared_ptr<ImageWrap>
+ImagesBlock::new_image_wrap_(unsigned int im_num) const
+{
+	const ISMRMRD::ImageHeader& head = headers_[im_num];
+	const std::string& attr = attributes_[im_num];
+	int type = head.data_type;
+	void* ptr_img;
+	if (type == ISMRMRD::ISMRMRD_USHORT)
+		ptr_img = new_block_image<unsigned short>(dim_, head, attr);
+	else if (type == ISMRMRD::ISMRMRD_SHORT)
+		ptr_img = new_block_image<short>(dim_, head, attr);
+	else if (type == ISMRMRD::ISMRMRD_FLOAT)
+		ptr_img = new_block_image<float>(dim_, head, attr);
+	else
+		ptr_img = new_block_image<complex_float_t>(dim_, head, attr);
+	shared_ptr<ImageWrap> sptr_iw(new ImageWrap(type, ptr_img));
+	sptr_iw->set_complex_data(data_ptr_(im_num));
+	return sptr_iw;
+}
+
+shared_ptr<ImageWrap>
+ImagesBlock::cached_image_wrap_(unsigned int im_num, bool modifiable) const
+{
+	if (im_num >= headers_.size())
+		throw LocalisedException
+		("image number out of range", __FILE__, __LINE__);
+	std::lock_guard<std::mutex> lock(wraps_mutex_);
+	std::pair<shared_ptr<ImageWrap>, bool>& entry = wraps_[im_num];
+	if (!entry.first.get())
+		entry.first = new_image_wrap_(im_num);
+	entry.second = entry.second || modifiable;
+	return entry.first;
+}
+
+shared_ptr<ImageWrap>
+ImagesBlock::sptr_image_wrap(unsigned int im_num)
+{
+	return cached_image_wrap_(im_num, true);
+}
+
+shared_ptr<const ImageWrap>
+ImagesBlock::sptr_image_wrap(unsigned int im_num) const
+{
+	return cached_image_wrap_(im_num, false);
+}
+
+void
+ImagesBlock::sync_() const
+{
+	// the block only receives the values its wraps are meant to show,
+	// hence this is logically const
+	ImagesBlock& self = const_cast<ImagesBlock&>(*this);
+	std::lock_guard<std::mutex> lock(wraps_mutex_);
+	std::map<unsigned int, std::pair<shared_ptr<ImageWrap>, bool> >::iterator i;
+	for (i = wraps_.begin(); i != wraps_.end();) {
+		unsigned int im_num = i->first;
+		const shared_ptr<ImageWrap>& sptr_iw = i->second.first;
+		if (i->second.second) {
+			self.headers_[im_num] = sptr_iw->head();
+			self.attributes_[im_num] = sptr_iw->attributes();
+			sptr_iw->get_complex_data(self.data_ptr_(im_num));
+		}
+		// wraps are handed out only under the lock, so one held by the
+		// cache alone cannot be got hold of meanwhile
+		if (sptr_iw.use_count() == 1)
+			i = wraps_.erase(i);
+		else
+			i++;
+	}
+}
+
+void
+ImagesBlock::refresh_()
+{
+	std::lock_guard<std::mutex> lock(wraps_mutex_);
+	std::map<unsigned int, std::pair<shared_ptr<ImageWrap>, bool> >::iterator i;
+	for (i = wraps_.begin(); i != wraps_.end(); i++)
+		i->second.first->set_complex_data(data_ptr_(i->first));
+}
+
+void
+ImagesBlock::write(std::string filename, std::string groupname)
+{
+	if (headers_.size() < 1)
+		return;
+	sync_();
+	Mutex mtx;
+	mtx.lock();
+	ISMRMRD::Dataset dataset(filename.c_str(), groupname.c_str());
+	mtx.unlock();
+	for (unsigned int i = 0; i < headers_.size(); i++)
+		new_image_wrap_(i)->write(dataset);
+}
+
+void
+ImagesBlock::get_images_data_as_float_array(float* data) const
+{
+	sync_();
+	const float* x = reinterpret_cast<const float*>(data_.data());
+	size_t n = data_.size();
+	for (size_t i = 0; i < n; i++)
+		data[i] = x[2*i];
+}
+
+void
+ImagesBlock::get_images_data_as_complex_array(float* re, float* im) const
+{
+	sync_();
+	const float* x = reinterpret_cast<const float*>(data_.data());
+	size_t n = data_.size();
+	for (size_t i = 0; i < n; i++) {
+		re[i] = x[2*i];
+		im[i] = x[2*i + 1];
+	}
+}
+
+void
+ImagesBlock::set_complex_images_data(const float* re, const float* im)
+{
+	sync_();
+	float* x = reinterpret_cast<float*>(data_.data());
+	size_t n = data_.size();
+	for (size_t i = 0; i < n; i++) {
+		x[2*i] = re[i];
+		x[2*i + 1] = im[i];
+	}	refresh_();
+}
+
+void
+ImagesBlock::get_images_data_as_complex_array(complex_float_t* data)
+{
+	sync_();
+	std::copy(data_.begin(), data_.end(), data);
+}
+
+void
+ImagesBlock::set_complex_images_data(const complex_float_t* data)
+{
+	sync_();
+	std::copy(data, data + data_.size(), data_.begin());
+	refresh_();
+}
+
+void
+ImagesBlock::axpby(
+	complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+	complex_float_t b, const aDataContainer<complex_float_t>& a_y)
+{
+	const ImagesBlock* ptr_x = dynamic_cast<const ImagesBlock*>(&a_x);
+	const ImagesBlock* ptr_y = dynamic_cast<const ImagesBlock*>(&a_y);
+	if (!ptr_x || !ptr_y || ptr_x->size_ != ptr_y->size_ ||
+		(headers_.size() > 0 && ptr_x->size_ != size_)) {
+		ImagesContainer::axpby(a, a_x, b, a_y);
+		return;
+	}
+	const ImagesBlock& x = *ptr_x;
+	const ImagesBlock& y = *ptr_y;
+	x.sync_();
+	y.sync_();
+	sync_();
+	size_t n = std::min(x.headers_.size(), y.headers_.size());
+	size_t first = headers_.size();
+	// copied before resizing, as x may be this container
+	std::vector<ISMRMRD::ImageHeader> 
+		headers(x.headers_.begin(), x.headers_.begin() + n);
+	std::vector<std::string> 
+		attributes(x.attributes_.begin(), x.attributes_.begin() + n);
+	if (first < 1) {
+		for (int i = 0; i < 4; i++)
+			dim_[i] = x.dim_[i];
+		size_ = x.size_;
+	}
+	data_.resize((first + n)*size_);
+	headers_.insert(headers_.end(), headers.begin(), headers.end());
+	attributes_.insert(attributes_.end(), attributes.begin(), attributes.end());
+
+	const float* u = reinterpret_cast<const float*>(x.data_.data());
+	const float* v = reinterpret_cast<const float*>(y.data_.data());
+	float* w = reinterpret_cast<float*>(data_ptr_((unsigned int)first));
+	float ar = a.real();
+	float ai = a.imag();
+	float br = b.real();
+	float bi = b.imag();
+	native_parallel_for(n*size_, [=](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++) {
+			float ur = u[2*i];
+			float ui = u[2*i + 1];
+			float vr = v[2*i];
+			float vi = v[2*i + 1];
+			w[2*i] = ar*ur - ai*ui + br*vr - bi*vi;
+			w[2*i + 1] = ar*ui + ai*ur + br*vi + bi*vr;
+		}
+	}, 1 << 16);
+}
+
+complex_float_t
+ImagesBlock::dot(const aDataContainer<complex_float_t>& dc)
+{
+	const ImagesBlock* ptr_x = dynamic_cast<const ImagesBlock*>(&dc);
+	if (!ptr_x || ptr_x->size_ != size_)
+		return ImagesContainer::dot(dc);
+	ptr_x->sync_();
+	sync_();
+	size_t n = std::min(headers_.size(), ptr_x->headers_.size())*size_;
+	const float* u = reinterpret_cast<const float*>(data_.data());
+	const float* v = reinterpret_cast<const float*>(ptr_x->data_.data());
+	double re = 0;
+	double im = 0;
+	std::mutex mtx;
+	native_parallel_for(n, [&](size_t begin, size_t end)
+	{
+		double s = 0;
+		double t = 0;
+		for (size_t i = begin; i < end; i++) {
+			s += u[2*i]*v[2*i] + u[2*i + 1]*v[2*i + 1];
+			t += u[2*i + 1]*v[2*i] - u[2*i]*v[2*i + 1];
+		}
+		std::lock_guard<std::mutex> lock(mtx);
+		re += s;
+		im += t;
+	}, 1 << 16);
+	return complex_float_t((float)re, (float)im);
+}
+
+float
+ImagesBlock::norm()
+{
+	sync_();
+	const float* u = reinterpret_cast<const float*>(data_.data());
+	double r = 0;
+	std::mutex mtx;
+	native_parallel_for(2*data_.size(), [&](size_t begin, size_t end)
+	{
+		double s = 0;
+		for (size_t i = begin; i < end; i++)
+			s += u[i]*u[i];
+		std::lock_guard<std::mutex> lock(mtx);
+		r += s;
+	}, 1 << 17);
+	return (float)std::sqrt(r);
+}
+
+ImagesWriter::ImagesWriter(ImagesContainer& images,
+	std::string filename, std::string groupname, unsigned int batch_size)
+{
+	const ImagesContainer& ic = images;
+	std::vector<shared_ptr<ImageWrap> > snapshot;
+	for (unsigned int i = 0; i < images.number(); i++)
+		snapshot.push_back(shared_ptr<ImageWrap>
+		(new ImageWrap(ic.image_wrap(i))));
+	future_ = std::async(std::launch::async, 
+		[snapshot, filename, groupname, batch_size]()
+	{
+		write(snapshot, filename, groupname, batch_size);
+	});
+}
+
+ImagesWriter::~ImagesWriter()
+{
+	try {
+		wait();
+	}
+	catch (...) {
+	}
+}
+
+bool
+ImagesWriter::done() const
+{
+	return !future_.valid() ||
+		future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+void
+ImagesWriter::wait()
+{
+	if (future_.valid())
+		future_.get();
+}
+
+void
+ImagesWriter::write(const std::vector<shared_ptr<ImageWrap> >& images,
+	std::string filename, std::string groupname, unsigned int batch_size)
+{
+	if (images.size() < 1)
+		return;
+	if (batch_size < 1)
+		batch_size = 1;
+	Mutex mtx;
+	shared_ptr<ISMRMRD::Dataset> sptr_dataset;
+	{
+		boost::lock_guard<boost::mutex> lock(mtx());
+		sptr_dataset.reset
+			(new ISMRMRD::Dataset(filename.c_str(), groupname.c_str()));
+	}
+	// series by series, keeping the order of images within each
+	std::vector<size_t> order(images.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&images](size_t i, size_t j)
+	{
+		return images[i]->head().image_series_index < 
+			images[j]->head().image_series_index;
+	});
+	// a batch ends at a series boundary, so that each takes one series
+	for (size_t first = 0, last; first < order.size(); first = last) {
+		uint16_t series = images[order[first]]->head().image_series_index;
+		for (last = first + 1; last < order.size() && last - first < batch_size
+			&& images[order[last]]->head().image_series_index == series; 
+			last++);
+		boost::lock_guard<boost::mutex> lock(mtx());
+		for (size_t i = first; i < last; i++)
+			images[order[i]]->append_to(*sptr_dataset);
+	}
+	boost::lock_guard<boost::mutex> lock(mtx());
+	sptr_dataset.reset();
+}
+
 void
 CoilDataAsCFImage::get_data(float* re, float* im) const
 {
@@ -43,6 +43,13 @@ limitations under the License.
 //#include <boost/algorithm/string/predicate.hpp>
 //#include <boost/algorithm/string/replace.hpp>
 
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <new>
+
 #include <boost/algorithm/string.hpp>
 
 #include <ismrmrd/ismrmrd.h>
@@ -100,13 +107,34 @@ public:
 
 	virtual unsigned int number() = 0;
 	virtual void get_acquisition(unsigned int num, ISMRMRD::Acquisition& acq) = 0;
+	// gets n acquisitions starting with first into acqs[0], ..., acqs[n - 1]
+	virtual void get_acquisitions(unsigned int first, unsigned int n,
+		std::vector<ISMRMRD::Acquisition>& acqs)
+	{
+		if (acqs.size() < n)
+			acqs.resize(n);
+		for (unsigned int i = 0; i < n; i++)
+			get_acquisition(first + i, acqs[i]);
+	}
 	virtual void append_acquisition(ISMRMRD::Acquisition& acq) = 0;
+	// appends the first n acquisitions of a batch
+	virtual void append_acquisitions
+		(std::vector<ISMRMRD::Acquisition>& acqs, size_t n)
+	{
+		for (size_t i = 0; i < n; i++)
+			append_acquisition(acqs[i]);
+	}
+	// prepares the container for storing n acquisitions
+	virtual void reserve(unsigned int n) {}
 	virtual void copy_acquisitions_info(const AcquisitionsContainer& ac) = 0;
 	virtual 
 		shared_ptr<AcquisitionsContainer> new_acquisitions_container() = 0;
 	virtual AcquisitionsContainer* same_acquisitions_container(AcquisitionsInfo info) = 0;
 	virtual int set_acquisition_data
 		(int na, int nc, int ns, const float* re, const float* im) = 0;
+	// same as above for interleaved complex data
+	virtual int set_acquisition_data
+		(int na, int nc, int ns, const complex_float_t* z) = 0;
 
 	virtual void axpby(
 		complex_float_t a, const aDataContainer<complex_float_t>& a_x,
@@ -121,7 +149,16 @@ public:
 	bool undersampled() const;
 	int get_acquisitions_dimensions(size_t ptr_dim);
 	void get_acquisitions_flags(unsigned int n, int* flags);
+	// copies the headers of all acquisitions into headers[0], ...,
+	// returns the number of acquisitions
+	virtual unsigned int get_acquisitions_headers
+		(ISMRMRD::AcquisitionHeader* headers);
+	// replaces the headers of all acquisitions with headers[0], ...
+	// (in the same order as above)
+	virtual void set_acquisitions_headers
+		(const ISMRMRD::AcquisitionHeader* headers) = 0;
 	unsigned int get_acquisitions_data(unsigned int slice, float* re, float* im);
+	unsigned int get_acquisitions_data(unsigned int slice, complex_float_t* z);
 	void order();
 	bool ordered() const { return ordered_; }
 	int* index() { return index_; }
@@ -139,6 +176,10 @@ protected:
 	int* index_;
 	AcquisitionsInfo acqs_info_;
 	static shared_ptr<AcquisitionsContainer> acqs_templ_;
+
+	// sets the data of an acquisition, the second argument being the
+	// position of its first sample in the input arrays
+	typedef std::function<void(ISMRMRD::Acquisition&, size_t)> ReadoutSetter;
 };
 
 class AcquisitionsFile : public AcquisitionsContainer {
@@ -168,10 +209,18 @@ public:
 
 	virtual int set_acquisition_data
 		(int na, int nc, int ns, const float* re, const float* im);
+	virtual int set_acquisition_data
+		(int na, int nc, int ns, const complex_float_t* z);
 	virtual unsigned int items();
 	virtual unsigned int number() { return items(); }
 	virtual void get_acquisition(unsigned int num, ISMRMRD::Acquisition& acq);
+	virtual void get_acquisitions(unsigned int first, unsigned int n,
+		std::vector<ISMRMRD::Acquisition>& acqs);
 	virtual void append_acquisition(ISMRMRD::Acquisition& acq);
+	virtual void append_acquisitions
+		(std::vector<ISMRMRD::Acquisition>& acqs, size_t n);
+	virtual void set_acquisitions_headers
+		(const ISMRMRD::AcquisitionHeader* headers);
 	virtual void copy_acquisitions_info(const AcquisitionsContainer& ac);
 	virtual AcquisitionsContainer* 
 		same_acquisitions_container(AcquisitionsInfo info)
@@ -195,6 +244,8 @@ private:
 	bool own_file_;
 	std::string filename_;
 	shared_ptr<ISMRMRD::Dataset> dataset_;
+
+	int set_acquisition_data_(int na, int nc, int ns, ReadoutSetter set);
 };
 
 class AcquisitionsVector : public AcquisitionsContainer {
@@ -221,12 +272,33 @@ public:
 		int ind = index(num);
 		acq = *acqs_[ind];
 	}
+	virtual unsigned int get_acquisitions_headers
+		(ISMRMRD::AcquisitionHeader* headers)
+	{
+		unsigned int na = number();
+		for (unsigned int a = 0; a < na; a++)
+			headers[a] = acqs_[index(a)]->getHead();
+		return na;
+	}
+	virtual void set_acquisitions_headers
+		(const ISMRMRD::AcquisitionHeader* headers)
+	{
+		unsigned int na = number();
+		for (unsigned int a = 0; a < na; a++)
+			acqs_[index(a)]->setHead(headers[a]);
+	}
+	virtual void reserve(unsigned int n)
+	{
+		acqs_.reserve(n);
+	}
 	virtual void copy_acquisitions_info(const AcquisitionsContainer& ac)
 	{
 		acqs_info_ = ac.acquisitions_info();
 	}
 	virtual int set_acquisition_data
 		(int na, int nc, int ns, const float* re, const float* im);
+	virtual int set_acquisition_data
+		(int na, int nc, int ns, const complex_float_t* z);
 	virtual AcquisitionsContainer* same_acquisitions_container(AcquisitionsInfo info)
 	{
 		return new AcquisitionsVector(info);
@@ -245,6 +317,8 @@ public:
 
 private:
 	std::vector<shared_ptr<ISMRMRD::Acquisition> > acqs_;
+
+	int set_acquisition_data_(int na, int nc, int ns, ReadoutSetter set);
 };
 
 class ImagesContainer : public aDataContainer<complex_float_t> {
@@ -259,11 +333,15 @@ public:
 	virtual const ImageWrap& image_wrap(unsigned int im_num) const = 0;
 	virtual void append(int image_data_type, void* ptr_image) = 0;
 	virtual void append(const ImageWrap& iw) = 0;
+	virtual void append(shared_ptr<ImageWrap> sptr_iw) = 0;
 	virtual void get_image_dimensions(unsigned int im_num, int* dim) = 0;
 	virtual void get_images_data_as_float_array(float* data) const = 0;
 	virtual void get_images_data_as_complex_array
 		(float* re, float* im) const = 0;
 	virtual void set_complex_images_data(const float* re, const float* im) = 0;
+	// interleaved complex counterparts of the above
+	virtual void get_images_data_as_complex_array(complex_float_t* data);
+	virtual void set_complex_images_data(const complex_float_t* data);
 	virtual void write(std::string filename, std::string groupname) = 0;
 	virtual shared_ptr<ImagesContainer> new_images_container() = 0;
 	virtual shared_ptr<ImagesContainer>
@@ -281,13 +359,29 @@ public:
 	virtual complex_float_t dot(const aDataContainer<complex_float_t>& dc);
 	virtual float norm();
 
+	// copies the headers of all images into headers[0], ...,
+	// returns the number of images
+	unsigned int get_images_headers(ISMRMRD::ImageHeader* headers)
+	{
+		const ImagesContainer& images = *this;
+		unsigned int ni = number();
+		for (unsigned int i = 0; i < ni; i++)
+			headers[i] = images.image_wrap(i).head();
+		return ni;
+	}
 	void get_image_data_as_cmplx_array
 		(unsigned int im_num, float* re, float* im)
 	{
-		ImageWrap& iw = image_wrap(im_num);
-		iw.get_cmplx_data(re, im);
+		const ImagesContainer& images = *this;
+		images.image_wrap(im_num).get_cmplx_data(re, im);
 	}
 
+	// new empty container of the type last set by set_as_template()
+	// (ImagesVector by default)
+	static shared_ptr<ImagesContainer> new_default();
+
+protected:
+	static shared_ptr<ImagesContainer> imgs_templ_;
 };
 
 class ImagesVector : public ImagesContainer {
@@ -296,6 +390,12 @@ public:
 	ImagesVector(const ImagesVector& list, const char* attr, const char* target);
 	ImagesVector
 		(const ImagesVector& list, unsigned int inc = 1, unsigned int off = 0);
+	static void set_as_template()
+	{
+		imgs_templ_.reset(new ImagesVector);
+	}
+	using ImagesContainer::get_images_data_as_complex_array;
+	using ImagesContainer::set_complex_images_data;
 	virtual unsigned int items() { return (unsigned int)images_.size(); }
 	virtual unsigned int number() { return (unsigned int)images_.size(); }
 	virtual int types()
@@ -314,13 +414,23 @@ public:
 	{
 		images_.push_back(shared_ptr<ImageWrap>
 			(new ImageWrap(image_data_type, ptr_image)));
+		clear_attr_index_();
 	}
 	virtual void append(const ImageWrap& iw)
 	{
 		images_.push_back(shared_ptr<ImageWrap>(new ImageWrap(iw)));
+		clear_attr_index_();
 	}
+	virtual void append(shared_ptr<ImageWrap> sptr_iw)
+	{
+		images_.push_back(sptr_iw);
+		clear_attr_index_();
+	}
+	// the image may be changed via the wrap returned, which invalidates
+	// the attribute indices
 	virtual shared_ptr<ImageWrap> sptr_image_wrap(unsigned int im_num)
 	{
+		clear_attr_index_();
 		return images_[im_num];
 	}
 	virtual shared_ptr<const ImageWrap> sptr_image_wrap
@@ -341,9 +451,11 @@ public:
 	virtual void write(std::string filename, std::string groupname);
 	virtual void get_image_dimensions(unsigned int im_num, int* dim)
 	{
-		if (im_num >= images_.size())
+		if (im_num >= images_.size()) {
 			dim[0] = dim[1] = dim[2] = dim[3] = 0;
-		ImageWrap& iw = image_wrap(im_num);
+			return;
+		}
+		const ImageWrap& iw = *images_[im_num];
 		iw.get_dim(dim);
 		//std::string attr = iw.attributes();
 		//ISMRMRD::MetaContainer mc;
@@ -374,8 +486,232 @@ public:
 	}
 
 private:
+	// numbers of images with each (lower case) value of an attribute
+	typedef std::map<std::string, std::vector<unsigned int> > AttributeIndex;
+
 	std::vector<shared_ptr<ImageWrap> > images_;
 	int nimages_;
+	// indices of the attributes used for selection so far, built on the first
+	// selection by each attribute and discarded when images are appended or
+	// handed out for changing;
+	// guarded by attr_index_mutex_, as selections may run concurrently
+	mutable std::map<std::string, AttributeIndex> attr_index_;
+	mutable std::mutex attr_index_mutex_;
+
+	void clear_attr_index_()
+	{
+		std::lock_guard<std::mutex> lock(attr_index_mutex_);
+		attr_index_.clear();
+	}
+	// numbers of images whose attribute attr equals target (ignoring case)
+	std::vector<unsigned int>
+		images_with_(const char* attr, const char* target) const;
+};
+
+/*!
+\brief Minimal allocator returning storage aligned to A bytes.
+*/
+template<typename T, size_t A = 64>
+class AlignedAllocator {
+public:
+	typedef T value_type;
+	template<typename U>
+	struct rebind {
+		typedef AlignedAllocator<U, A> other;
+	};
+	AlignedAllocator() {}
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U, A>&) {}
+	T* allocate(size_t n)
+	{
+		void* ptr = std::malloc(n*sizeof(T) + A + sizeof(void*));
+		if (!ptr)
+			throw std::bad_alloc();
+		size_t addr = ((size_t)ptr + sizeof(void*) + A - 1) & ~(A - 1);
+		((void**)addr)[-1] = ptr;
+		return (T*)addr;
+	}
+	void deallocate(T* p, size_t)
+	{
+		std::free(((void**)p)[-1]);
+	}
+	template<typename U>
+	bool operator==(const AlignedAllocator<U, A>&) const { return true; }
+	template<typename U>
+	bool operator!=(const AlignedAllocator<U, A>&) const { return false; }
+};
+
+/*!
+\brief Images container keeping all pixel values in one block.
+
+All images must have the same dimensions. Their pixel values are stored as 
+complex floats in one contiguous aligned array laid out as 
+[image][channel][z][y][x], with the headers and attributes kept alongside, 
+so that bulk operations run as single loops over the whole array. Each 
+image keeps its data type, which must be one whose values complex floats 
+hold exactly (short, unsigned short, float or complex float); images of 
+other types are refused.
+
+Image wraps returned by image_wrap() and sptr_image_wrap() are created from
+the block on request and cached. Changes made via non-const wraps are copied 
+back into the block by bulk operations. Wraps stay connected to the block 
+while held: bulk operations that change the pixel values also update the 
+wraps still held, and wraps no longer held elsewhere are dropped from the 
+cache. The cache is guarded by a mutex, so wraps may be requested 
+concurrently.
+*/
+class ImagesBlock : public ImagesContainer {
+public:
+	ImagesBlock() : nimages_(0), size_(0)
+	{
+		dim_[0] = dim_[1] = dim_[2] = dim_[3] = 0;
+	}
+	ImagesBlock(const ImagesBlock& list, const char* attr, const char* target);
+	ImagesBlock
+		(const ImagesBlock& list, unsigned int inc = 1, unsigned int off = 0);
+	static void set_as_template()
+	{
+		imgs_templ_.reset(new ImagesBlock);
+	}
+	virtual unsigned int items() { return (unsigned int)headers_.size(); }
+	virtual unsigned int number() { return (unsigned int)headers_.size(); }
+	virtual int types()
+	{
+		if (nimages_ > 0)
+			return (int)(headers_.size() / nimages_);
+		else
+			return 1;
+	}
+	virtual void count(int i)
+	{
+		if (i > nimages_)
+			nimages_ = i;
+	}
+	virtual void append(int image_data_type, void* ptr_image)
+	{
+		ImageWrap iw(image_data_type, ptr_image);
+		append(iw);
+	}
+	virtual void append(const ImageWrap& iw);
+	virtual void append(shared_ptr<ImageWrap> sptr_iw)
+	{
+		append(*sptr_iw);
+	}
+	virtual shared_ptr<ImageWrap> sptr_image_wrap(unsigned int im_num);
+	virtual shared_ptr<const ImageWrap> sptr_image_wrap
+		(unsigned int im_num) const;
+	virtual ImageWrap& image_wrap(unsigned int im_num)
+	{
+		return *sptr_image_wrap(im_num);
+	}
+	virtual const ImageWrap& image_wrap(unsigned int im_num) const
+	{
+		return *sptr_image_wrap(im_num);
+	}
+	virtual int image_data_type(unsigned int im_num) const
+	{
+		return headers_[im_num].data_type;
+	}
+	virtual void write(std::string filename, std::string groupname);
+	virtual void get_image_dimensions(unsigned int im_num, int* dim)
+	{
+		for (int i = 0; i < 4; i++)
+			dim[i] = im_num < headers_.size() ? dim_[i] : 0;
+	}
+	virtual void get_images_data_as_float_array(float* data) const;
+	virtual void get_images_data_as_complex_array(float* re, float* im) const;
+	virtual void set_complex_images_data(const float* re, const float* im);
+	virtual void get_images_data_as_complex_array(complex_float_t* data);
+	virtual void set_complex_images_data(const complex_float_t* data);
+
+	virtual void axpby(
+		complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+		complex_float_t b, const aDataContainer<complex_float_t>& a_y);
+	virtual complex_float_t dot(const aDataContainer<complex_float_t>& dc);
+	virtual float norm();
+
+	virtual aDataContainer<complex_float_t>* new_data_container()
+	{
+		return (aDataContainer<complex_float_t>*)new ImagesBlock();
+	}
+	virtual shared_ptr<ImagesContainer> new_images_container()
+	{
+		return shared_ptr<ImagesContainer>((ImagesContainer*)new ImagesBlock());
+	}
+	virtual shared_ptr<ImagesContainer>
+		clone(const char* attr, const char* target)
+	{
+		return shared_ptr<ImagesContainer>(new ImagesBlock(*this, attr, target));
+	}
+	virtual shared_ptr<ImagesContainer>
+		clone(unsigned int inc = 1, unsigned int off = 0)
+	{
+		return shared_ptr<ImagesContainer>(new ImagesBlock(*this, inc, off));
+	}
+
+private:
+	typedef std::vector<complex_float_t, AlignedAllocator<complex_float_t> >
+		Block;
+
+	int nimages_;
+	int dim_[4];
+	size_t size_; // number of pixel values per image
+	std::vector<ISMRMRD::ImageHeader> headers_;
+	std::vector<std::string> attributes_;
+	Block data_;
+	// wraps handed out and still held, and whether each may be modified;
+	// guarded by wraps_mutex_
+	mutable std::map<unsigned int, std::pair<shared_ptr<ImageWrap>, bool> >
+		wraps_;
+	mutable std::mutex wraps_mutex_;
+
+	complex_float_t* data_ptr_(unsigned int im_num)
+	{
+		return data_.data() + im_num*size_;
+	}
+	const complex_float_t* data_ptr_(unsigned int im_num) const
+	{
+		return data_.data() + im_num*size_;
+	}
+	// appends image im_num of list
+	void append_(const ImagesBlock& list, unsigned int im_num);
+	shared_ptr<ImageWrap> new_image_wrap_(unsigned int im_num) const;
+	shared_ptr<ImageWrap> cached_image_wrap_
+		(unsigned int im_num, bool modifiable) const;
+	// copies modifiable wraps back into the block and drops from the cache
+	// those no longer held elsewhere
+	void sync_() const;
+	// copies the block values into the wraps still held
+	void refresh_();
+};
+
+/*!
+\brief Writer of images to an ISMRMRD file on a background thread.
+
+The writer keeps copies of the image wraps, which share the images with the
+container copy-on-write, so the container may be changed or deleted while
+the images are being written. Images are written series by series in
+batches of images of one series, the HDF5 mutex being taken once per batch.
+*/
+class ImagesWriter {
+public:
+	ImagesWriter(ImagesContainer& images, 
+		std::string filename, std::string groupname, 
+		unsigned int batch_size = 16);
+	// waits for the writing to finish (errors are then ignored)
+	~ImagesWriter();
+	// true if all images have been written (or the writing failed)
+	bool done() const;
+	// waits for the writing to finish, rethrowing any error it raised
+	void wait();
+
+	// writes images as described above on the calling thread
+	static void write(const std::vector<shared_ptr<ImageWrap> >& images,
+		std::string filename, std::string groupname,
+		unsigned int batch_size = 16);
+
+private:
+	std::future<void> future_;
 };
 
 class CoilData {
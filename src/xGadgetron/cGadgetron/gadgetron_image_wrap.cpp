@@ -31,8 +31,9 @@ ImageWrap::get_cmplx_data(float* re, float* im) const
 }
 
 void
-ImageWrap::set_cmplx_data(const float* re, const float* im) const
+ImageWrap::set_cmplx_data(const float* re, const float* im)
 {
+	detach_();
 	int dim[4];
 	size_t n = get_dim(dim);
 	if (type_ == ISMRMRD::ISMRMRD_CXFLOAT) {
@@ -14,6 +14,8 @@
 //#include <boost/algorithm/string/predicate.hpp>
 //#include <boost/algorithm/string/replace.hpp>
 
+#include <mutex>
+
 #include <ismrmrd/ismrmrd.h>
 #include <ismrmrd/dataset.h>
 #include <ismrmrd/meta.h>
@@ -63,21 +65,34 @@ typedef ISMRMRD::Image<complex_double_t> CDImage;
 
 using namespace gadgetron;
 
+/*!
+\brief Wrapper for ISMRMRD::Image<T> of any supported pixel type T.
+
+Copies of a wrap share its image, which is copied by the non-const methods
+that may change it (copy on write). The wraps sharing an image are counted
+under a mutex, so that a wrap may be copied or destroyed on one thread 
+while another is changing a copy of it.
+*/
 class ImageWrap {
 public:
-	ImageWrap(uint16_t type = 0, void* ptr_im = 0)
+	ImageWrap(uint16_t type = 0, void* ptr_im = 0) : sharing_(new Sharing)
 	{
 		type_ = type;
 		ptr_ = ptr_im;
+		IMAGE_PROCESSING_SWITCH(type_, own_, ptr_im);
 	}
 	ImageWrap(const ImageWrap& iw)
 	{
-		type_ = iw.type();
-		IMAGE_PROCESSING_SWITCH(type_, copy_, iw.ptr_image());
+		std::lock_guard<std::mutex> lock(iw.sharing_->mtx);
+		type_ = iw.type_;
+		ptr_ = iw.ptr_;
+		sptr_ = iw.sptr_;
+		sharing_ = iw.sharing_;
+		sharing_->wraps++;
 	}
 	~ImageWrap()
 	{
-		IMAGE_PROCESSING_SWITCH(type_, delete, ptr_);
+		release_();
 	}
 	int type() const
 	{
@@ -85,6 +100,7 @@ public:
 	}
 	void* ptr_image()
 	{
+		detach_();
 		return ptr_;
 	}
 	const void* ptr_image() const
@@ -99,8 +115,15 @@ public:
 	}
 	ISMRMRD::ImageHeader* ptr_head()
 	{
-		ISMRMRD::ImageHeader** h;
-		IMAGE_PROCESSING_SWITCH(type_, get_head_ptr_, ptr_, h);
+		detach_();
+		ISMRMRD::ImageHeader* h = 0;
+		IMAGE_PROCESSING_SWITCH(type_, get_head_ptr_, ptr_, &h);
+		return h;
+	}
+	const ISMRMRD::ImageHeader& head() const
+	{
+		const ISMRMRD::ImageHeader* h = 0;
+		IMAGE_PROCESSING_SWITCH_CONST(type_, get_head_cptr_, ptr_, &h);
 		return *h;
 	}
 	std::string attributes() const
@@ -111,6 +134,7 @@ public:
 	}
 	void set_imtype(ISMRMRD::ISMRMRD_ImageTypes imtype)
 	{
+		detach_();
 		IMAGE_PROCESSING_SWITCH(type_, set_imtype_, ptr_, imtype);
 	}
 	size_t get_dim(int* dim) const
@@ -126,12 +150,29 @@ public:
 	{
 		IMAGE_PROCESSING_SWITCH_CONST(type_, get_data_, ptr_, data);
 	}
+	// copies the pixel values converted to complex floats into data
+	void get_complex_data(complex_float_t* data) const
+	{
+		IMAGE_PROCESSING_SWITCH_CONST(type_, get_complex_data_, ptr_, data);
+	}
+	// sets the pixel values from complex data (real part for real images)
+	void set_complex_data(const complex_float_t* data)
+	{
+		detach_();
+		IMAGE_PROCESSING_SWITCH(type_, set_complex_data_, ptr_, data);
+	}
 	void write(ISMRMRD::Dataset& dataset) const
 	{
 		IMAGE_PROCESSING_SWITCH_CONST(type_, write_, ptr_, dataset);
 	}
+	// as write(), but the caller must hold the HDF5 mutex
+	void append_to(ISMRMRD::Dataset& dataset) const
+	{
+		IMAGE_PROCESSING_SWITCH_CONST(type_, append_to_, ptr_, dataset);
+	}
 	void axpby(complex_float_t a, const ImageWrap& x, complex_float_t b)
 	{
+		detach_();
 		IMAGE_PROCESSING_SWITCH(type_, axpby_, x.ptr_image(), a, b);
 	}
 	complex_float_t dot(const ImageWrap& iw) const
@@ -153,26 +194,91 @@ public:
 		return s;
 	}
 
+	// new float image of the given type (magnitude, real, imaginary or 
+	// phase) extracted from this one
+	ImageWrap* extract(ISMRMRD::ISMRMRD_ImageTypes imtype) const
+	{
+		ImageWrap* ptr_iw = 0;
+		IMAGE_PROCESSING_SWITCH_CONST(type_, extract_, ptr_, imtype, &ptr_iw);
+		return ptr_iw;
+	}
+	// new unsigned short image converted from the real part of this one
+	// as by FloatToShortGadget: phase images are mapped from [-pi, pi] to
+	// [0, 2*offset], others shifted by offset (magnitude images are not),
+	// and all rounded and clamped to [min, max]
+	ImageWrap* to_ushort(float min, float max, float offset) const
+	{
+		ImageWrap* ptr_iw = 0;
+		IMAGE_PROCESSING_SWITCH_CONST
+			(type_, to_ushort_, ptr_, min, max, offset, &ptr_iw);
+		return ptr_iw;
+	}
+
 	void get_cmplx_data(float* re, float* im) const;
 
-	void set_cmplx_data(const float* re, const float* im) const;
+	void set_cmplx_data(const float* re, const float* im);
 
 private:
 	int type_;
 	void* ptr_;
+	// owner of *ptr_, shared by copies of this wrap
+	shared_ptr<void> sptr_;
+	// number of wraps sharing *ptr_
+	struct Sharing {
+		Sharing() : wraps(1) {}
+		std::mutex mtx;
+		unsigned int wraps;
+	};
+	shared_ptr<Sharing> sharing_;
 
 	ImageWrap& operator=(const ImageWrap& iw)
 	{
-		type_ = iw.type();
-		IMAGE_PROCESSING_SWITCH(type_, copy_, iw.ptr_image());
+		if (&iw == this || iw.sharing_ == sharing_)
+			return *this;
+		release_();
+		std::lock_guard<std::mutex> lock(iw.sharing_->mtx);
+		type_ = iw.type_;
+		ptr_ = iw.ptr_;
+		sptr_ = iw.sptr_;
+		sharing_ = iw.sharing_;
+		sharing_->wraps++;
 		return *this;
 	}
 
+	// stops sharing the image
+	void release_()
+	{
+		std::lock_guard<std::mutex> lock(sharing_->mtx);
+		sharing_->wraps--;
+	}
+
+	// makes this wrap the only owner of its image
+	void detach_()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sharing_->mtx);
+			if (sharing_->wraps < 2)
+				return;
+			// the image is copied before this wrap stops sharing it, so that
+			// no other wrap may change it meanwhile
+			IMAGE_PROCESSING_SWITCH(type_, copy_, ptr_);
+			sharing_->wraps--;
+		}
+		sharing_.reset(new Sharing);
+	}
+
+	template<typename T>
+	void own_(ISMRMRD::Image<T>* ptr_im)
+	{
+		sptr_.reset(ptr_im);
+	}
+
 	template<typename T>
 	void copy_(const ISMRMRD::Image<T>* ptr_im)
 	{
-		type_ = ptr_im->getDataType();
-		ptr_ = (void*)new ISMRMRD::Image<T>(*ptr_im);
+		ISMRMRD::Image<T>* ptr_copy = new ISMRMRD::Image<T>(*ptr_im);
+		sptr_.reset(ptr_copy);
+		ptr_ = (void*)ptr_copy;
 	}
 
 	template<typename T>
@@ -181,6 +287,13 @@ private:
 		*h = &(ptr_im->getHead());
 	}
 
+	template<typename T>
+	void get_head_cptr_
+		(const ISMRMRD::Image<T>* ptr_im, const ISMRMRD::ImageHeader** h) const
+	{
+		*h = &(ptr_im->getHead());
+	}
+
 	template<typename T>
 	void set_imtype_(ISMRMRD::Image<T>* ptr_im, ISMRMRD::ISMRMRD_ImageTypes type)
 	{
@@ -204,16 +317,109 @@ private:
 		(const ISMRMRD::Image<T>* ptr_im, ISMRMRD::Dataset& dataset) const
 	{
 		//std::cout << "appending image..." << std::endl;
+		Mutex mtx;
+		mtx.lock();
+		append_to_(ptr_im, dataset);
+		mtx.unlock();
+	}
+
+	template<typename T>
+	void append_to_
+		(const ISMRMRD::Image<T>* ptr_im, ISMRMRD::Dataset& dataset) const
+	{
 		const ISMRMRD::Image<T>& im = *ptr_im;
 		std::stringstream ss;
 		ss << "image_" << im.getHead().image_series_index;
 		std::string image_varname = ss.str();
-		{
-			Mutex mtx;
-			mtx.lock();
-			dataset.appendImage(image_varname, im);
-			mtx.unlock();
+		dataset.appendImage(image_varname, im);
+	}
+
+	// new image with the same header and attributes as *ptr_im and pixels
+	// of type S
+	template<typename S, typename T>
+	static ISMRMRD::Image<S>* 
+		new_image_like_(const ISMRMRD::Image<T>* ptr_im, uint16_t data_type)
+	{
+		ISMRMRD::ImageHeader head = ptr_im->getHead();
+		head.data_type = data_type;
+		ISMRMRD::Image<S>* ptr_res = new ISMRMRD::Image<S>;
+		ptr_res->setHead(head);
+		std::string attr;
+		ptr_im->getAttributeString(attr);
+		ptr_res->setAttributeString(attr);
+		return ptr_res;
+	}
+
+	template<typename T>
+	void extract_(const ISMRMRD::Image<T>* ptr_im, 
+		ISMRMRD::ISMRMRD_ImageTypes imtype, ImageWrap** ptr_iw) const
+	{
+		ISMRMRD::Image<float>* ptr_res = 
+			new_image_like_<float>(ptr_im, ISMRMRD::ISMRMRD_FLOAT);
+		ptr_res->setImageType(imtype);
+		extract_data_(imtype, ptr_im->getDataPtr(), ptr_res->getDataPtr(),
+			ptr_im->getNumberOfDataElements());
+		*ptr_iw = new ImageWrap(ISMRMRD::ISMRMRD_FLOAT, ptr_res);
+	}
+
+	template<typename T>
+	static void extract_data_
+		(int imtype, const T* src, float* dst, size_t n)
+	{
+		for (size_t i = 0; i < n; i++) {
+			complex_float_t z(src[i]);
+			if (imtype == ISMRMRD::ISMRMRD_IMTYPE_REAL)
+				dst[i] = z.real();
+			else if (imtype == ISMRMRD::ISMRMRD_IMTYPE_IMAG)
+				dst[i] = z.imag();
+			else if (imtype == ISMRMRD::ISMRMRD_IMTYPE_PHASE)
+				dst[i] = std::arg(z);
+			else
+				dst[i] = std::abs(z);
+		}
+	}
+	// complex float pixels are handled as pairs of floats in loops
+	// without branches, which the compiler can vectorise
+	static void extract_data_
+		(int imtype, const complex_float_t* src, float* dst, size_t n)
+	{
+		const float* x = reinterpret_cast<const float*>(src);
+		if (imtype == ISMRMRD::ISMRMRD_IMTYPE_REAL)
+			for (size_t i = 0; i < n; i++)
+				dst[i] = x[2*i];
+		else if (imtype == ISMRMRD::ISMRMRD_IMTYPE_IMAG)
+			for (size_t i = 0; i < n; i++)
+				dst[i] = x[2*i + 1];
+		else if (imtype == ISMRMRD::ISMRMRD_IMTYPE_PHASE)
+			for (size_t i = 0; i < n; i++)
+				dst[i] = std::atan2(x[2*i + 1], x[2*i]);
+		else
+			for (size_t i = 0; i < n; i++)
+				dst[i] = std::sqrt(x[2*i]*x[2*i] + x[2*i + 1]*x[2*i + 1]);
+	}
+
+	template<typename T>
+	void to_ushort_(const ISMRMRD::Image<T>* ptr_im, 
+		float min, float max, float offset, ImageWrap** ptr_iw) const
+	{
+		ISMRMRD::Image<unsigned short>* ptr_res = new_image_like_
+			<unsigned short>(ptr_im, ISMRMRD::ISMRMRD_USHORT);
+		int imtype = ptr_im->getImageType();
+		float scale = 1.0f;
+		if (imtype == ISMRMRD::ISMRMRD_IMTYPE_PHASE)
+			scale = (float)(offset / 3.14159265358979);
+		else if (imtype == ISMRMRD::ISMRMRD_IMTYPE_MAGNITUDE)
+			offset = 0.0f;
+		const T* src = ptr_im->getDataPtr();
+		unsigned short* dst = ptr_res->getDataPtr();
+		size_t n = ptr_im->getNumberOfDataElements();
+		for (size_t i = 0; i < n; i++) {
+			float v = (float)std::real(src[i])*scale + offset + 0.5f;
+			v = v < min ? min : v;
+			v = v > max ? max : v;
+			dst[i] = (unsigned short)v;
 		}
+		*ptr_iw = new ImageWrap(ISMRMRD::ISMRMRD_USHORT, ptr_res);
 	}
 
 	template<typename T>
@@ -236,6 +442,26 @@ private:
 			data[i] = std::real(ptr[i]);
 	}
 
+	template<typename T>
+	void get_complex_data_
+		(const ISMRMRD::Image<T>* ptr_im, complex_float_t* data) const
+	{
+		const T* ptr = ptr_im->getDataPtr();
+		size_t n = ptr_im->getNumberOfDataElements();
+		for (size_t i = 0; i < n; i++)
+			data[i] = (complex_float_t)ptr[i];
+	}
+
+	template<typename T>
+	void set_complex_data_
+		(ISMRMRD::Image<T>* ptr_im, const complex_float_t* data)
+	{
+		T* ptr = ptr_im->getDataPtr();
+		size_t n = ptr_im->getNumberOfDataElements();
+		for (size_t i = 0; i < n; i++)
+			xGadgetronUtilities::convert_complex(data[i], ptr[i]);
+	}
+
 	template<typename T>
 	void axpby_
 		(const ISMRMRD::Image<T>* ptr_x, complex_float_t a, complex_float_t b)
@@ -0,0 +1,623 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Gadgetron Extensions
+\brief Implementation file for in-process execution of gadget chains.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <thread>
+
+#include <ismrmrd/xml.h>
+
+#include "data_handle.h"
+#include "gadgetron_native.h"
+#include "ismrmrd_fftw.h"
+
+typedef shared_ptr<NativeGadgetBatch> BatchPtr;
+
+// threads shared by all native_parallel_for calls, so that no threads
+// are started per batch; several calls (e.g. from different pipeline 
+// stages) may run at the same time, the calling threads taking part
+class NativeThreadPool {
+public:
+	typedef std::function<void(size_t)> Task;
+
+	static NativeThreadPool& instance()
+	{
+		static NativeThreadPool pool;
+		return pool;
+	}
+	// number of threads available to a call, the calling one included
+	size_t size() const
+	{
+		return threads_.size() + 1;
+	}
+	// runs task(0), ..., task(n - 1) and waits for all to finish
+	void run(size_t n, const Task& task)
+	{
+		shared_ptr<Job> job(new Job(n, task));
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			jobs_.push_back(job);
+			cv_.notify_all();
+		}
+		job->work();
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			std::deque<shared_ptr<Job> >::iterator it =
+				std::find(jobs_.begin(), jobs_.end(), job);
+			if (it != jobs_.end())
+				jobs_.erase(it);
+		}
+		job->wait();
+	}
+
+private:
+	struct Job {
+		Job(size_t n, const Task& task) : 
+			task(task), n(n), next(0), done(0), errors(n)
+		{}
+		// runs the parts not yet taken by other threads
+		void work()
+		{
+			for (size_t i = next++; i < n; i = next++) {
+				try {
+					task(i);
+				}
+				catch (...) {
+					errors[i] = std::current_exception();
+				}
+				boost::mutex::scoped_lock lock(mutex);
+				if (++done == n)
+					cv.notify_all();
+			}
+		}
+		// waits for all parts to finish, rethrows the first exception
+		void wait()
+		{
+			{
+				boost::mutex::scoped_lock lock(mutex);
+				while (done < n)
+					cv.wait(lock);
+			}
+			for (size_t i = 0; i < n; i++)
+				if (errors[i])
+					std::rethrow_exception(errors[i]);
+		}
+		Task task;
+		size_t n;
+		std::atomic<size_t> next;
+		size_t done;
+		std::vector<std::exception_ptr> errors;
+		boost::mutex mutex;
+		boost::condition_variable cv;
+	};
+
+	NativeThreadPool() : stop_(false)
+	{
+		size_t nt = std::thread::hardware_concurrency();
+		for (size_t t = 1; t < nt; t++)
+			threads_.push_back(std::thread(&NativeThreadPool::work_, this));
+	}
+	~NativeThreadPool()
+	{
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			stop_ = true;
+			cv_.notify_all();
+		}
+		for (size_t t = 0; t < threads_.size(); t++)
+			threads_[t].join();
+	}
+	void work_()
+	{
+		for (;;) {
+			shared_ptr<Job> job;
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				while (jobs_.empty() && !stop_)
+					cv_.wait(lock);
+				if (stop_)
+					return;
+				job = jobs_.front();
+				if (job->next >= job->n) {
+					// all parts taken, the caller waits for them
+					jobs_.pop_front();
+					continue;
+				}
+			}
+			job->work();
+		}
+	}
+
+	std::vector<std::thread> threads_;
+	std::deque<shared_ptr<Job> > jobs_;
+	bool stop_;
+	boost::mutex mutex_;
+	boost::condition_variable cv_;
+};
+
+void
+native_parallel_for(size_t n, std::function<void(size_t, size_t)> f, 
+	size_t grain)
+{
+	NativeThreadPool& pool = NativeThreadPool::instance();
+	size_t nt = pool.size();
+	if (grain < 1)
+		grain = 1;
+	if (nt > (n + grain - 1) / grain)
+		nt = (n + grain - 1) / grain;
+	if (nt < 2) {
+		if (n > 0)
+			f(0, n);
+		return;
+	}
+	pool.run(nt, [&](size_t t)
+	{
+		f(t*n / nt, (t + 1)*n / nt);
+	});
+}
+
+void
+NativeRemoveROOversamplingGadget::set_up(const std::string& info)
+{
+	dowork_ = true;
+	if (info.empty())
+		return;
+	ISMRMRD::IsmrmrdHeader header;
+	ISMRMRD::deserialize(info.c_str(), header);
+	if (header.encoding.size() < 1)
+		return;
+	ISMRMRD::Encoding e = header.encoding[0];
+	dowork_ = e.encodedSpace.matrixSize.x != e.reconSpace.matrixSize.x;
+}
+
+void
+NativeRemoveROOversamplingGadget::process(NativeGadgetBatch& batch)
+{
+	if (!dowork_)
+		return;
+	std::vector<shared_ptr<ISMRMRD::Acquisition> >& acqs = batch.acquisitions;
+	native_parallel_for(acqs.size(), [&acqs](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			remove_oversampling(*acqs[i]);
+	}, 8);
+}
+
+void
+NativeRemoveROOversamplingGadget::remove_oversampling
+(ISMRMRD::Acquisition& acq)
+{
+	ISMRMRD::AcquisitionHeader head = acq.getHead();
+	int ns = head.number_of_samples;
+	int nc = head.active_channels;
+	int nt = head.trajectory_dimensions;
+	int ms = ns / 2;
+	int start = (ns - ms) / 2;
+	if (ms < 1 || nc < 1)
+		return;
+
+	std::vector<complex_float_t> data(acq.data_begin(), acq.data_end());
+	if (ISMRMRD::fft1c(&data[0], ns, nc, false))
+		THROW("readout oversampling removal failed");
+	for (int c = 0; c < nc; c++)
+		std::copy(&data[c*ns + start], &data[c*ns + start + ms], &data[c*ms]);
+	if (ISMRMRD::fft1c(&data[0], ms, nc, true))
+		THROW("readout oversampling removal failed");
+
+	std::vector<float> traj;
+	if (nt > 0)
+		traj.assign(acq.getTrajPtr() + nt*start, 
+			acq.getTrajPtr() + nt*(start + ms));
+
+	head.number_of_samples = ms;
+	head.center_sample /= 2;
+	head.discard_pre /= 2;
+	head.discard_post /= 2;
+	acq.setHead(head);
+	std::copy(data.begin(), data.begin() + ms*nc, acq.getDataPtr());
+	if (nt > 0)
+		std::copy(traj.begin(), traj.end(), acq.getTrajPtr());
+}
+
+void
+NativeNoiseAdjustGadget::set_up(const std::string& info)
+{
+	receiver_bandwidth_ = 0.793f;
+	configurations_.clear();
+	if (info.empty())
+		return;
+	ISMRMRD::IsmrmrdHeader header;
+	ISMRMRD::deserialize(info.c_str(), header);
+	if (header.acquisitionSystemInformation.is_present() &&
+		header.acquisitionSystemInformation().
+		relativeReceiverNoiseBandwidth.is_present())
+		receiver_bandwidth_ = header.acquisitionSystemInformation().
+		relativeReceiverNoiseBandwidth();
+}
+
+void
+NativeNoiseAdjustGadget::process(NativeGadgetBatch& batch)
+{
+	typedef const std::vector<complex_float_t>* WhiteningPtr;
+	std::vector<shared_ptr<ISMRMRD::Acquisition> >& acqs = batch.acquisitions;
+	std::vector<shared_ptr<ISMRMRD::Acquisition> > data;
+	std::vector<WhiteningPtr> whitening;
+	for (size_t i = 0; i < acqs.size(); i++) {
+		ISMRMRD::Acquisition& acq = *acqs[i];
+		if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_IS_NOISE_MEASUREMENT)) {
+			add_noise_(acq);
+			continue;
+		}
+		data.push_back(acqs[i]);
+		whitening.push_back(whitening_(acq));
+	}
+	native_parallel_for(data.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			if (whitening[i])
+				whiten(*data[i], *whitening[i]);
+	}, 4);
+	acqs.swap(data);
+}
+
+NativeNoiseAdjustGadget::CoilConfigurationKey
+NativeNoiseAdjustGadget::key_(const ISMRMRD::AcquisitionHeader& head)
+{
+	CoilConfigurationKey key(1, head.active_channels);
+	key.insert(key.end(), head.channel_mask, head.channel_mask + 
+		ISMRMRD::ISMRMRD_CHANNEL_MASKS);
+	return key;
+}
+
+void
+NativeNoiseAdjustGadget::add_noise_(const ISMRMRD::Acquisition& acq)
+{
+	const ISMRMRD::AcquisitionHeader& head = acq.getHead();
+	CoilConfiguration& cc = configurations_[key_(head)];
+	// noise arriving after the whitening has been computed is ignored
+	if (cc.whitening.size() > 0)
+		return;
+	size_t ns = head.number_of_samples;
+	size_t nc = head.active_channels;
+	if (cc.covariance.size() < 1)
+		cc.covariance.assign(nc*nc, 0);
+	const complex_float_t* d = acq.getDataPtr();
+	for (size_t i = 0; i < nc; i++)
+		for (size_t j = i; j < nc; j++) {
+			std::complex<double> s = 0;
+			const complex_float_t* di = d + i*ns;
+			const complex_float_t* dj = d + j*ns;
+			for (size_t k = 0; k < ns; k++)
+				s += std::complex<double>(std::conj(di[k]) * dj[k]);
+			cc.covariance[i*nc + j] += s;
+		}
+	cc.samples += ns;
+	cc.noise_dwell_time = head.sample_time_us;
+}
+
+const std::vector<complex_float_t>*
+NativeNoiseAdjustGadget::whitening_(const ISMRMRD::Acquisition& acq)
+{
+	const ISMRMRD::AcquisitionHeader& head = acq.getHead();
+	std::map<CoilConfigurationKey, CoilConfiguration>::iterator it =
+		configurations_.find(key_(head));
+	if (it == configurations_.end())
+		return 0;
+	CoilConfiguration& cc = it->second;
+	if (cc.whitening.size() > 0)
+		return &cc.whitening;
+	size_t nc = head.active_channels;
+	if (cc.samples < 2 || cc.covariance.size() != nc*nc)
+		return 0;
+
+	// Cholesky factorization C = U^H U of the upper triangle of C
+	std::vector<std::complex<double> > u(nc*nc, 0);
+	for (size_t j = 0; j < nc; j++) {
+		for (size_t i = j; i < nc; i++) {
+			std::complex<double> s = cc.covariance[j*nc + i] / 
+				(double)(cc.samples - 1);
+			for (size_t k = 0; k < j; k++)
+				s -= std::conj(u[k*nc + j]) * u[k*nc + i];
+			if (i == j) {
+				if (s.real() <= 0)
+					THROW("noise covariance matrix is not positive definite");
+				u[j*nc + j] = std::sqrt(s.real());
+			}
+			else
+				u[j*nc + i] = s / u[j*nc + j];
+		}
+	}
+	// W = U^-1, scaled for the noise bandwidth
+	double scale = 1.0;
+	if (cc.noise_dwell_time > 0 && head.sample_time_us > 0)
+		scale = std::sqrt(2.0 * head.sample_time_us / cc.noise_dwell_time * 
+			receiver_bandwidth_);
+	std::vector<std::complex<double> > v(nc*nc, 0);
+	for (size_t j = 0; j < nc; j++) {
+		v[j*nc + j] = 1.0 / u[j*nc + j];
+		for (size_t i = 0; i < j; i++) {
+			std::complex<double> s = 0;
+			for (size_t k = i; k < j; k++)
+				s += v[i*nc + k] * u[k*nc + j];
+			v[i*nc + j] = -s / u[j*nc + j];
+		}
+	}
+	cc.whitening.resize(nc*nc);
+	for (size_t i = 0; i < nc*nc; i++)
+		cc.whitening[i] = complex_float_t(scale * v[i]);
+	return &cc.whitening;
+}
+
+void
+NativeNoiseAdjustGadget::whiten
+(ISMRMRD::Acquisition& acq, const std::vector<complex_float_t>& w)
+{
+	// d := d w, d being the ns x nc matrix of the readout stored by columns;
+	// w being upper triangular, column j of the result only depends on 
+	// columns c <= j, hence columns can be overwritten in reverse order;
+	// rows are processed in blocks that stay in cache
+	const size_t block = 256;
+	size_t ns = acq.number_of_samples();
+	size_t nc = acq.active_channels();
+	if (w.size() != nc*nc)
+		THROW("noise whitening matrix size mismatch");
+	complex_float_t* d = acq.getDataPtr();
+	for (size_t b = 0; b < ns; b += block) {
+		size_t nb = std::min(block, ns - b);
+		for (size_t j = nc; j-- > 0;) {
+			complex_float_t* dj = d + j*ns + b;
+			complex_float_t wjj = w[j*nc + j];
+			for (size_t k = 0; k < nb; k++)
+				dj[k] *= wjj;
+			for (size_t c = 0; c < j; c++) {
+				const complex_float_t* dc = d + c*ns + b;
+				complex_float_t wcj = w[c*nc + j];
+				for (size_t k = 0; k < nb; k++)
+					dj[k] += wcj * dc[k];
+			}
+		}
+	}
+}
+
+// replaces each image of the batch with the images returned by f
+// for it, working on the images in parallel
+static void
+transform_images(NativeGadgetBatch& batch,
+	std::function<void(ImageWrap&, 
+	std::vector<shared_ptr<ImageWrap> >&)> f)
+{
+	std::vector<shared_ptr<ImageWrap> >& images = batch.images;
+	std::vector<std::vector<shared_ptr<ImageWrap> > > results(images.size());
+	native_parallel_for(images.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			f(*images[i], results[i]);
+	});
+	images.clear();
+	for (size_t i = 0; i < results.size(); i++)
+		images.insert(images.end(), results[i].begin(), results[i].end());
+}
+
+void
+NativeExtractGadget::process(NativeGadgetBatch& batch)
+{
+	static const ISMRMRD::ISMRMRD_ImageTypes imtypes[] = {
+		ISMRMRD::ISMRMRD_IMTYPE_MAGNITUDE,
+		ISMRMRD::ISMRMRD_IMTYPE_REAL,
+		ISMRMRD::ISMRMRD_IMTYPE_IMAG,
+		ISMRMRD::ISMRMRD_IMTYPE_PHASE
+	};
+	unsigned int mask = mask_;
+	transform_images(batch, [mask](ImageWrap& iw,
+		std::vector<shared_ptr<ImageWrap> >& out)
+	{
+		for (unsigned int t = 0; t < 4; t++) {
+			if (!(mask & (1 << t)))
+				continue;
+			shared_ptr<ImageWrap> sptr_iw(iw.extract(imtypes[t]));
+			sptr_iw->ptr_head()->image_series_index += 1000 * t;
+			out.push_back(sptr_iw);
+		}
+	});
+}
+
+void
+NativeComplexToFloatGadget::process(NativeGadgetBatch& batch)
+{
+	transform_images(batch, [](ImageWrap& iw,
+		std::vector<shared_ptr<ImageWrap> >& out)
+	{
+		ISMRMRD::ISMRMRD_ImageTypes imtype = ISMRMRD::ISMRMRD_IMTYPE_MAGNITUDE;
+		switch (iw.head().image_type) {
+		case ISMRMRD::ISMRMRD_IMTYPE_REAL:
+			imtype = ISMRMRD::ISMRMRD_IMTYPE_REAL;
+			break;
+		case ISMRMRD::ISMRMRD_IMTYPE_IMAG:
+			imtype = ISMRMRD::ISMRMRD_IMTYPE_IMAG;
+			break;
+		case ISMRMRD::ISMRMRD_IMTYPE_PHASE:
+			imtype = ISMRMRD::ISMRMRD_IMTYPE_PHASE;
+			break;
+		}
+		out.push_back(shared_ptr<ImageWrap>(iw.extract(imtype)));
+	});
+}
+
+void
+NativeFloatToShortGadget::process(NativeGadgetBatch& batch)
+{
+	float min = min_;
+	float max = max_;
+	float offset = offset_;
+	transform_images(batch, [=](ImageWrap& iw,
+		std::vector<shared_ptr<ImageWrap> >& out)
+	{
+		out.push_back(shared_ptr<ImageWrap>(iw.to_ushort(min, max, offset)));
+	});
+}
+
+/*!
+\ingroup Gadgetron Extensions
+\brief Bounded queue of batches between two pipeline stages.
+
+close() marks the end of the stream: pop() returns false once the queue
+is empty; abort() makes both push() and pop() return false at once.
+*/
+
+class NativeGadgetPipeline::Queue {
+public:
+	Queue(unsigned int depth, std::atomic<bool>& aborted) :
+		depth_(depth), closed_(false), aborted_(aborted)
+	{}
+	bool push(BatchPtr batch)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		while (queue_.size() >= depth_ && !aborted_)
+			cv_.wait(lock);
+		if (aborted_)
+			return false;
+		queue_.push_back(batch);
+		cv_.notify_all();
+		return true;
+	}
+	bool pop(BatchPtr& batch)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		while (queue_.empty() && !closed_ && !aborted_)
+			cv_.wait(lock);
+		if (aborted_ || queue_.empty())
+			return false;
+		batch = queue_.front();
+		queue_.pop_front();
+		cv_.notify_all();
+		return true;
+	}
+	void close()
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		closed_ = true;
+		cv_.notify_all();
+	}
+	void wake_up()
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		cv_.notify_all();
+	}
+
+private:
+	unsigned int depth_;
+	bool closed_;
+	std::atomic<bool>& aborted_;
+	std::deque<BatchPtr> queue_;
+	boost::mutex mutex_;
+	boost::condition_variable cv_;
+};
+
+void
+NativeGadgetPipeline::run(const std::string& info, Source source, Sink sink)
+{
+	for (unsigned int i = 0; i < gadgets_.size(); i++)
+		gadgets_[i]->set_up(info);
+
+	unsigned int ng = (unsigned int)gadgets_.size();
+	std::atomic<bool> aborted(false);
+	std::vector<shared_ptr<Queue> > queues;
+	for (unsigned int i = 0; i <= ng; i++)
+		queues.push_back(shared_ptr<Queue>(new Queue(queue_depth_, aborted)));
+	std::vector<std::exception_ptr> errors(ng + 2);
+
+	std::function<void()> abort_all = [&]()
+	{
+		aborted = true;
+		for (unsigned int i = 0; i <= ng; i++)
+			queues[i]->wake_up();
+	};
+
+	std::vector<std::thread> threads;
+	// source: queue 0
+	threads.push_back(std::thread([&]()
+	{
+		try {
+			for (;;) {
+				BatchPtr batch(new NativeGadgetBatch);
+				if (!source(*batch))
+					break;
+				if (!batch->empty() && !queues[0]->push(batch))
+					return;
+			}
+			queues[0]->close();
+		}
+		catch (...) {
+			errors[0] = std::current_exception();
+			abort_all();
+		}
+	}));
+	// gadget i: queue i to queue i + 1
+	for (unsigned int i = 0; i < ng; i++)
+		threads.push_back(std::thread([&, i]()
+	{
+		try {
+			aNativeGadget& g = *gadgets_[i];
+			BatchPtr batch;
+			while (queues[i]->pop(batch)) {
+				g.process(*batch);
+				if (!batch->empty() && !queues[i + 1]->push(batch))
+					return;
+			}
+			if (aborted)
+				return;
+			batch.reset(new NativeGadgetBatch);
+			g.finish(*batch);
+			if (!batch->empty() && !queues[i + 1]->push(batch))
+				return;
+			queues[i + 1]->close();
+		}
+		catch (...) {
+			errors[i + 1] = std::current_exception();
+			abort_all();
+		}
+	}));
+	// sink: the calling thread
+	try {
+		BatchPtr batch;
+		while (queues[ng]->pop(batch))
+			sink(*batch);
+	}
+	catch (...) {
+		errors[ng + 1] = std::current_exception();
+		abort_all();
+	}
+	for (unsigned int i = 0; i < threads.size(); i++)
+		threads[i].join();
+	for (unsigned int i = 0; i < errors.size(); i++)
+		if (errors[i])
+			std::rethrow_exception(errors[i]);
+}
@@ -0,0 +1,279 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Gadgetron Extensions
+\brief Specification file for in-process execution of gadget chains.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#ifndef GADGETRON_NATIVE
+#define GADGETRON_NATIVE
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <ismrmrd/ismrmrd.h>
+
+#include "cgadgetron_shared_ptr.h"
+#include "gadgetron_image_wrap.h"
+
+using namespace gadgetron;
+
+/*!
+\ingroup Gadgetron Extensions
+\brief A portion of the data stream passed between native gadgets.
+
+*/
+
+struct NativeGadgetBatch {
+	std::vector<shared_ptr<ISMRMRD::Acquisition> > acquisitions;
+	std::vector<shared_ptr<ImageWrap> > images;
+	bool empty() const
+	{
+		return acquisitions.empty() && images.empty();
+	}
+	void clear()
+	{
+		acquisitions.clear();
+		images.clear();
+	}
+};
+
+// calls f(begin, end) for consecutive subranges of [0, n) of at least
+// grain items each on as many threads as the hardware supports, taken
+// from a pool shared by all calls (the calling thread included)
+void native_parallel_for(size_t n, std::function<void(size_t, size_t)> f,
+	size_t grain = 1);
+
+/*!
+\ingroup Gadgetron Extensions
+\brief Abstract base class for in-process implementations of gadgets.
+
+A native gadget processes the data stream batch by batch, in the order
+of the stream, on its own pipeline stage thread. It may modify, remove,
+replace or add items of a batch, e.g. replace acquisitions with images,
+and may hold items back until finish() is called at the end of the stream.
+Items in a batch are copies of the input data and may be modified in place.
+*/
+
+class aNativeGadget {
+public:
+	virtual ~aNativeGadget() {}
+	// called before the stream starts, info being the acquisitions
+	// header (ISMRMRD xml), empty for image streams
+	virtual void set_up(const std::string& info) {}
+	virtual void process(NativeGadgetBatch& batch) = 0;
+	// called at the end of the stream with an empty batch
+	virtual void finish(NativeGadgetBatch& batch) {}
+};
+
+/*!
+\ingroup Gadgetron Extensions
+\brief Native gadget passing the data through unchanged.
+
+Stands for the finishing gadgets, which in Gadgetron only prepare
+the results for sending to the client.
+*/
+
+class NativePassThroughGadget : public aNativeGadget {
+public:
+	virtual void process(NativeGadgetBatch& batch) {}
+};
+
+/*!
+\ingroup Gadgetron Extensions
+\brief Native gadget passing the data through after showing each batch
+to a callback, e.g. for keeping intermediate results of a chain.
+
+The callback must copy the items it keeps, as the gadgets that follow
+may modify them.
+*/
+
+class NativeTapGadget : public aNativeGadget {
+public:
+	typedef std::function<void(const NativeGadgetBatch&)> Tap;
+	NativeTapGadget(Tap tap) : tap_(tap) {}
+	virtual void process(NativeGadgetBatch& batch)
+	{
+		tap_(batch);
+	}
+private:
+	Tap tap_;
+};
+
+/*!
+\ingroup Gadgetron Extensions
+\brief Native implementation of RemoveROOversamplingGadget.
+
+Halves the readout field of view of each acquisition: the readout is
+Fourier transformed to image space, the central half kept and
+transformed back, and the header updated accordingly. Acquisitions of
+a batch are processed in parallel. As in Gadgetron, nothing is done if
+the encoded and reconstructed matrices have the same readout size.
+*/
+
+class NativeRemoveROOversamplingGadget : public aNativeGadget {
+public:
+	NativeRemoveROOversamplingGadget() : dowork_(true) {}
+	virtual void set_up(const std::string& info);
+	virtual void process(NativeGadgetBatch& batch);
+	static void remove_oversampling(ISMRMRD::Acquisition& acq);
+private:
+	bool dowork_;
+};
+
+/*!
+\ingroup Gadgetron Extensions
+\brief Native implementation of NoiseAdjustGadget.
+
+Noise measurements (acquisitions flagged ISMRMRD_ACQ_IS_NOISE_MEASUREMENT)
+are removed from the stream and used to estimate the noise covariance
+matrix C of the coils. The first subsequent readout computes the
+whitening matrix W = U^-1, where C = U^H U is the Cholesky factorization,
+scaled for the difference in noise and readout sampling rates, and all
+readouts are then multiplied by W in parallel. Statistics and whitening
+matrices are kept separately for each coil configuration (active channels
+and channel mask); readouts of a configuration without noise measurements
+pass unchanged, as in Gadgetron.
+*/
+
+class NativeNoiseAdjustGadget : public aNativeGadget {
+public:
+	NativeNoiseAdjustGadget() : receiver_bandwidth_(0.793f) {}
+	virtual void set_up(const std::string& info);
+	virtual void process(NativeGadgetBatch& batch);
+	// multiplies the readout by upper triangular nc x nc matrix w
+	// stored by rows
+	static void whiten(ISMRMRD::Acquisition& acq, 
+		const std::vector<complex_float_t>& w);
+private:
+	typedef std::vector<uint64_t> CoilConfigurationKey;
+	struct CoilConfiguration {
+		CoilConfiguration() : samples(0), noise_dwell_time(0) {}
+		std::vector<std::complex<double> > covariance;
+		size_t samples;
+		float noise_dwell_time;
+		std::vector<complex_float_t> whitening;
+	};
+
+	float receiver_bandwidth_;
+	std::map<CoilConfigurationKey, CoilConfiguration> configurations_;
+
+	static CoilConfigurationKey key_(const ISMRMRD::AcquisitionHeader& head);
+	void add_noise_(const ISMRMRD::Acquisition& acq);
+	const std::vector<complex_float_t>* 
+		whitening_(const ISMRMRD::Acquisition& acq);
+};
+
+/*!
+\ingroup Gadgetron Extensions
+\brief Native implementation of ExtractGadget.
+
+Replaces each image with float images of the types selected by the
+extract mask (1: magnitude, 2: real part, 4: imaginary part, 8: phase),
+in this order; as in Gadgetron, the image series index of the real part,
+imaginary part and phase is offset by 1000, 2000 and 3000 respectively.
+Images of a batch are processed in parallel.
+*/
+
+class NativeExtractGadget : public aNativeGadget {
+public:
+	NativeExtractGadget(unsigned int mask = 1) : mask_(mask) {}
+	virtual void process(NativeGadgetBatch& batch);
+private:
+	unsigned int mask_;
+};
+
+/*!
+\ingroup Gadgetron Extensions
+\brief Native implementation of ComplexToFloatGadget.
+
+Replaces each image with the float image of its image type (magnitude 
+if the type is complex or not set).
+*/
+
+class NativeComplexToFloatGadget : public aNativeGadget {
+public:
+	virtual void process(NativeGadgetBatch& batch);
+};
+
+/*!
+\ingroup Gadgetron Extensions
+\brief Native implementation of FloatToShortGadget.
+
+Replaces each image with an unsigned short one (see ImageWrap::to_ushort).
+*/
+
+class NativeFloatToShortGadget : public aNativeGadget {
+public:
+	NativeFloatToShortGadget(float min = 0, float max = 32767, 
+		float offset = 0) : min_(min), max_(max), offset_(offset)
+	{}
+	virtual void process(NativeGadgetBatch& batch);
+private:
+	float min_;
+	float max_;
+	float offset_;
+};
+
+/*!
+\ingroup Gadgetron Extensions
+\brief Multi-threaded pipeline of native gadgets.
+
+The source, each gadget and the sink run on separate threads (the sink
+on the calling one) connected by bounded queues of batches, so that
+consecutive gadgets work on consecutive batches concurrently. An
+exception thrown by any of them stops the pipeline and is rethrown by
+run().
+*/
+
+class NativeGadgetPipeline {
+public:
+	// fills the batch, returns false at the end of the stream
+	typedef std::function<bool(NativeGadgetBatch&)> Source;
+	typedef std::function<void(NativeGadgetBatch&)> Sink;
+
+	NativeGadgetPipeline(unsigned int queue_depth = 4) : 
+		queue_depth_(queue_depth ? queue_depth : 1)
+	{}
+	void add_gadget(shared_ptr<aNativeGadget> sptr_g)
+	{
+		gadgets_.push_back(sptr_g);
+	}
+	void run(const std::string& info, Source source, Sink sink);
+
+private:
+	class Queue;
+
+	unsigned int queue_depth_;
+	std::vector<shared_ptr<aNativeGadget> > gadgets_;
+};
+
+#endif
@@ -27,6 +27,12 @@ limitations under the License.
 \author CCP PETMR
 */
 
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <map>
+#include <thread>
+
 #include "cgadgetron_shared_ptr.h"
 #include "data_handle.h"
 #include "gadgetron_x.h"
@@ -81,6 +87,10 @@ GadgetChain::xml() const
 		xml_script += gh->get()->gadget().xml() + '\n';
 	for (gh = writers_.begin(); gh != writers_.end(); gh++)
 		xml_script += gh->get()->gadget().xml() + '\n';
+	if (sptr_prefix_.get())
+		for (gh = sptr_prefix_->gadgets_.begin(); 
+			gh != sptr_prefix_->gadgets_.end(); gh++)
+			xml_script += gh->get()->gadget().xml() + '\n';
 	for (gh = gadgets_.begin(); gh != gadgets_.end(); gh++)
 		xml_script += gh->get()->gadget().xml() + '\n';
 	xml_script += endgadget_->xml() + '\n';
@@ -89,40 +99,133 @@ GadgetChain::xml() const
 	return xml_script;
 }
 
+bool
+GadgetChain::native() const
+{
+	if (!native_ || !endgadget_->native().get())
+		return false;
+#ifdef _MSC_VER
+	std::list<shared_ptr<GadgetHandle> >::const_iterator gh;
+#else
+	typename std::list<shared_ptr<GadgetHandle> >::const_iterator gh;
+#endif
+	for (gh = gadgets_.begin(); gh != gadgets_.end(); gh++)
+		if (!gh->get()->gadget().native().get())
+			return false;
+	if (sptr_prefix_.get()) {
+		if (!sptr_prefix_->native_)
+			return false;
+		for (gh = sptr_prefix_->gadgets_.begin(); 
+			gh != sptr_prefix_->gadgets_.end(); gh++)
+			if (!gh->get()->gadget().native().get())
+				return false;
+	}
+	return true;
+}
+
+void
+GadgetChain::run_natively_(const std::string& info,
+	NativeGadgetPipeline::Source source, NativeGadgetPipeline::Sink sink,
+	shared_ptr<aNativeGadget> sptr_tap)
+{
+	NativeGadgetPipeline pipeline;
+#ifdef _MSC_VER
+	std::list<shared_ptr<GadgetHandle> >::const_iterator gh;
+#else
+	typename std::list<shared_ptr<GadgetHandle> >::const_iterator gh;
+#endif
+	if (sptr_prefix_.get())
+		for (gh = sptr_prefix_->gadgets_.begin(); 
+			gh != sptr_prefix_->gadgets_.end(); gh++)
+			pipeline.add_gadget(gh->get()->gadget().native());
+	if (sptr_tap.get())
+		pipeline.add_gadget(sptr_tap);
+	for (gh = gadgets_.begin(); gh != gadgets_.end(); gh++)
+		pipeline.add_gadget(gh->get()->gadget().native());
+	pipeline.add_gadget(endgadget_->native());
+	session_stats_.reset();
+	streaming_stats_.reset();
+	pipeline.run(info, source, sink);
+}
+
+// feeds acquisitions to a native pipeline in batches
+static NativeGadgetPipeline::Source
+acquisitions_source(AcquisitionsContainer& acquisitions)
+{
+	const unsigned int batch_size = 64;
+	shared_ptr<unsigned int> next(new unsigned int(0));
+	return [&acquisitions, next](NativeGadgetBatch& batch)
+	{
+		unsigned int n = acquisitions.number();
+		unsigned int& i = *next;
+		if (i >= n)
+			return false;
+		for (unsigned int j = 0; j < batch_size && i < n; j++, i++) {
+			shared_ptr<ISMRMRD::Acquisition> sptr_acq(new ISMRMRD::Acquisition);
+			acquisitions.get_acquisition(i, *sptr_acq);
+			batch.acquisitions.push_back(sptr_acq);
+		}
+		return true;
+	};
+}
+
+// collects images from a native pipeline
+static NativeGadgetPipeline::Sink
+images_sink(shared_ptr<ImagesContainer> sptr_images)
+{
+	return [sptr_images](NativeGadgetBatch& batch)
+	{
+		for (unsigned int i = 0; i < batch.images.size(); i++) {
+			shared_ptr<ImageWrap> sptr_iw = batch.images[i];
+			sptr_images->append(sptr_iw);
+			sptr_images->count(sptr_iw->head().image_index);
+		}
+	};
+}
+
 void 
 AcquisitionsProcessor::process(AcquisitionsContainer& acquisitions) 
 {
+	if (native()) {
+		shared_ptr<AcquisitionsContainer> sptr_acqs =
+			acquisitions.new_acquisitions_container();
+		sptr_acqs->reserve(acquisitions.number());
+		run_natively_(acquisitions.acquisitions_info(),
+			acquisitions_source(acquisitions),
+			[sptr_acqs](NativeGadgetBatch& batch)
+		{
+			for (unsigned int i = 0; i < batch.acquisitions.size(); i++)
+				sptr_acqs->append_acquisition(*batch.acquisitions[i]);
+		});
+		sptr_acqs_ = sptr_acqs;
+		return;
+	}
 
 	std::string config = xml();
 	//std::cout << config << std::endl;
 
 	GTConnector conn;
 
-	sptr_acqs_ = acquisitions.new_acquisitions_container();
-	conn().register_reader(GADGET_MESSAGE_ISMRMRD_ACQUISITION,
-		shared_ptr<GadgetronClientMessageReader>
-		(new GadgetronClientAcquisitionMessageCollector(sptr_acqs_)));
-
 	for (int nt = 0; nt < N_TRIALS; nt++) {
 		try {
+			// a failed attempt may have received some of the results
+			conn().disconnect();
+			sptr_acqs_ = acquisitions.new_acquisitions_container();
+			conn().register_reader(GADGET_MESSAGE_ISMRMRD_ACQUISITION,
+				shared_ptr<GadgetronClientMessageReader>
+				(new GadgetronClientAcquisitionMessageCollector(sptr_acqs_)));
 			conn().connect(host_, port_);
 			conn().send_gadgetron_configuration_script(config);
 
 			conn().send_gadgetron_parameters(acquisitions.acquisitions_info());
 
-			uint32_t nacq = 0;
-			nacq = acquisitions.number();
-
-			//std::cout << nacq << " acquisitions" << std::endl;
-
-			ISMRMRD::Acquisition acq_tmp;
-			for (uint32_t i = 0; i < nacq; i++) {
-				acquisitions.get_acquisition(i, acq_tmp);
-				conn().send_ismrmrd_acquisition(acq_tmp);
-			}
+			GadgetronClientAcquisitionStreamer streamer(conn());
+			streamer.send(acquisitions);
+			streaming_stats_ = streamer.stats();
 
 			conn().send_gadgetron_close();
 			conn().wait();
+			session_stats_ = conn().session_stats();
 
 			break;
 		}
@@ -133,40 +236,127 @@ AcquisitionsProcessor::process(AcquisitionsContainer& acquisitions)
 	}
 }
 
+void
+ImagesReconstructor::set_endpoints(std::string endpoints)
+{
+	std::vector<std::string> items;
+	boost::split(items, endpoints, boost::is_any_of(", "),
+		boost::token_compress_on);
+	std::vector<std::pair<std::string, std::string> > list;
+	for (unsigned int i = 0; i < items.size(); i++) {
+		std::string& item = items[i];
+		if (item.empty())
+			continue;
+		size_t colon = item.rfind(':');
+		if (colon == std::string::npos)
+			list.push_back(std::make_pair(item, std::string("9002")));
+		else
+			list.push_back(std::make_pair
+			(item.substr(0, colon), item.substr(colon + 1)));
+	}
+	if (list.empty())
+		THROW("no Gadgetron server endpoints specified");
+	endpoints_ = list;
+	host_ = endpoints_[0].first;
+	port_ = endpoints_[0].second;
+}
+
+void
+ImagesReconstructor::set_shard_by(std::string field)
+{
+	if (boost::iequals(field, "none"))
+		shard_by_ = "none";
+	else if (boost::iequals(field, "slice"))
+		shard_by_ = "slice";
+	else if (boost::iequals(field, "repetition"))
+		shard_by_ = "repetition";
+	else {
+		std::string msg = "unknown sharding field " + field;
+		THROW(msg.c_str());
+	}
+}
+
 void 
 ImagesReconstructor::process(AcquisitionsContainer& acquisitions)
 {
+	sptr_acqs_.reset();
+	if (!sptr_preprocessor_.get() || !return_acquisitions_ || native()) {
+		process_(acquisitions);
+		return;
+	}
+	// the processed acquisitions cannot be sent back by the server
+	// in the middle of the chain, hence separate sessions
+	sptr_preprocessor_->process(acquisitions);
+	shared_ptr<AcquisitionsContainer> sptr_acqs =
+		sptr_preprocessor_->get_output();
+	sptr_prefix_.reset();
+	try {
+		process_(*sptr_acqs);
+	}
+	catch (...) {
+		sptr_prefix_ = sptr_preprocessor_;
+		throw;
+	}
+	sptr_prefix_ = sptr_preprocessor_;
+	session_stats_.accumulate(sptr_preprocessor_->session_stats());
+	streaming_stats_.accumulate(sptr_preprocessor_->streaming_stats());
+	sptr_acqs_ = sptr_acqs;
+}
+
+void 
+ImagesReconstructor::process_(AcquisitionsContainer& acquisitions)
+{
+	if (native()) {
+		shared_ptr<ImagesContainer> sptr_images = ImagesContainer::new_default();
+		shared_ptr<aNativeGadget> sptr_tap;
+		shared_ptr<AcquisitionsContainer> sptr_acqs;
+		if (sptr_prefix_.get() && return_acquisitions_) {
+			sptr_acqs = acquisitions.new_acquisitions_container();
+			sptr_acqs->reserve(acquisitions.number());
+			sptr_tap.reset(new NativeTapGadget
+				([sptr_acqs](const NativeGadgetBatch& batch)
+			{
+				for (unsigned int i = 0; i < batch.acquisitions.size(); i++)
+					sptr_acqs->append_acquisition(*batch.acquisitions[i]);
+			}));
+		}
+		run_natively_(acquisitions.acquisitions_info(),
+			acquisitions_source(acquisitions), images_sink(sptr_images),
+			sptr_tap);
+		sptr_images_ = sptr_images;
+		sptr_acqs_ = sptr_acqs;
+		return;
+	}
+	if (shard_by_ != "none") {
+		process_sharded_(acquisitions);
+		return;
+	}
 
 	std::string config = xml();
 	//std::cout << "config:\n" << config << std::endl;
 
 	GTConnector conn;
 
-	sptr_images_.reset(new ImagesVector);
-	conn().register_reader(GADGET_MESSAGE_ISMRMRD_IMAGE,
-		shared_ptr<GadgetronClientMessageReader>
-		(new GadgetronClientImageMessageCollector(sptr_images_)));
-
 	for (int nt = 0; nt < N_TRIALS; nt++) {
 		try {
+			// a failed attempt may have received some of the results
+			conn().disconnect();
+			sptr_images_ = ImagesContainer::new_default();
+			conn().register_reader(GADGET_MESSAGE_ISMRMRD_IMAGE,
+				shared_ptr<GadgetronClientMessageReader>
+				(new GadgetronClientImageMessageCollector(sptr_images_)));
 			conn().connect(host_, port_);
 			conn().send_gadgetron_configuration_script(config);
 
 			conn().send_gadgetron_parameters(acquisitions.acquisitions_info());
 
-			uint32_t nacquisitions = 0;
-			nacquisitions = acquisitions.number();
-
-			//std::cout << nacquisitions << " acquisitions" << std::endl;
-
-			ISMRMRD::Acquisition acq_tmp;
-			for (uint32_t i = 0; i < nacquisitions; i++) {
-				acquisitions.get_acquisition(i, acq_tmp);
-				conn().send_ismrmrd_acquisition(acq_tmp);
-			}
+			GadgetronClientAcquisitionStreamer streamer(conn());
+			streamer.send(acquisitions);
+			streaming_stats_ = streamer.stats();
 
 			conn().send_gadgetron_close();
 			conn().wait();
+			session_stats_ = conn().session_stats();
 
 			break;
 		}
@@ -177,21 +367,177 @@ ImagesReconstructor::process(AcquisitionsContainer& acquisitions)
 	}
 }
 
+static shared_ptr<ImagesContainer>
+reconstruct_shard(const std::string& config, const std::string& par,
+	AcquisitionsContainer& acquisitions, const std::vector<uint32_t>& shard,
+	const std::string& host, const std::string& port,
+	GadgetronClientSessionStats& stats,
+	GadgetronClientStreamingStats& streaming_stats)
+{
+	GTConnector conn;
+
+	shared_ptr<ImagesContainer> sptr_images = ImagesContainer::new_default();
+	conn().register_reader(GADGET_MESSAGE_ISMRMRD_IMAGE,
+		shared_ptr<GadgetronClientMessageReader>
+		(new GadgetronClientImageMessageCollector(sptr_images)));
+
+	conn().connect(host, port);
+	conn().send_gadgetron_configuration_script(config);
+	conn().send_gadgetron_parameters(par);
+
+	GadgetronClientAcquisitionStreamer streamer(conn());
+	streamer.send((uint32_t)shard.size(),
+		[&](uint32_t i, ISMRMRD::Acquisition& acq)
+	{
+		acquisitions.get_acquisition(shard[i], acq);
+	});
+	streaming_stats = streamer.stats();
+
+	conn().send_gadgetron_close();
+	conn().wait();
+	stats = conn().session_stats();
+	if (!conn().closed_by_server())
+		throw GadgetronClientException("connection terminated prematurely");
+
+	return sptr_images;
+}
+
+void
+ImagesReconstructor::process_sharded_(AcquisitionsContainer& acquisitions)
+{
+	std::string config = xml();
+	std::string par = acquisitions.acquisitions_info();
+	bool by_slice = shard_by_ == "slice";
+
+	// split acquisitions by the index field, noise readouts go to every shard
+	std::map<unsigned int, std::vector<uint32_t> > keyed;
+	std::vector<uint32_t> noise;
+	std::vector<ISMRMRD::AcquisitionHeader> headers(acquisitions.number());
+	uint32_t na = headers.empty() ? 0 :
+		acquisitions.get_acquisitions_headers(&headers[0]);
+	for (uint32_t i = 0; i < na; i++) {
+		const ISMRMRD::AcquisitionHeader& head = headers[i];
+		if (ISMRMRD::ismrmrd_is_flag_set
+			(head.flags, ISMRMRD::ISMRMRD_ACQ_IS_NOISE_MEASUREMENT))
+			noise.push_back(i);
+		else
+			keyed[by_slice ? head.idx.slice : head.idx.repetition].push_back(i);
+	}
+	std::vector<std::vector<uint32_t> > shards;
+#ifdef _MSC_VER
+	std::map<unsigned int, std::vector<uint32_t> >::iterator it;
+#else
+	typename std::map<unsigned int, std::vector<uint32_t> >::iterator it;
+#endif
+	for (it = keyed.begin(); it != keyed.end(); it++) {
+		std::vector<uint32_t> shard;
+		shard.reserve(noise.size() + it->second.size());
+		// keep the original order of acquisitions
+		std::merge(noise.begin(), noise.end(),
+			it->second.begin(), it->second.end(), std::back_inserter(shard));
+		shards.push_back(shard);
+	}
+	if (shards.empty())
+		shards.push_back(noise);
+
+	std::vector<std::pair<std::string, std::string> > endpoints(endpoints_);
+	if (endpoints.empty())
+		endpoints.push_back(std::make_pair(host_, port_));
+	unsigned int ns = (unsigned int)shards.size();
+	unsigned int ne = (unsigned int)endpoints.size();
+	unsigned int nw = std::min(ns, ne);
+
+	// each worker owns an endpoint and takes shards in turn; a failed shard
+	// is retried on the next endpoints without resending the other shards
+	std::vector<shared_ptr<ImagesContainer> > results(ns);
+	std::vector<GadgetronClientSessionStats> stats(ns);
+	std::vector<GadgetronClientStreamingStats> streaming_stats(ns);
+	std::atomic<unsigned int> next(0);
+	std::atomic<bool> failed(false);
+	std::vector<std::thread> workers;
+	for (unsigned int w = 0; w < nw; w++)
+		workers.push_back(std::thread([&, w]()
+	{
+		for (unsigned int s = next++; s < ns && !failed; s = next++) {
+			for (int nt = 0; nt < N_TRIALS; nt++) {
+				const std::pair<std::string, std::string>& e =
+					endpoints[(w + nt) % ne];
+				try {
+					results[s] = reconstruct_shard
+						(config, par, acquisitions, shards[s], e.first, e.second,
+						stats[s], streaming_stats[s]);
+					break;
+				}
+				catch (...) {
+					std::cout << "shard " << s << " failed on " 
+						<< e.first << ':' << e.second;
+					if (nt < N_TRIALS - 1)
+						std::cout << ", trying again...\n";
+					else {
+						std::cout << std::endl;
+						failed = true;
+					}
+				}
+			}
+		}
+	}));
+	for (unsigned int w = 0; w < nw; w++)
+		workers[w].join();
+	session_stats_.reset();
+	streaming_stats_.reset();
+	for (unsigned int s = 0; s < ns; s++) {
+		session_stats_.accumulate(stats[s]);
+		streaming_stats_.accumulate(streaming_stats[s]);
+	}
+	if (failed)
+		THROW("Server running Gadgetron not accessible");
+
+	// merge shard results in the order of the index field
+	shared_ptr<ImagesContainer> sptr_images = ImagesContainer::new_default();
+	int nimages = 0;
+	for (unsigned int s = 0; s < ns; s++) {
+		ImagesContainer& images = *results[s];
+		for (unsigned int i = 0; i < images.number(); i++)
+			sptr_images->append(images.sptr_image_wrap(i));
+		nimages += images.number() / images.types();
+	}
+	sptr_images->count(nimages);
+	sptr_images_ = sptr_images;
+}
+
 void 
 ImagesProcessor::process(ImagesContainer& images)
 {
+	if (native()) {
+		shared_ptr<ImagesContainer> sptr_images = images.new_images_container();
+		unsigned int next = 0;
+		run_natively_(std::string(), [&](NativeGadgetBatch& batch)
+		{
+			const unsigned int batch_size = 8;
+			unsigned int n = images.number();
+			if (next >= n)
+				return false;
+			for (unsigned int j = 0; j < batch_size && next < n; j++, next++)
+				batch.images.push_back(shared_ptr<ImageWrap>
+				(new ImageWrap(images.image_wrap(next))));
+			return true;
+		}, images_sink(sptr_images));
+		sptr_images_ = sptr_images;
+		return;
+	}
 	std::string config = xml();
 	//std::cout << config << std::endl;
 
 	GTConnector conn;
 
-	sptr_images_ = images.new_images_container();
-	conn().register_reader(GADGET_MESSAGE_ISMRMRD_IMAGE,
-		shared_ptr<GadgetronClientMessageReader>
-		(new GadgetronClientImageMessageCollector(sptr_images_)));
-
 	for (int nt = 0; nt < N_TRIALS; nt++) {
 		try {
+			// a failed attempt may have received some of the results
+			conn().disconnect();
+			sptr_images_ = images.new_images_container();
+			conn().register_reader(GADGET_MESSAGE_ISMRMRD_IMAGE,
+				shared_ptr<GadgetronClientMessageReader>
+				(new GadgetronClientImageMessageCollector(sptr_images_)));
 			conn().connect(host_, port_);
 			conn().send_gadgetron_configuration_script(config);
 
@@ -202,6 +548,7 @@ ImagesProcessor::process(ImagesContainer& images)
 
 			conn().send_gadgetron_close();
 			conn().wait();
+			session_stats_ = conn().session_stats();
 
 			break;
 		}
@@ -32,6 +32,8 @@ limitations under the License.
 
 #include <cmath>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <boost/thread/mutex.hpp>
 #include <boost/shared_ptr.hpp>
@@ -136,10 +138,10 @@ writer gadget
 
 class GadgetChain { //: public anObject {
 public:
-	//GadgetChain()
-	//{
-	//	class_ = "GadgetChain";
-	//}
+	GadgetChain() : native_(false)
+	{
+		//class_ = "GadgetChain";
+	}
 	static const char* class_name()
 	{
 		return "GadgetChain";
@@ -172,7 +174,39 @@ public:
 	shared_ptr<aGadget> gadget_sptr(std::string id);
 	// returns string containing the definition of the chain in xml format
 	std::string xml() const;
+	// enables/disables running the chain in-process when all its gadgets
+	// have native implementations (disabled by default: the native
+	// implementations are yet to be validated against Gadgetron)
+	void set_native(bool native)
+	{
+		native_ = native;
+	}
+	// true if the chain is to run in-process
+	bool native() const;
+	// client-server communication statistics of the last processing
+	const GadgetronClientSessionStats& session_stats() const
+	{
+		return session_stats_;
+	}
+	// statistics of the last acquisitions upload to the server
+	// (summed over concurrent uploads if sharded)
+	const GadgetronClientStreamingStats& streaming_stats() const
+	{
+		return streaming_stats_;
+	}
+protected:
+	GadgetronClientSessionStats session_stats_;
+	GadgetronClientStreamingStats streaming_stats_;
+	// chain whose gadgets precede the own ones
+	shared_ptr<GadgetChain> sptr_prefix_;
+
+	// runs the chain in-process, passing the data coming out of the
+	// prefix gadgets to sptr_tap if present
+	void run_natively_(const std::string& info,
+		NativeGadgetPipeline::Source source, NativeGadgetPipeline::Sink sink,
+		shared_ptr<aNativeGadget> sptr_tap = shared_ptr<aNativeGadget>());
 private:
+	bool native_;
 	std::list<shared_ptr<GadgetHandle> > readers_;
 	std::list<shared_ptr<GadgetHandle> > writers_;
 	std::list<shared_ptr<GadgetHandle> > gadgets_;
@@ -208,6 +242,12 @@ public:
 		return "AcquisitionsProcessor";
 	}
 
+	// sets the Gadgetron server to connect to
+	void set_server(std::string host, std::string port)
+	{
+		host_ = host;
+		port_ = port;
+	}
 	void process(AcquisitionsContainer& acquisitions);
 	shared_ptr<AcquisitionsContainer> get_output() 
 	{
@@ -233,8 +273,8 @@ class ImagesReconstructor : public GadgetChain {
 public:
 
 	ImagesReconstructor() :
-		host_("localhost"), port_("9002"),
-		reader_(new IsmrmrdAcqMsgReader),
+		host_("localhost"), port_("9002"), shard_by_("none"),
+		return_acquisitions_(false), reader_(new IsmrmrdAcqMsgReader),
 		writer_(new IsmrmrdImgMsgWriter)
 	{
 		//class_ = "ImagesReconstructor";
@@ -249,18 +289,55 @@ public:
 		return "ImagesReconstructor";
 	}
 
+	// Sets the servers to use: a comma-separated list of host[:port]
+	// items; the first one is used for unsharded reconstruction.
+	// An endpoint may be listed more than once to have several
+	// concurrent connections to it.
+	void set_endpoints(std::string endpoints);
+	// Sets the acquisitions index field to split the data by
+	// for concurrent reconstruction: "none", "slice" or "repetition".
+	void set_shard_by(std::string field);
+	// Makes the reconstruction start with the gadgets of the given
+	// acquisitions processor, so that raw acquisitions are processed and
+	// reconstructed in one go and sent to the server only once.
+	void set_preprocessor(shared_ptr<AcquisitionsProcessor> sptr_ap)
+	{
+		sptr_preprocessor_ = sptr_ap;
+		sptr_prefix_ = sptr_ap;
+	}
+	// Makes the reconstruction keep the preprocessed acquisitions
+	// (see get_processed_acquisitions()). Gadgetron cannot send back data
+	// from the middle of a chain, so unless the chain runs in-process,
+	// the preprocessing then takes a separate session.
+	void set_return_acquisitions(bool return_acquisitions)
+	{
+		return_acquisitions_ = return_acquisitions;
+	}
+
 	void process(AcquisitionsContainer& acquisitions);
 	shared_ptr<ImagesContainer> get_output() 
 	{
 		return sptr_images_;
 	}
+	shared_ptr<AcquisitionsContainer> get_processed_acquisitions()
+	{
+		return sptr_acqs_;
+	}
 
 private:
 	std::string host_;
 	std::string port_;
+	std::vector<std::pair<std::string, std::string> > endpoints_;
+	std::string shard_by_;
+	bool return_acquisitions_;
 	shared_ptr<IsmrmrdAcqMsgReader> reader_;
 	shared_ptr<IsmrmrdImgMsgWriter> writer_;
 	shared_ptr<ImagesContainer> sptr_images_;
+	shared_ptr<AcquisitionsProcessor> sptr_preprocessor_;
+	shared_ptr<AcquisitionsContainer> sptr_acqs_;
+
+	void process_(AcquisitionsContainer& acquisitions);
+	void process_sharded_(AcquisitionsContainer& acquisitions);
 };
 
 /*!
@@ -288,6 +365,12 @@ public:
 		return "ImagesProcessor";
 	}
 
+	// sets the Gadgetron server to connect to
+	void set_server(std::string host, std::string port)
+	{
+		host_ = host;
+		port_ = port;
+	}
 	void process(ImagesContainer& images);
 	shared_ptr<ImagesContainer> get_output() 
 	{
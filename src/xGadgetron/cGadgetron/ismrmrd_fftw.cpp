@@ -40,6 +40,10 @@ IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <ismrmrd/meta.h>
 #include <ismrmrd/xml.h>
 
+#include <map>
+#include <mutex>
+#include <vector>
+
 #include <fftw3.h>
 
 #include "ismrmrd_fftw.h"
@@ -48,6 +52,13 @@ namespace ISMRMRD {
 
 #define fftshift(out, in, x, y) circshift(out, in, x, y, (x/2), (y/2))
 
+	// FFTW planner is not thread-safe, plan execution is
+	static std::mutex& fftw_planner_mutex()
+	{
+		static std::mutex mutex;
+		return mutex;
+	}
+
 	int fft2c(NDArray<complex_float_t> &a, bool forward)
 	{
 		if (a.getNDim() < 2) {
@@ -74,6 +85,7 @@ namespace ISMRMRD {
 				&a(0, 0, f), a.getDims()[0], a.getDims()[1]);
 
 			//Create the FFTW plan
+			std::unique_lock<std::mutex> lock(fftw_planner_mutex());
 			fftwf_plan p;
 			if (forward) {
 				p = fftwf_plan_dft_2d
@@ -85,12 +97,14 @@ namespace ISMRMRD {
 					(a.getDims()[1], a.getDims()[0], tmp, tmp,
 					FFTW_BACKWARD, FFTW_ESTIMATE);
 			}
+			lock.unlock();
 			fftwf_execute(p);
 
 			fftshift(&a(0, 0, f), reinterpret_cast<std::complex<float>*>(tmp),
 				a.getDims()[0], a.getDims()[1]);
 
 			//Clean up.
+			lock.lock();
 			fftwf_destroy_plan(p);
 		}
 
@@ -112,5 +126,52 @@ namespace ISMRMRD {
 		return fft2c(a, false);
 	}
 
-};
+	// in-place unaligned plans for 1D transforms, kept for the lifetime
+	// of the program and shared by all threads
+	static fftwf_plan fft1_plan(int n, int howmany, bool forward)
+	{
+		typedef std::map<std::pair<int, int>, fftwf_plan> PlanMap;
+		static PlanMap plans[2];
+		std::lock_guard<std::mutex> lock(fftw_planner_mutex());
+		PlanMap& pm = plans[forward ? 0 : 1];
+		std::pair<int, int> key(n, howmany);
+		PlanMap::iterator it = pm.find(key);
+		if (it != pm.end())
+			return it->second;
+		fftwf_complex* tmp =
+			(fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*n*howmany);
+		if (!tmp)
+			return 0;
+		fftwf_plan p = fftwf_plan_many_dft(1, &n, howmany,
+			tmp, 0, 1, n, tmp, 0, 1, n,
+			forward ? FFTW_FORWARD : FFTW_BACKWARD,
+			FFTW_ESTIMATE | FFTW_UNALIGNED);
+		fftwf_free(tmp);
+		if (p)
+			pm[key] = p;
+		return p;
+	}
+
+	int fft1c(complex_float_t* data, int n, int howmany, bool forward)
+	{
+		if (n < 1 || howmany < 1)
+			return 0;
+		fftwf_plan p = fft1_plan(n, howmany, forward);
+		if (!p) {
+			std::cout << "fft1c Error: cannot create FFTW plan" << std::endl;
+			return -1;
+		}
+		std::vector<complex_float_t> tmp((size_t)n*howmany);
+		for (int f = 0; f < howmany; f++)
+			circshift(&tmp[(size_t)f*n], data + (size_t)f*n, n, 1, n - n/2, 0);
+		fftwf_execute_dft(p, reinterpret_cast<fftwf_complex*>(&tmp[0]),
+			reinterpret_cast<fftwf_complex*>(&tmp[0]));
+		float scale = 1.0f / std::sqrt(1.0f*n);
+		for (int f = 0; f < howmany; f++)
+			circshift(data + (size_t)f*n, &tmp[(size_t)f*n], n, 1, n/2, 0);
+		for (size_t i = 0; i < (size_t)n*howmany; i++)
+			data[i] *= scale;
+		return 0;
+	}
 
+};
@@ -52,6 +52,9 @@ namespace ISMRMRD {
 	}
 	int fft2c(NDArray<complex_float_t> &a);
 	int ifft2c(NDArray<complex_float_t> &a);
+	// centered 1D FFT of howmany contiguous arrays of length n stored
+	// one after another, may be called by several threads at once
+	int fft1c(complex_float_t* data, int n, int howmany, bool forward);
 
 };
 
@@ -0,0 +1,671 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup SIRF Gadgetron client
+\brief Throughput benchmark for Gadgetron client-server communication.
+
+Runs AcquisitionsProcessor, ImagesReconstructor and ImagesProcessor against
+MockGadgetronServer for a range of readout sizes and reports messages per
+second, megabytes per second and the round-trip time of a single-message
+session (connect, configure, send, close). Then checks that a
+reconstruction sharded by slice over several mock servers, one of which
+is not running, returns all images in the order of the index field, that
+one slice of ordered acquisitions is exported as complex data intact, and
+that a collector whose storage falls behind pauses reading instead of
+blocking the io thread, that images stored in one block behave as
+images stored separately, that selecting images by an attribute sees
+changes made to it since the last selection, that changing copies of
+an image leaves the original unchanged, and that images written in
+background while being changed are written as in foreground.
+
+Usage: gadgetron_client_benchmark [port [readouts [channels]]]
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "cgadgetron_shared_ptr.h"
+#include "gadgetron_data_containers.h"
+#include "gadgetron_x.h"
+#include "mock_gadgetron_server.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double
+seconds_since(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static shared_ptr<AcquisitionsContainer>
+synthetic_acquisitions(unsigned int na, unsigned int nc, unsigned int ns)
+{
+	shared_ptr<AcquisitionsContainer> sptr_acqs(new AcquisitionsVector);
+	ISMRMRD::Acquisition acq(ns, nc);
+	const unsigned int ny = 128;
+	for (unsigned int i = 0; i < na; i++) {
+		acq.idx().kspace_encode_step_1 = i % ny;
+		acq.idx().slice = (i / ny) % 4;
+		acq.idx().repetition = i / (4 * ny);
+		complex_float_t* ptr = acq.getDataPtr();
+		for (unsigned int j = 0; j < nc*ns; j++)
+			ptr[j] = complex_float_t((float)(i + j), (float)i);
+		sptr_acqs->append_acquisition(acq);
+	}
+	return sptr_acqs;
+}
+
+static shared_ptr<ImagesContainer>
+synthetic_images(unsigned int ni, unsigned int n)
+{
+	shared_ptr<ImagesContainer> sptr_imgs(new ImagesVector);
+	for (unsigned int i = 0; i < ni; i++) {
+		ISMRMRD::Image<complex_float_t>* ptr_img =
+			new ISMRMRD::Image<complex_float_t>(n, n, 1, 1);
+		ptr_img->setImageType(ISMRMRD::ISMRMRD_IMTYPE_COMPLEX);
+		ptr_img->setSlice(i);
+		std::fill(ptr_img->getDataPtr(), ptr_img->getDataPtr() + n*n,
+			complex_float_t((float)i, 0.0f));
+		sptr_imgs->append(ISMRMRD::ISMRMRD_CXFLOAT, ptr_img);
+	}
+	sptr_imgs->count(ni);
+	return sptr_imgs;
+}
+
+// messages and bytes are those actually sent and received in the session
+static void
+report(const char* name, unsigned int ns, 
+	const GadgetronClientSessionStats& stats, double t, double rtt)
+{
+	double messages = (double)(stats.messages_sent + stats.messages_received);
+	double bytes = (double)(stats.bytes_sent + stats.bytes_received);
+	printf("%-22s %6u %10.0f %10.1f %10.3f\n", name, ns,
+		messages / t, bytes / t / 1e6, rtt*1e3);
+}
+
+// median time of a few single-message sessions
+template<class Processor, class Input>
+static double
+round_trip_time(Processor& proc, Input& input)
+{
+	std::vector<double> times;
+	for (int i = 0; i < 5; i++) {
+		Clock::time_point start = Clock::now();
+		proc.process(input);
+		times.push_back(seconds_since(start));
+	}
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+// reconstructs acquisitions made by synthetic_acquisitions() sharded by
+// slice over servers at ports port, ..., port + nservers - 1 and port + 
+// nservers, at which none is running, so that the shards sent there are 
+// retried on the others; returns 0 if all images arrive in the right order
+static int
+check_sharding(unsigned short port, unsigned int nservers, 
+	unsigned int na, unsigned int nc, unsigned int ns)
+{
+	std::vector<shared_ptr<MockGadgetronServer> > servers;
+	std::string endpoints;
+	for (unsigned int i = 0; i <= nservers; i++) {
+		unsigned short p = (unsigned short)(port + i);
+		if (i > 0 && i < nservers) {
+			servers.push_back(shared_ptr<MockGadgetronServer>
+				(new MockGadgetronServer(p)));
+			servers.back()->start();
+		}
+		char item[32];
+		sprintf(item, "%slocalhost:%u", i ? "," : "", p);
+		endpoints += item;
+	}
+
+	ImagesReconstructor ir;
+	ir.set_native(false);
+	ir.set_endpoints(endpoints);
+	ir.set_shard_by("slice");
+	ir.process(*synthetic_acquisitions(na, nc, ns));
+	shared_ptr<ImagesContainer> sptr_images = ir.get_output();
+	for (unsigned int i = 0; i < servers.size(); i++)
+		servers[i]->stop();
+
+	// synthetic_acquisitions() makes 4 slices of 128 readouts per repetition,
+	// the mock server makes one image per slice and repetition, the first
+	// pixel of which is the first sample of the first readout
+	const unsigned int ny = 128;
+	unsigned int nr = (na + 4 * ny - 1) / (4 * ny);
+	std::vector<unsigned int> expected;
+	for (unsigned int slice = 0; slice < 4; slice++)
+		for (unsigned int rep = 0; rep < nr; rep++) {
+			unsigned int i = rep * 4 * ny + slice * ny;
+			if (i < na)
+				expected.push_back(i);
+		}
+	unsigned int ni = sptr_images->number();
+	if (ni != expected.size()) {
+		std::cout << "sharded reconstruction: expected " << expected.size()
+			<< " images, received " << ni << '\n';
+		return 1;
+	}
+	std::vector<complex_float_t> data;
+	for (unsigned int i = 0; i < ni; i++) {
+		const ImageWrap& iw = sptr_images->image_wrap(i);
+		data.resize(iw.size());
+		iw.get_complex_data(&data[0]);
+		unsigned int first = expected[i];
+		if (iw.head().slice != (first / ny) % 4 ||
+			iw.head().repetition != first / (4 * ny) ||
+			data[0] != complex_float_t((float)first, (float)first)) {
+			std::cout << "sharded reconstruction: image " << i
+				<< " out of order\n";
+			return 1;
+		}
+	}
+	printf("sharded reconstruction: %u images in order from %u servers\n",
+		ni, nservers);
+	return 0;
+}
+
+// exports one slice of acquisitions ordered into nz slices of ny readouts
+// into a buffer of exactly one slice size and compares it with the float
+// export; returns 0 if both are as expected
+static int
+check_ordered_slice(unsigned int nz, unsigned int ny,
+	unsigned int nc, unsigned int ns)
+{
+	AcquisitionsVector acqs;
+	ISMRMRD::Acquisition acq(ns, nc);
+	for (unsigned int i = 0; i < nz*ny; i++) {
+		acq.clearAllFlags();
+		if (i % ny == 0)
+			acq.setFlag(ISMRMRD::ISMRMRD_ACQ_FIRST_IN_SLICE);
+		if (i % ny == ny - 1)
+			acq.setFlag(ISMRMRD::ISMRMRD_ACQ_LAST_IN_SLICE);
+		acq.idx().kspace_encode_step_1 = i % ny;
+		acq.idx().slice = i / ny;
+		for (unsigned int c = 0; c < nc; c++)
+			for (unsigned int s = 0; s < ns; s++)
+				acq.data(s, c) = complex_float_t((float)i, (float)(c*ns + s));
+		acqs.append_acquisition(acq);
+	}
+	acqs.set_ordered(true);
+
+	unsigned int slice = nz - 1;
+	size_t size = (size_t)ns*nc*ny;
+	std::vector<complex_float_t> z(size);
+	std::vector<float> re(size), im(size);
+	unsigned int n = acqs.get_acquisitions_data(slice, &z[0]);
+	unsigned int m = acqs.get_acquisitions_data(slice, &re[0], &im[0]);
+	if (n != ny || m != ny) {
+		std::cout << "ordered slice: expected " << ny << " readouts, got "
+			<< n << " and " << m << '\n';
+		return 1;
+	}
+	for (unsigned int c = 0; c < nc; c++)
+		for (unsigned int y = 0; y < ny; y++)
+			for (unsigned int s = 0; s < ns; s++) {
+				size_t i = s + ns*(y + ny*c);
+				complex_float_t expected
+					((float)(slice*ny + y), (float)(c*ns + s));
+				if (z[i] != expected || 
+					z[i] != complex_float_t(re[i], im[i])) {
+					std::cout << "ordered slice: wrong value at sample " << s
+						<< ", readout " << y << ", coil " << c << '\n';
+					return 1;
+				}
+			}
+	printf("ordered slice: %u readouts of %u coils exported\n", n, nc);
+	return 0;
+}
+
+// fills both batches of a writer whose storage is held up, checks that
+// ready() then returns at once, and that reading is resumed once a batch
+// has been stored; returns 0 if so
+static int
+check_paused_reading()
+{
+	boost::mutex mtx;
+	boost::condition_variable cv;
+	bool release = false;
+	GadgetronClientBatchWriter<int> writer([&](std::vector<int>&, size_t)
+	{
+		boost::mutex::scoped_lock lock(mtx);
+		while (!release)
+			cv.wait(lock);
+	}, 1, 2);
+	std::atomic<bool> resumed(false);
+	std::function<void()> resume = [&resumed]() { resumed = true; };
+	for (int i = 0; i < 2; i++) {
+		if (!writer.ready(resume)) {
+			std::cout << "paused reading: batch " << i << " not free\n";
+			return 1;
+		}
+		writer.next() = i;
+		writer.commit();
+	}
+	bool paused = !writer.ready(resume);
+	{
+		boost::mutex::scoped_lock lock(mtx);
+		release = true;
+		cv.notify_all();
+	}
+	writer.finish();
+	if (!paused || !resumed) {
+		std::cout << "paused reading: " << (paused ? "not resumed" : 
+			"reading not paused") << '\n';
+		return 1;
+	}
+	printf("paused reading: resumed once a batch was stored\n");
+	return 0;
+}
+
+// fills ni complex n x n images with values depending on seed
+static void
+fill_images(ImagesContainer& images, unsigned int ni, unsigned int n, 
+	float seed)
+{
+	for (unsigned int i = 0; i < ni; i++) {
+		ISMRMRD::Image<complex_float_t>* ptr_img =
+			new ISMRMRD::Image<complex_float_t>(n, n, 1, 1);
+		ptr_img->setImageType(ISMRMRD::ISMRMRD_IMTYPE_COMPLEX);
+		ptr_img->setSlice(i);
+		complex_float_t* ptr = ptr_img->getDataPtr();
+		for (unsigned int j = 0; j < n*n; j++)
+			ptr[j] = complex_float_t(seed*i + 0.5f*(j % 7), seed - (j % 5));
+		images.append(ISMRMRD::ISMRMRD_CXFLOAT, ptr_img);
+	}
+	images.count(ni);
+}
+
+// maximal difference between the pixel values of two containers
+// relative to the largest value
+static float
+images_diff(ImagesContainer& x, ImagesContainer& y, size_t size)
+{
+	std::vector<complex_float_t> u(size), v(size);
+	x.get_images_data_as_complex_array(&u[0]);
+	y.get_images_data_as_complex_array(&v[0]);
+	float d = 0;
+	float s = 0;
+	for (size_t i = 0; i < size; i++) {
+		d = std::max(d, std::abs(u[i] - v[i]));
+		s = std::max(s, std::max(std::abs(u[i]), std::abs(v[i])));
+	}
+	return s > 0 ? d / s : d;
+}
+
+// compares export, import, axpby, dot and norm of images stored in blocks
+// with those of images stored separately, and checks that an image wrap
+// held across bulk operations stays connected to its block; returns 0 if
+// all agree
+static int
+check_images_block(unsigned int ni, unsigned int n)
+{
+	const float eps = 1e-5f;
+	size_t size = (size_t)ni*n*n;
+	ImagesVector u, v;
+	ImagesBlock x, y;
+	fill_images(u, ni, n, 1.0f);
+	fill_images(v, ni, n, -2.0f);
+	fill_images(x, ni, n, 1.0f);
+	fill_images(y, ni, n, -2.0f);
+	int failed = 0;
+	if (images_diff(u, x, size) > 0) {
+		std::cout << "images block: wrong exported values\n";
+		failed++;
+	}
+
+	std::vector<complex_float_t> z(size);
+	for (size_t i = 0; i < size; i++)
+		z[i] = complex_float_t((float)(i % 11), -(float)(i % 13));
+	u.set_complex_images_data(&z[0]);
+	x.set_complex_images_data(&z[0]);
+	std::vector<float> re(size), im(size);
+	x.get_images_data_as_complex_array(&re[0], &im[0]);
+	for (size_t i = 0; i < size; i++)
+		if (complex_float_t(re[i], im[i]) != z[i]) {
+			std::cout << "images block: wrong imported value at " << i << '\n';
+			failed++;
+			break;
+		}
+
+	complex_float_t a(2.0f, -1.0f);
+	complex_float_t b(0.5f, 3.0f);
+	ImagesVector w;
+	ImagesBlock t;
+	w.axpby(a, u, b, v);
+	t.axpby(a, x, b, y);
+	if (t.number() != ni || images_diff(w, t, size) > eps) {
+		std::cout << "images block: axpby differs\n";
+		failed++;
+	}
+	complex_float_t d = u.dot(v);
+	complex_float_t e = x.dot(y);
+	if (std::abs(d - e) > eps*std::abs(d)) {
+		std::cout << "images block: dot " << e << " instead of " << d << '\n';
+		failed++;
+	}
+	float r = w.norm();
+	float s = t.norm();
+	if (std::abs(r - s) > eps*r) {
+		std::cout << "images block: norm " << s << " instead of " << r << '\n';
+		failed++;
+	}
+
+	// changes made via a held wrap reach the block before and after a bulk
+	// operation, and the wrap shows the values imported into the block
+	shared_ptr<ImageWrap> sptr_iw = x.sptr_image_wrap(1);
+	std::vector<complex_float_t> img(n*n, complex_float_t(7.0f, 0.0f));
+	sptr_iw->set_complex_data(&img[0]);
+	x.norm();
+	std::fill(img.begin(), img.end(), complex_float_t(0.0f, 5.0f));
+	sptr_iw->set_complex_data(&img[0]);
+	std::vector<complex_float_t> data(size);
+	x.get_images_data_as_complex_array(&data[0]);
+	if (data[n*n] != img[0] || data[2*n*n - 1] != img[0]) {
+		std::cout << "images block: changes via a held wrap lost\n";
+		failed++;
+	}
+	x.set_complex_images_data(&z[0]);
+	sptr_iw->get_complex_data(&img[0]);
+	if (img[0] != z[n*n] || img[n*n - 1] != z[2*n*n - 1]) {
+		std::cout << "images block: held wrap not updated\n";
+		failed++;
+	}
+	if (!failed)
+		printf("images block: %u images agree with separate ones\n", ni);
+	return failed ? 1 : 0;
+}
+
+// sets the attribute role of the image wrapped by iw
+static void
+set_role(ImageWrap& iw, const char* role)
+{
+	ISMRMRD::MetaContainer mc;
+	mc.set("role", role);
+	std::stringstream ss;
+	ISMRMRD::serialize(mc, ss);
+	((CFImage*)iw.ptr_image())->setAttributeString(ss.str());
+}
+
+// selects images by attribute, changes the attribute of one of them and
+// selects again; returns 0 if the second selection sees the change
+static int
+check_selection_after_change(unsigned int ni)
+{
+	ImagesVector images;
+	fill_images(images, ni, 8, 1.0f);
+	for (unsigned int i = 0; i < ni; i++)
+		set_role(images.image_wrap(i), "image");
+	unsigned int before = images.clone("role", "image")->number();
+	set_role(images.image_wrap(0), "reference");
+	unsigned int after = images.clone("role", "image")->number();
+	unsigned int changed = images.clone("role", "reference")->number();
+	if (before != ni || after != ni - 1 || changed != 1) {
+		std::cout << "selection: " << before << ", " << after << " and "
+			<< changed << " images selected instead of " << ni << ", "
+			<< ni - 1 << " and 1\n";
+		return 1;
+	}
+	printf("selection: attribute change seen by the next selection\n");
+	return 0;
+}
+
+// true if all n pixel values of the image wrapped by iw equal z
+static bool
+all_equal(const ImageWrap& iw, size_t n, complex_float_t z)
+{
+	std::vector<complex_float_t> data(n);
+	iw.get_complex_data(&data[0]);
+	return std::count(data.begin(), data.end(), z) == (std::ptrdiff_t)n;
+}
+
+// changes copies of an image wrap while another thread keeps copying and
+// dropping copies of it; returns 0 if the original stays unchanged
+static int
+check_copy_on_write(unsigned int n, int repeats)
+{
+	ImagesVector images;
+	fill_images(images, 1, n, 0.0f);
+	ImageWrap& original = images.image_wrap(0);
+	std::vector<complex_float_t> data(n*n, complex_float_t(1.0f, 1.0f));
+	original.set_complex_data(&data[0]);
+	std::thread copier([&]()
+	{
+		for (int i = 0; i < repeats; i++)
+			ImageWrap copy(original);
+	});
+	bool changed = true;
+	for (int i = 0; i < repeats; i++) {
+		ImageWrap copy(original);
+		std::vector<complex_float_t> values(n*n, complex_float_t((float)i));
+		copy.set_complex_data(&values[0]);
+		changed = changed && all_equal(copy, n*n, values[0]);
+	}
+	copier.join();
+	if (!changed || !all_equal(original, n*n, data[0])) {
+		std::cout << "copy on write: " << (changed ? "original changed" : 
+			"copy not changed") << '\n';
+		return 1;
+	}
+	printf("copy on write: original unchanged by %d changed copies\n",
+		repeats);
+	return 0;
+}
+
+// reads the images of series 0, ..., ns - 1 from a file
+static std::vector<CFImage>
+read_series(const char* filename, unsigned int ns)
+{
+	std::vector<CFImage> images;
+	Mutex mtx;
+	boost::lock_guard<boost::mutex> lock(mtx());
+	ISMRMRD::Dataset dataset(filename, "dataset");
+	for (unsigned int s = 0; s < ns; s++) {
+		std::stringstream ss;
+		ss << "image_" << s;
+		uint32_t n = dataset.getNumberOfImages(ss.str());
+		for (uint32_t i = 0; i < n; i++) {
+			images.push_back(CFImage());
+			dataset.readImage(ss.str(), i, images.back());
+		}
+	}
+	return images;
+}
+
+// writes images of ns series, interleaved, on the calling thread and in 
+// background while the images are being changed; returns 0 if both files 
+// hold the same images as those written
+static int
+check_images_writer(unsigned int ni, unsigned int ns, unsigned int n)
+{
+	const char* sync_file = "images_writer_sync.h5";
+	const char* async_file = "images_writer_async.h5";
+	std::remove(sync_file);
+	std::remove(async_file);
+	ImagesVector images;
+	fill_images(images, ni, n, 1.0f);
+	for (unsigned int i = 0; i < ni; i++) {
+		ISMRMRD::ImageHeader* ptr_head = images.image_wrap(i).ptr_head();
+		ptr_head->image_series_index = i % ns;
+		ptr_head->image_index = i;
+	}
+	size_t size = (size_t)ni*n*n;
+	std::vector<complex_float_t> data(size);
+	images.get_images_data_as_complex_array(&data[0]);
+	images.write(sync_file, "dataset");
+	{
+		ImagesWriter writer(images, async_file, "dataset", 2);
+		std::vector<complex_float_t> zeros(size);
+		images.set_complex_images_data(&zeros[0]);
+		writer.wait();
+	}
+	std::vector<CFImage> written = read_series(sync_file, ns);
+	std::vector<CFImage> written_async = read_series(async_file, ns);
+	std::remove(sync_file);
+	std::remove(async_file);
+	if (written.size() != ni || written_async.size() != ni) {
+		std::cout << "images writer: " << written.size() << " and "
+			<< written_async.size() << " images written instead of " << ni
+			<< '\n';
+		return 1;
+	}
+	// series by series, each in the order of images
+	std::vector<unsigned int> order;
+	for (unsigned int s = 0; s < ns; s++)
+		for (unsigned int i = s; i < ni; i += ns)
+			order.push_back(i);
+	for (unsigned int k = 0; k < ni; k++) {
+		unsigned int i = order[k];
+		const complex_float_t* expected = &data[(size_t)i*n*n];
+		if (written[k].getHead().image_index != i ||
+			written_async[k].getHead().image_index != i ||
+			!std::equal(expected, expected + n*n, written[k].getDataPtr()) ||
+			!std::equal(expected, expected + n*n, 
+			written_async[k].getDataPtr())) {
+			std::cout << "images writer: image " << i << " differs\n";
+			return 1;
+		}
+	}
+	printf("images writer: %u images of %u series written in background "
+		"as in foreground\n", ni, ns);
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned short port = argc > 1 ? (unsigned short)atoi(argv[1]) : 9102;
+	unsigned int na = argc > 2 ? atoi(argv[2]) : 1024;
+	unsigned int nc = argc > 3 ? atoi(argv[3]) : 8;
+	int status = 0;
+	char port_str[16];
+	sprintf(port_str, "%u", port);
+
+	try {
+		AcquisitionsVector::set_as_template();
+
+		MockGadgetronServer server(port);
+		server.start();
+
+		// chains without gadgets would otherwise run in-process
+		AcquisitionsProcessor ap;
+		ap.set_native(false);
+		ap.set_server("localhost", port_str);
+		ImagesReconstructor ir;
+		ir.set_native(false);
+		ir.set_endpoints(std::string("localhost:") + port_str);
+		ImagesProcessor ip;
+		ip.set_native(false);
+		ip.set_server("localhost", port_str);
+
+		printf("%u readouts, %u channels\n", na, nc);
+		printf("%-22s %6s %10s %10s %10s\n",
+			"chain", "size", "msgs/s", "MB/s", "RTT (ms)");
+
+		const unsigned int sizes[] = { 64, 128, 256, 512, 1024 };
+		for (unsigned int k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+			unsigned int ns = sizes[k];
+			shared_ptr<AcquisitionsContainer> sptr_acqs =
+				synthetic_acquisitions(na, nc, ns);
+			shared_ptr<AcquisitionsContainer> sptr_acq =
+				synthetic_acquisitions(1, nc, ns);
+			// session statistics are overwritten by round_trip_time()
+			GadgetronClientSessionStats stats;
+
+			// acquisitions are echoed back
+			Clock::time_point start = Clock::now();
+			ap.process(*sptr_acqs);
+			double t = seconds_since(start);
+			size_t received = ap.get_output()->number();
+			if (received != na) {
+				std::cout << "AcquisitionsProcessor: sent " << na
+					<< " acquisitions, received " << received << '\n';
+				status = 1;
+			}
+			stats = ap.session_stats();
+			report(AcquisitionsProcessor::class_name(), ns, stats, t,
+				round_trip_time(ap, *sptr_acq));
+
+			// one image per slice and repetition is returned
+			start = Clock::now();
+			ir.process(*sptr_acqs);
+			t = seconds_since(start);
+			stats = ir.session_stats();
+			report(ImagesReconstructor::class_name(), ns, stats, t,
+				round_trip_time(ir, *sptr_acq));
+
+			// ns x ns images are echoed back
+			unsigned int ni = std::max(1u, na*nc / ns);
+			shared_ptr<ImagesContainer> sptr_imgs = synthetic_images(ni, ns);
+			shared_ptr<ImagesContainer> sptr_img = synthetic_images(1, ns);
+			start = Clock::now();
+			ip.process(*sptr_imgs);
+			t = seconds_since(start);
+			stats = ip.session_stats();
+			report(ImagesProcessor::class_name(), ns, stats, t,
+				round_trip_time(ip, *sptr_img));
+		}
+
+		// 4 slices x 2 repetitions; the server at port is reused,
+		// there is none at port + 3
+		if (check_sharding(port, 3, 1024, nc, 64))
+			status = 1;
+		if (check_ordered_slice(3, 16, nc, 64))
+			status = 1;
+		if (check_paused_reading())
+			status = 1;
+		if (check_images_block(5, 32))
+			status = 1;
+		if (check_selection_after_change(4))
+			status = 1;
+		if (check_copy_on_write(16, 1000))
+			status = 1;
+		if (check_images_writer(10, 3, 8))
+			status = 1;
+
+		server.stop();
+		printf("%u sessions served\n", server.sessions());
+	}
+	catch (LocalisedException& le) {
+		std::cout << le.what() << std::endl;
+		return 1;
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+		return 1;
+	}
+	catch (...) {
+		std::cout << "exception thrown" << std::endl;
+		return 1;
+	}
+	return status;
+}
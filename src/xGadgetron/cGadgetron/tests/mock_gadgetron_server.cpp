@@ -0,0 +1,276 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup SIRF Gadgetron client
+\brief Implementation file for a mock Gadgetron server.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#include <iostream>
+#include <map>
+#include <utility>
+
+#include "gadgetron_client.h"
+#include "mock_gadgetron_server.h"
+
+typedef boost::asio::ip::tcp::socket Socket;
+
+static size_t
+image_data_element_size(uint16_t type)
+{
+	switch (type) {
+	case ISMRMRD::ISMRMRD_USHORT:
+	case ISMRMRD::ISMRMRD_SHORT:
+		return 2;
+	case ISMRMRD::ISMRMRD_UINT:
+	case ISMRMRD::ISMRMRD_INT:
+	case ISMRMRD::ISMRMRD_FLOAT:
+		return 4;
+	case ISMRMRD::ISMRMRD_DOUBLE:
+	case ISMRMRD::ISMRMRD_CXFLOAT:
+		return 8;
+	case ISMRMRD::ISMRMRD_CXDOUBLE:
+		return 16;
+	default:
+		throw GadgetronClientException("Invalid image data type");
+	}
+}
+
+static void
+read_bytes(Socket& s, void* ptr, size_t size)
+{
+	if (size)
+		boost::asio::read(s, boost::asio::buffer(ptr, size));
+}
+
+static void
+write_id(std::vector<char>& msg, uint16_t id)
+{
+	GadgetMessageIdentifier mid;
+	mid.id = id;
+	const char* ptr = (const char*)&mid;
+	msg.insert(msg.end(), ptr, ptr + sizeof(GadgetMessageIdentifier));
+}
+
+static void
+write_bytes(std::vector<char>& msg, const void* ptr, size_t size)
+{
+	const char* ptr_c = (const char*)ptr;
+	msg.insert(msg.end(), ptr_c, ptr_c + size);
+}
+
+// first channel of the readouts sharing slice and repetition
+struct SyntheticImage {
+	ISMRMRD::AcquisitionHeader head;
+	std::vector<complex_float_t> data;
+};
+
+static void
+send_synthetic_images(Socket& s, 
+	const std::vector<std::pair<uint32_t, SyntheticImage> >& images)
+{
+	const std::string meta =
+		"<?xml version=\"1.0\"?><ismrmrdMeta><meta>"
+		"<name>GADGETRON_DataRole</name><value>Image</value>"
+		"</meta></ismrmrdMeta>";
+	std::vector<char> msg;
+	for (size_t i = 0; i < images.size(); i++) {
+		const SyntheticImage& si = images[i].second;
+		ISMRMRD::ImageHeader h;
+		memset(&h, 0, sizeof(h));
+		h.version = 1;
+		h.data_type = ISMRMRD::ISMRMRD_CXFLOAT;
+		h.matrix_size[0] = si.head.number_of_samples;
+		h.matrix_size[1] = (uint16_t)(si.data.size() / 
+			(si.head.number_of_samples ? si.head.number_of_samples : 1));
+		h.matrix_size[2] = 1;
+		h.channels = 1;
+		h.slice = si.head.idx.slice;
+		h.repetition = si.head.idx.repetition;
+		h.image_type = ISMRMRD::ISMRMRD_IMTYPE_COMPLEX;
+		h.image_index = (uint16_t)(i + 1);
+		h.attribute_string_len = (uint32_t)meta.size();
+		unsigned long long meta_length = meta.size();
+
+		msg.clear();
+		write_id(msg, GADGET_MESSAGE_ISMRMRD_IMAGE);
+		write_bytes(msg, &h, sizeof(h));
+		write_bytes(msg, &meta_length, sizeof(meta_length));
+		write_bytes(msg, meta.c_str(), meta.size());
+		write_bytes(msg, si.data.data(), si.data.size()*sizeof(complex_float_t));
+		boost::asio::write(s, boost::asio::buffer(msg));
+	}
+}
+
+void
+MockGadgetronServer::start()
+{
+	stop_ = false;
+	acceptor_.reset(new tcp::acceptor(io_service_, 
+		tcp::endpoint(tcp::v4(), port_)));
+	accept_thread_ = 
+		boost::thread(boost::bind(&MockGadgetronServer::accept_task_, this));
+}
+
+void
+MockGadgetronServer::stop()
+{
+	if (!acceptor_.get())
+		return;
+	stop_ = true;
+	// wake up the blocking accept
+	try {
+		boost::asio::io_service ios;
+		Socket s(ios);
+		s.connect(tcp::endpoint
+			(boost::asio::ip::address_v4::loopback(), port_));
+	}
+	catch (...) {
+	}
+	accept_thread_.join();
+	acceptor_.reset();
+	boost::mutex::scoped_lock lock(sessions_mutex_);
+	for (size_t i = 0; i < session_threads_.size(); i++)
+		session_threads_[i]->join();
+	session_threads_.clear();
+}
+
+void
+MockGadgetronServer::accept_task_()
+{
+	while (!stop_) {
+		shared_ptr<Socket> sptr_socket(new Socket(io_service_));
+		boost::system::error_code error;
+		acceptor_->accept(*sptr_socket, error);
+		if (stop_)
+			break;
+		if (error)
+			continue;
+		sessions_++;
+		boost::mutex::scoped_lock lock(sessions_mutex_);
+		session_threads_.push_back(shared_ptr<boost::thread>
+			(new boost::thread(&MockGadgetronServer::session_, sptr_socket)));
+	}
+}
+
+void
+MockGadgetronServer::session_(shared_ptr<Socket> sptr_socket)
+{
+	Socket& s = *sptr_socket;
+	bool echo_acquisitions = false;
+	std::vector<std::pair<uint32_t, SyntheticImage> > images;
+	std::map<uint32_t, size_t> image_index;
+	std::vector<char> msg;
+	std::vector<char> buff;
+
+	try {
+		for (;;) {
+			GadgetMessageIdentifier id;
+			read_bytes(s, &id, sizeof(id));
+
+			if (id.id == GADGET_MESSAGE_CLOSE) {
+				send_synthetic_images(s, images);
+				msg.clear();
+				write_id(msg, GADGET_MESSAGE_CLOSE);
+				boost::asio::write(s, boost::asio::buffer(msg));
+				break;
+			}
+			else if (id.id == GADGET_MESSAGE_CONFIG_FILE) {
+				GadgetMessageConfigurationFile cfg;
+				read_bytes(s, &cfg, sizeof(cfg));
+			}
+			else if (id.id == GADGET_MESSAGE_CONFIG_SCRIPT ||
+				id.id == GADGET_MESSAGE_PARAMETER_SCRIPT) {
+				GadgetMessageScript script;
+				read_bytes(s, &script, sizeof(script));
+				std::string text(script.script_length, 0);
+				read_bytes(s, &text[0], script.script_length);
+				if (id.id == GADGET_MESSAGE_CONFIG_SCRIPT)
+					echo_acquisitions = text.find
+					("GadgetIsmrmrdAcquisitionMessageWriter") != std::string::npos;
+			}
+			else if (id.id == GADGET_MESSAGE_ISMRMRD_ACQUISITION) {
+				ISMRMRD::AcquisitionHeader h;
+				read_bytes(s, &h, sizeof(h));
+				size_t ns = h.number_of_samples;
+				size_t traj_size = sizeof(float)*h.trajectory_dimensions*ns;
+				size_t data_size = 2 * sizeof(float)*h.active_channels*ns;
+				buff.resize(traj_size + data_size);
+				read_bytes(s, buff.data(), buff.size());
+				if (echo_acquisitions) {
+					msg.clear();
+					write_id(msg, GADGET_MESSAGE_ISMRMRD_ACQUISITION);
+					write_bytes(msg, &h, sizeof(h));
+					write_bytes(msg, buff.data(), buff.size());
+					boost::asio::write(s, boost::asio::buffer(msg));
+					continue;
+				}
+				if (h.flags & (1ULL << 
+					(ISMRMRD::ISMRMRD_ACQ_IS_NOISE_MEASUREMENT - 1)))
+					continue;
+				uint32_t key = (uint32_t(h.idx.repetition) << 16) | h.idx.slice;
+				std::map<uint32_t, size_t>::iterator it = image_index.find(key);
+				if (it == image_index.end()) {
+					it = image_index.insert
+						(std::make_pair(key, images.size())).first;
+					images.push_back(std::make_pair(key, SyntheticImage()));
+					images.back().second.head = h;
+				}
+				SyntheticImage& si = images[it->second].second;
+				if (ns != si.head.number_of_samples || !h.active_channels)
+					continue;
+				const complex_float_t* ptr =
+					(const complex_float_t*)(buff.data() + traj_size);
+				si.data.insert(si.data.end(), ptr, ptr + ns);
+			}
+			else if (id.id == GADGET_MESSAGE_ISMRMRD_IMAGE) {
+				ISMRMRD::ImageHeader h;
+				read_bytes(s, &h, sizeof(h));
+				size_t meta_length;
+				read_bytes(s, &meta_length, sizeof(meta_length));
+				size_t data_size = image_data_element_size(h.data_type)*
+					h.matrix_size[0] * h.matrix_size[1] * h.matrix_size[2] *
+					h.channels;
+				buff.resize(meta_length + data_size);
+				read_bytes(s, buff.data(), buff.size());
+				unsigned long long length = meta_length;
+				msg.clear();
+				write_id(msg, GADGET_MESSAGE_ISMRMRD_IMAGE);
+				write_bytes(msg, &h, sizeof(h));
+				write_bytes(msg, &length, sizeof(length));
+				write_bytes(msg, buff.data(), buff.size());
+				boost::asio::write(s, boost::asio::buffer(msg));
+			}
+			else {
+				std::cout << "mock server: unknown message id " << id.id 
+					<< std::endl;
+				break;
+			}
+		}
+	}
+	catch (...) {
+	}
+	boost::system::error_code error;
+	s.close(error);
+}
@@ -0,0 +1,102 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup SIRF Gadgetron client
+\brief Specification file for a mock Gadgetron server.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#ifndef MOCK_GADGETRON_SERVER
+#define MOCK_GADGETRON_SERVER
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <ismrmrd/ismrmrd.h>
+
+#include "cgadgetron_shared_ptr.h"
+
+/*!
+\ingroup SIRF Gadgetron client
+\brief A lightweight stand-in for Gadgetron server.
+
+Speaks the client-server message protocol used by GadgetronClientConnector
+(configuration file or script, parameters, acquisitions, images, close)
+without doing any processing, so that the client can be tested and
+benchmarked without Gadgetron installed.
+
+What is sent back depends on the writer gadget in the configuration
+script: if it is the acquisition writer, every acquisition is echoed back
+as soon as it is received; otherwise, on close, one synthetic complex image
+per (slice, repetition) pair is sent, made of the first channel of the
+respective readouts. Images are always echoed back.
+
+Each connection is served by a separate thread.
+*/
+
+class MockGadgetronServer {
+public:
+	MockGadgetronServer(unsigned short port = 9002) : 
+		port_(port), stop_(false), sessions_(0)
+	{}
+	~MockGadgetronServer()
+	{
+		stop();
+	}
+	// starts accepting connections in a background thread
+	void start();
+	// stops accepting connections and waits for open sessions to finish
+	void stop();
+	unsigned short port() const
+	{
+		return port_;
+	}
+	// number of sessions served so far
+	unsigned int sessions() const
+	{
+		return sessions_;
+	}
+
+private:
+	typedef boost::asio::ip::tcp tcp;
+
+	unsigned short port_;
+	std::atomic<bool> stop_;
+	std::atomic<unsigned int> sessions_;
+	boost::asio::io_service io_service_;
+	shared_ptr<tcp::acceptor> acceptor_;
+	boost::thread accept_thread_;
+	boost::mutex sessions_mutex_;
+	std::vector<shared_ptr<boost::thread> > session_threads_;
+
+	void accept_task_();
+	static void session_(shared_ptr<tcp::socket> sptr_socket);
+};
+
+#endif
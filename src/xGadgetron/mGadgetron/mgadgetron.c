@@ -74,6 +74,9 @@ EXPORTED_FUNCTION 	void* mGT_AcquisitionModelBackward(void* ptr_am, const void*
 EXPORTED_FUNCTION 	void* mGT_setAcquisitionsStorageScheme(const char* scheme) {
 	return cGT_setAcquisitionsStorageScheme(scheme);
 }
+EXPORTED_FUNCTION 	void* mGT_setImagesStorageScheme(const char* scheme) {
+	return cGT_setImagesStorageScheme(scheme);
+}
 EXPORTED_FUNCTION 	void* mGT_ISMRMRDAcquisitionsFromFile(const char* file) {
 	return cGT_ISMRMRDAcquisitionsFromFile(file);
 }
@@ -95,12 +98,24 @@ EXPORTED_FUNCTION 	void* mGT_getAcquisitionsDimensions(void* ptr_acqs, PTR_INT p
 EXPORTED_FUNCTION 	void* mGT_getAcquisitionsFlags(void* ptr_acqs, unsigned int n, PTR_INT ptr_f) {
 	return cGT_getAcquisitionsFlags(ptr_acqs, n, ptr_f);
 }
+EXPORTED_FUNCTION 	void* mGT_getAcquisitionsHeaders(void* ptr_acqs, PTR_INT ptr_h) {
+	return cGT_getAcquisitionsHeaders(ptr_acqs, ptr_h);
+}
+EXPORTED_FUNCTION 	void* mGT_setAcquisitionsHeaders(void* ptr_acqs, PTR_INT ptr_h) {
+	return cGT_setAcquisitionsHeaders(ptr_acqs, ptr_h);
+}
 EXPORTED_FUNCTION 	void* mGT_getAcquisitionsData (void* ptr_acqs, unsigned int slice, PTR_FLOAT ptr_re, PTR_FLOAT ptr_im) {
 	return cGT_getAcquisitionsData (ptr_acqs, slice, ptr_re, ptr_im);
 }
 EXPORTED_FUNCTION 	void* mGT_setAcquisitionsData (void* ptr_acqs, unsigned int na, unsigned int nc, unsigned int ns, PTR_FLOAT ptr_re, PTR_FLOAT ptr_im) {
 	return cGT_setAcquisitionsData (ptr_acqs, na, nc, ns, ptr_re, ptr_im);
 }
+EXPORTED_FUNCTION 	void* mGT_getAcquisitionsComplexData (void* ptr_acqs, unsigned int slice, PTR_FLOAT ptr_z) {
+	return cGT_getAcquisitionsComplexData (ptr_acqs, slice, ptr_z);
+}
+EXPORTED_FUNCTION 	void* mGT_setAcquisitionsComplexData (void* ptr_acqs, unsigned int na, unsigned int nc, unsigned int ns, PTR_FLOAT ptr_z) {
+	return cGT_setAcquisitionsComplexData (ptr_acqs, na, nc, ns, ptr_z);
+}
 EXPORTED_FUNCTION 	void* mGT_reconstructImages(void* ptr_recon, void* ptr_input) {
 	return cGT_reconstructImages(ptr_recon, ptr_input);
 }
@@ -119,6 +134,12 @@ EXPORTED_FUNCTION 	void* mGT_imagesCopy(const void* ptr_imgs) {
 EXPORTED_FUNCTION 	void* mGT_writeImages (void* ptr_imgs, const char* out_file, const char* out_group) {
 	return cGT_writeImages (ptr_imgs, out_file, out_group);
 }
+EXPORTED_FUNCTION 	void* mGT_writeImagesAsync(void* ptr_imgs,  const char* out_file, const char* out_group, int batch_size) {
+	return cGT_writeImagesAsync(ptr_imgs, out_file, out_group, batch_size);
+}
+EXPORTED_FUNCTION 	void* mGT_waitForImagesWriter(void* ptr_w) {
+	return cGT_waitForImagesWriter(ptr_w);
+}
 EXPORTED_FUNCTION 	void* mGT_imageWrapFromContainer(void* ptr_imgs, unsigned int img_num) {
 	return cGT_imageWrapFromContainer(ptr_imgs, img_num);
 }
@@ -128,6 +149,9 @@ EXPORTED_FUNCTION 	void* mGT_imageTypes(const void* ptr_x) {
 EXPORTED_FUNCTION 	void* mGT_imageDataType(const void* ptr_x, int im_num) {
 	return cGT_imageDataType(ptr_x, im_num);
 }
+EXPORTED_FUNCTION 	void* mGT_getImagesHeaders(void* ptr_imgs, PTR_INT ptr_h) {
+	return cGT_getImagesHeaders(ptr_imgs, ptr_h);
+}
 EXPORTED_FUNCTION 	void mGT_getCoilDataDimensions(void* ptr_csms, int csm_num, PTR_INT ptr_dim) {
 	cGT_getCoilDataDimensions(ptr_csms, csm_num, ptr_dim);
 }
@@ -149,6 +173,12 @@ EXPORTED_FUNCTION 	void mGT_getImagesDataAsComplexArray (void* ptr_imgs, PTR_FLO
 EXPORTED_FUNCTION 	void* mGT_setComplexImagesData(void* ptr_imgs, PTR_FLOAT ptr_re, PTR_FLOAT ptr_im) {
 	return cGT_setComplexImagesData(ptr_imgs, ptr_re, ptr_im);
 }
+EXPORTED_FUNCTION 	void* mGT_getImagesComplexData(void* ptr_imgs, PTR_FLOAT ptr_z) {
+	return cGT_getImagesComplexData(ptr_imgs, ptr_z);
+}
+EXPORTED_FUNCTION 	void* mGT_setImagesComplexData(void* ptr_imgs, PTR_FLOAT ptr_z) {
+	return cGT_setImagesComplexData(ptr_imgs, ptr_z);
+}
 EXPORTED_FUNCTION 	void* mGT_dataItems(const void* ptr_x) {
 	return cGT_dataItems(ptr_x);
 }
@@ -47,6 +47,7 @@ EXPORTED_FUNCTION 	void* mGT_setCSMs(void* ptr_am, const void* ptr_csms);
 EXPORTED_FUNCTION 	void* mGT_AcquisitionModelForward(void* ptr_am, const void* ptr_imgs);
 EXPORTED_FUNCTION 	void* mGT_AcquisitionModelBackward(void* ptr_am, const void* ptr_acqs);
 EXPORTED_FUNCTION 	void* mGT_setAcquisitionsStorageScheme(const char* scheme);
+EXPORTED_FUNCTION 	void* mGT_setImagesStorageScheme(const char* scheme);
 EXPORTED_FUNCTION 	void* mGT_ISMRMRDAcquisitionsFromFile(const char* file);
 EXPORTED_FUNCTION 	void* mGT_ISMRMRDAcquisitionsFile(const char* file);
 EXPORTED_FUNCTION 	void* mGT_processAcquisitions(void* ptr_proc, void* ptr_input);
@@ -54,17 +55,24 @@ EXPORTED_FUNCTION 	void* mGT_acquisitionFromContainer(void* ptr_acqs, unsigned i
 EXPORTED_FUNCTION 	void* mGT_orderAcquisitions(void* ptr_acqs);
 EXPORTED_FUNCTION 	void* mGT_getAcquisitionsDimensions(void* ptr_acqs, PTR_INT ptr_dim);
 EXPORTED_FUNCTION 	void* mGT_getAcquisitionsFlags(void* ptr_acqs, unsigned int n, PTR_INT ptr_f);
+EXPORTED_FUNCTION 	void* mGT_getAcquisitionsHeaders(void* ptr_acqs, PTR_INT ptr_h);
+EXPORTED_FUNCTION 	void* mGT_setAcquisitionsHeaders(void* ptr_acqs, PTR_INT ptr_h);
 EXPORTED_FUNCTION 	void* mGT_getAcquisitionsData (void* ptr_acqs, unsigned int slice, PTR_FLOAT ptr_re, PTR_FLOAT ptr_im);
 EXPORTED_FUNCTION 	void* mGT_setAcquisitionsData (void* ptr_acqs, unsigned int na, unsigned int nc, unsigned int ns, PTR_FLOAT ptr_re, PTR_FLOAT ptr_im);
+EXPORTED_FUNCTION 	void* mGT_getAcquisitionsComplexData (void* ptr_acqs, unsigned int slice, PTR_FLOAT ptr_z);
+EXPORTED_FUNCTION 	void* mGT_setAcquisitionsComplexData (void* ptr_acqs, unsigned int na, unsigned int nc, unsigned int ns, PTR_FLOAT ptr_z);
 EXPORTED_FUNCTION 	void* mGT_reconstructImages(void* ptr_recon, void* ptr_input);
 EXPORTED_FUNCTION 	void* mGT_reconstructedImages(void* ptr_recon);
 EXPORTED_FUNCTION 	void* mGT_processImages(void* ptr_proc, void* ptr_input);
 EXPORTED_FUNCTION 	void* mGT_selectImages(void* ptr_input, const char* attr, const char* target);
 EXPORTED_FUNCTION 	void* mGT_imagesCopy(const void* ptr_imgs);
 EXPORTED_FUNCTION 	void* mGT_writeImages (void* ptr_imgs, const char* out_file, const char* out_group);
+EXPORTED_FUNCTION 	void* mGT_writeImagesAsync(void* ptr_imgs,  const char* out_file, const char* out_group, int batch_size);
+EXPORTED_FUNCTION 	void* mGT_waitForImagesWriter(void* ptr_w);
 EXPORTED_FUNCTION 	void* mGT_imageWrapFromContainer(void* ptr_imgs, unsigned int img_num);
 EXPORTED_FUNCTION 	void* mGT_imageTypes(const void* ptr_x);
 EXPORTED_FUNCTION 	void* mGT_imageDataType(const void* ptr_x, int im_num);
+EXPORTED_FUNCTION 	void* mGT_getImagesHeaders(void* ptr_imgs, PTR_INT ptr_h);
 EXPORTED_FUNCTION 	void mGT_getCoilDataDimensions(void* ptr_csms, int csm_num, PTR_INT ptr_dim);
 EXPORTED_FUNCTION 	void mGT_getCoilData (void* ptr_csms, int csm_num, PTR_FLOAT ptr_re, PTR_FLOAT ptr_im);
 EXPORTED_FUNCTION 	void mGT_getCoilDataAbs(void* ptr_csms, int csm_num, PTR_FLOAT ptr);
@@ -72,6 +80,8 @@ EXPORTED_FUNCTION 	void mGT_getImageDimensions(void* ptr_imgs, int img_num, PTR_
 EXPORTED_FUNCTION 	void mGT_getImagesDataAsFloatArray(void* ptr_imgs, PTR_FLOAT ptr_data);
 EXPORTED_FUNCTION 	void mGT_getImagesDataAsComplexArray (void* ptr_imgs, PTR_FLOAT ptr_re, PTR_FLOAT ptr_im);
 EXPORTED_FUNCTION 	void* mGT_setComplexImagesData(void* ptr_imgs, PTR_FLOAT ptr_re, PTR_FLOAT ptr_im);
+EXPORTED_FUNCTION 	void* mGT_getImagesComplexData(void* ptr_imgs, PTR_FLOAT ptr_z);
+EXPORTED_FUNCTION 	void* mGT_setImagesComplexData(void* ptr_imgs, PTR_FLOAT ptr_z);
 EXPORTED_FUNCTION 	void* mGT_dataItems(const void* ptr_x);
 EXPORTED_FUNCTION 	void* mGT_norm(const void* ptr_x);
 EXPORTED_FUNCTION 	void* mGT_dot(const void* ptr_x, const void* ptr_y);
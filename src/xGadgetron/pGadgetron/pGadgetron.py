@@ -75,12 +75,22 @@ def _set_int_par(handle, set, par, value):
     h = pyiutil.intDataHandle(value)
     _setParameter(handle, set, par, h)
     pyiutil.deleteDataHandle(h)
+def _set_char_par(handle, set, par, value):
+    h = pyiutil.charDataHandle(value)
+    _setParameter(handle, set, par, h)
+    pyiutil.deleteDataHandle(h)
 def _int_par(handle, set, par):
     h = pygadgetron.cGT_parameter(handle, set, par)
     check_status(h)
     value = pyiutil.intDataFromHandle(h)
     pyiutil.deleteDataHandle(h)
     return value
+def _double_par(handle, set, par):
+    h = pygadgetron.cGT_parameter(handle, set, par)
+    check_status(h)
+    value = pyiutil.doubleDataFromHandle(h)
+    pyiutil.deleteDataHandle(h)
+    return value
 def _char_par(handle, set, par):
     h = pygadgetron.cGT_parameter(handle, set, par)
     check_status(h)
@@ -485,6 +495,15 @@ class ImageData(DataContainer):
     def __del__(self):
         if self.handle is not None:
             pyiutil.deleteDataHandle(self.handle)
+    @staticmethod
+    def set_storage_scheme(scheme):
+        '''
+        Sets the storage of images created from now on: 'block' keeps the 
+        pixel values of all images in one contiguous array (all images must 
+        then have the same dimensions), anything else keeps each image 
+        separately (default).
+        '''
+        try_calling(pygadgetron.cGT_setImagesStorageScheme(scheme))
     def same_object(self):
         return ImageData()
     def data_type(self, im_num):
@@ -498,6 +517,20 @@ class ImageData(DataContainer):
         n = pyiutil.intDataFromHandle(handle)
         pyiutil.deleteDataHandle(handle)
         return n
+    def get_headers(self):
+        '''
+        Returns the headers of all images as a numpy structured array of
+        dtype ISMRMRD_IMAGE_HEADER (one item per image).
+        '''
+        assert self.handle is not None
+        assert ISMRMRD_IMAGE_HEADER.itemsize == 198
+        ni = self.number()
+        headers = numpy.empty((ni,), dtype = ISMRMRD_IMAGE_HEADER)
+        handle = pygadgetron.cGT_getImagesHeaders\
+            (self.handle, headers.ctypes.data)
+        check_status(handle)
+        pyiutil.deleteDataHandle(handle)
+        return headers
     def is_real(self):
         assert self.handle is not None
         t = self.data_type(0)
@@ -553,15 +586,27 @@ class ImageData(DataContainer):
             pylab.imshow(data[i - 1, :, :])
             print('Close Figure %d window to continue...' % i)
             pylab.show()
-    def write(self, out_file, out_group):
+    def write(self, out_file, out_group, wait = True, batch_size = 16):
         '''
         Writes self's images to an hdf5 file.
-        out_file : the file name (Python string)
-        out_group: hdf5 dataset name (Python string)
+        out_file  : the file name (Python string)
+        out_group : hdf5 dataset name (Python string)
+        wait      : if False, the images are written on a background thread,
+                    and an ImagesWriter object is returned that can be used
+                    to wait for the writing to finish
+        batch_size: number of images appended to the file at a time when
+                    writing in background
         '''
         assert self.handle is not None
-        try_calling(pygadgetron.cGT_writeImages\
-                    (self.handle, out_file, out_group))
+        if wait:
+            try_calling(pygadgetron.cGT_writeImages\
+                        (self.handle, out_file, out_group))
+            return None
+        writer = ImagesWriter()
+        writer.handle = pygadgetron.cGT_writeImagesAsync\
+            (self.handle, out_file, out_group, batch_size)
+        check_status(writer.handle)
+        return writer
     def select(self, attr, value):
         '''
         Creates an images container with images from self with the specified
@@ -595,24 +640,114 @@ class ImageData(DataContainer):
                 (self.handle, array.ctypes.data)
             return array
         else:
-            re = numpy.ndarray((nz, ny, nx), dtype = numpy.float32)
-            im = numpy.ndarray((nz, ny, nx), dtype = numpy.float32)
-            pygadgetron.cGT_getImagesDataAsComplexArray\
-                (self.handle, re.ctypes.data, im.ctypes.data)
-            return re + 1j*im
+            array = numpy.ndarray((nz, ny, nx), dtype = numpy.complex64)
+            try_calling(pygadgetron.cGT_getImagesComplexData\
+                (self.handle, array.ctypes.data))
+            return array
     def fill(self, data):
         '''
         Fills self's image data with specified values.
         data: Python Numpy array
         '''
         assert self.handle is not None
-        re = numpy.real(data).astype(numpy.float32)
-        im = numpy.imag(data).astype(numpy.float32)
-        try_calling(pygadgetron.cGT_setComplexImagesData\
-            (self.handle, re.ctypes.data, im.ctypes.data))
+        z = numpy.ascontiguousarray(data, dtype = numpy.complex64)
+        try_calling(pygadgetron.cGT_setImagesComplexData\
+            (self.handle, z.ctypes.data))
 
 DataContainer.register(ImageData)
 
+class ImagesWriter:
+    '''
+    Class for writing images to an hdf5 file on a background thread
+    (see ImageData.write).
+    '''
+    def __init__(self):
+        self.handle = None
+    def __del__(self):
+        if self.handle is not None:
+            pyiutil.deleteDataHandle(self.handle)
+    def done(self):
+        '''
+        Returns True if the writing has finished.
+        '''
+        assert self.handle is not None
+        return _int_par(self.handle, 'images_writer', 'done') != 0
+    def wait(self):
+        '''
+        Waits for the writing to finish, raising error if it failed.
+        '''
+        assert self.handle is not None
+        try_calling(pygadgetron.cGT_waitForImagesWriter(self.handle))
+
+# numpy counterpart of ISMRMRD::EncodingCounters
+ISMRMRD_ENCODING_COUNTERS = numpy.dtype([
+    ('kspace_encode_step_1', numpy.uint16),
+    ('kspace_encode_step_2', numpy.uint16),
+    ('average', numpy.uint16),
+    ('slice', numpy.uint16),
+    ('contrast', numpy.uint16),
+    ('phase', numpy.uint16),
+    ('repetition', numpy.uint16),
+    ('set', numpy.uint16),
+    ('segment', numpy.uint16),
+    ('user', numpy.uint16, (8,))])
+
+# numpy counterpart of (packed) ISMRMRD::AcquisitionHeader
+ISMRMRD_ACQUISITION_HEADER = numpy.dtype([
+    ('version', numpy.uint16),
+    ('flags', numpy.uint64),
+    ('measurement_uid', numpy.uint32),
+    ('scan_counter', numpy.uint32),
+    ('acquisition_time_stamp', numpy.uint32),
+    ('physiology_time_stamp', numpy.uint32, (3,)),
+    ('number_of_samples', numpy.uint16),
+    ('available_channels', numpy.uint16),
+    ('active_channels', numpy.uint16),
+    ('channel_mask', numpy.uint64, (16,)),
+    ('discard_pre', numpy.uint16),
+    ('discard_post', numpy.uint16),
+    ('center_sample', numpy.uint16),
+    ('encoding_space_ref', numpy.uint16),
+    ('trajectory_dimensions', numpy.uint16),
+    ('sample_time_us', numpy.float32),
+    ('position', numpy.float32, (3,)),
+    ('read_dir', numpy.float32, (3,)),
+    ('phase_dir', numpy.float32, (3,)),
+    ('slice_dir', numpy.float32, (3,)),
+    ('patient_table_position', numpy.float32, (3,)),
+    ('idx', ISMRMRD_ENCODING_COUNTERS),
+    ('user_int', numpy.int32, (8,)),
+    ('user_float', numpy.float32, (8,))])
+
+# numpy counterpart of (packed) ISMRMRD::ImageHeader
+ISMRMRD_IMAGE_HEADER = numpy.dtype([
+    ('version', numpy.uint16),
+    ('data_type', numpy.uint16),
+    ('flags', numpy.uint64),
+    ('measurement_uid', numpy.uint32),
+    ('matrix_size', numpy.uint16, (3,)),
+    ('field_of_view', numpy.float32, (3,)),
+    ('channels', numpy.uint16),
+    ('position', numpy.float32, (3,)),
+    ('read_dir', numpy.float32, (3,)),
+    ('phase_dir', numpy.float32, (3,)),
+    ('slice_dir', numpy.float32, (3,)),
+    ('patient_table_position', numpy.float32, (3,)),
+    ('average', numpy.uint16),
+    ('slice', numpy.uint16),
+    ('contrast', numpy.uint16),
+    ('phase', numpy.uint16),
+    ('repetition', numpy.uint16),
+    ('set', numpy.uint16),
+    ('acquisition_time_stamp', numpy.uint32),
+    ('physiology_time_stamp', numpy.uint32, (3,)),
+    ('image_type', numpy.uint16),
+    ('image_index', numpy.uint16),
+    ('image_series_index', numpy.uint16),
+    ('user_int', numpy.int32, (8,)),
+    ('user_float', numpy.float32, (8,)),
+    ('attribute_string_len', numpy.uint32)])
+
 class AcquisitionInfo:
     '''
     Class for acquisition information parameters.
@@ -749,49 +884,55 @@ class AcquisitionData(DataContainer):
         else:
             dim[2] = numpy.prod(dim[2:])
         return tuple(dim[2::-1])
-    def set_info(self):
+    def get_headers(self):
         '''
-        Fills the array self.info with information for each acquisition.
+        Returns the headers of all acquisitions as a numpy structured array
+        of dtype ISMRMRD_ACQUISITION_HEADER (one item per acquisition).
+        '''
+        assert self.handle is not None
+        assert ISMRMRD_ACQUISITION_HEADER.itemsize == 340
+        na = self.number()
+        headers = numpy.empty((na,), dtype = ISMRMRD_ACQUISITION_HEADER)
+        handle = pygadgetron.cGT_getAcquisitionsHeaders\
+            (self.handle, headers.ctypes.data)
+        check_status(handle)
+        pyiutil.deleteDataHandle(handle)
+        return headers
+    def set_headers(self, headers):
+        '''
+        Replaces the headers of all acquisitions with those in a numpy
+        structured array of dtype ISMRMRD_ACQUISITION_HEADER, e.g. one
+        returned by get_headers() and modified.
+        '''
+        assert self.handle is not None
+        h = numpy.ascontiguousarray(headers, \
+            dtype = ISMRMRD_ACQUISITION_HEADER)
+        if h.shape != (self.number(),):
+            raise error('wrong number of acquisition headers')
+        try_calling(pygadgetron.cGT_setAcquisitionsHeaders\
+            (self.handle, h.ctypes.data))
+        self.info = None
+        '''
+        Fills the structured array self.info with the headers of acquisitions.
         '''
         na, nc, ns = self.dimensions()
-        self.info = numpy.empty((na,), dtype = object)
-        for a in range(na):
-            acq = self.acquisition(a)
-            info = AcquisitionInfo()
-            info.flags = acq.flags()
-            info.encode_step_1 = acq.idx_kspace_encode_step_1()
-            info.slice = acq.idx_slice()
-            info.repetition = acq.idx_repetition()
-            self.info[a] = info
+        self.info = self.get_headers()[:na]
     def get_info(self, par):
         '''
         Returns the array of values of the specified acquisition information 
         parameter.
         par: parameter name
         '''
-        na, nc, ns = self.dimensions()
         if self.info is None:
             self.set_info()
         if par == 'flags':
-            flags = numpy.empty((na,), dtype = numpy.int64)
-            for a in range(na):
-                flags[a] = self.info[a].flags
-            return flags
+            return self.info['flags'].astype(numpy.int64)
         elif par == 'encode_step_1':
-            es1 = numpy.empty((na,), dtype = numpy.int32)
-            for a in range(na):
-                es1[a] = self.info[a].encode_step_1
-            return es1
+            return self.info['idx']['kspace_encode_step_1'].astype(numpy.int32)
         elif par == 'slice':
-            s = numpy.empty((na,), dtype = numpy.int32)
-            for a in range(na):
-                s[a] = self.info[a].slice
-            return s
+            return self.info['idx']['slice'].astype(numpy.int32)
         elif par == 'repetition':
-            r = numpy.empty((na,), dtype = numpy.int32)
-            for a in range(na):
-                r[a] = self.info[a].repetition
-            return r
+            return self.info['idx']['repetition'].astype(numpy.int32)
         else:
             raise error('unknown acquisition parameter ' + par)
     def as_array(self, select = 'image'):
@@ -805,12 +946,12 @@ class AcquisitionData(DataContainer):
             n = na
         else: # return only image-related
             n = na + 1
-        re = numpy.ndarray((ny, nc, ns), dtype = numpy.float32)
-        im = numpy.ndarray((ny, nc, ns), dtype = numpy.float32)
-        hv = pygadgetron.cGT_getAcquisitionsData\
-            (self.handle, n, re.ctypes.data, im.ctypes.data)
+        z = numpy.ndarray((ny, nc, ns), dtype = numpy.complex64)
+        hv = pygadgetron.cGT_getAcquisitionsComplexData\
+            (self.handle, n, z.ctypes.data)
+        check_status(hv)
         pyiutil.deleteDataHandle(hv)
-        return re + 1j*im
+        return z
     def fill(self, data):
         '''
         Fills self's acquisitions with specified values.
@@ -818,10 +959,10 @@ class AcquisitionData(DataContainer):
         '''
         assert self.handle is not None
         na, nc, ns = data.shape
-        re = numpy.real(data).astype(numpy.float32)
-        im = numpy.imag(data).astype(numpy.float32)
-        try_calling(pygadgetron.cGT_setAcquisitionsData\
-            (self.handle, na, nc, ns, re.ctypes.data, im.ctypes.data))
+        # no copy if data is already a C-contiguous complex64 array
+        z = numpy.ascontiguousarray(data, dtype = numpy.complex64)
+        try_calling(pygadgetron.cGT_setAcquisitionsComplexData\
+            (self.handle, na, nc, ns, z.ctypes.data))
 
 DataContainer.register(AcquisitionData)
 
@@ -917,6 +1058,61 @@ class Gadget:
         '''
         return _char_par(self.handle, 'gadget', prop)
 
+class SessionStatistics:
+    '''
+    Class for client-server communication statistics of the last run of a
+    gadget chain (summed over concurrent sessions if sharded):
+    connect_time        : time taken to connect to the server
+    config_time         : time taken to send the chain configuration
+    bytes_sent, bytes_received      : data volumes
+    messages_sent, messages_received: message counts
+    first_result_latency: time from connection to the first result
+    last_result_latency : time from connection to the last result
+                          (negative if there have been no results)
+    write_blocked_time  : time spent waiting for the server to take data
+    read_blocked_time   : time spent waiting for the server to finish
+    All times are in seconds.
+    '''
+    fields = ('connect_time', 'config_time', \
+              'bytes_sent', 'bytes_received', \
+              'messages_sent', 'messages_received', \
+              'first_result_latency', 'last_result_latency', \
+              'write_blocked_time', 'read_blocked_time')
+    def __init__(self, handle):
+        for field in SessionStatistics.fields:
+            setattr(self, field, _double_par(handle, 'session', field))
+        for field in ('bytes_sent', 'bytes_received', \
+                      'messages_sent', 'messages_received'):
+            setattr(self, field, int(getattr(self, field)))
+    def __str__(self):
+        return '\n'.join('%s: %s' % (field, getattr(self, field)) \
+                         for field in SessionStatistics.fields)
+
+class StreamingStatistics:
+    '''
+    Class for statistics of the last acquisitions upload to the server by
+    a gadget chain (summed over concurrent uploads if sharded):
+    acquisitions, batches: numbers of acquisitions and batches sent
+    max_queue_depth     : maximal number of batches read ahead
+    mean_queue_depth    : mean number of batches read ahead
+    reader_stalls       : times reading waited for sending (queue full)
+    sender_stalls       : times sending waited for reading (queue empty)
+    reader_stall_time, sender_stall_time: times spent waiting (seconds)
+    '''
+    fields = ('acquisitions', 'batches', \
+              'max_queue_depth', 'mean_queue_depth', \
+              'reader_stalls', 'sender_stalls', \
+              'reader_stall_time', 'sender_stall_time')
+    def __init__(self, handle):
+        for field in StreamingStatistics.fields:
+            setattr(self, field, _double_par(handle, 'streaming', field))
+        for field in ('acquisitions', 'batches', 'max_queue_depth', \
+                      'reader_stalls', 'sender_stalls'):
+            setattr(self, field, int(getattr(self, field)))
+    def __str__(self):
+        return '\n'.join('%s: %s' % (field, getattr(self, field)) \
+                         for field in StreamingStatistics.fields)
+
 class GadgetChain:
     '''
     Class for Gadgetron chains.
@@ -979,6 +1175,24 @@ class GadgetChain:
         pyiutil.deleteDataHandle(hg)
         pyiutil.deleteDataHandle(hv)
         return value
+    def set_native(self, native):
+        '''
+        Enables (native = True) or disables (native = False, the default)
+        running the chain in-process, without Gadgetron server, when all
+        its gadgets have native implementations, which are yet to be
+        validated against Gadgetron.
+        '''
+        _set_int_par(self.handle, 'gadget_chain', 'native', int(native))
+    def session_statistics(self):
+        '''
+        Returns SessionStatistics of the last processing by this chain.
+        '''
+        return SessionStatistics(self.handle)
+    def streaming_statistics(self):
+        '''
+        Returns StreamingStatistics of the last processing by this chain.
+        '''
+        return StreamingStatistics(self.handle)
 
 class Reconstructor(GadgetChain):
     '''
@@ -1005,6 +1219,49 @@ class Reconstructor(GadgetChain):
         '''
         assert isinstance(input_data, AcquisitionData)
         self.input_data = input_data
+    def set_endpoints(self, endpoints):
+        '''
+        Sets Gadgetron servers to use.
+        endpoints: a list of 'host[:port]' strings or a comma-separated
+                   string of them; the same server may be listed more
+                   than once to have several concurrent connections to it
+        '''
+        if not isinstance(endpoints, str):
+            endpoints = ','.join(endpoints)
+        _set_char_par(self.handle, 'reconstructor', 'endpoints', endpoints)
+    def set_sharding(self, field):
+        '''
+        Makes reconstruction split acquisitions by the specified index
+        field and reconstruct the parts concurrently on the servers set by
+        set_endpoints, merging the results in the order of the field.
+        field: 'slice', 'repetition' or 'none' (no splitting)
+        '''
+        _set_char_par(self.handle, 'reconstructor', 'shard_by', field)
+    def set_preprocessor(self, processor, return_acquisitions = False):
+        '''
+        Makes the reconstruction start with the gadgets of the specified
+        acquisition processor, so that raw data are processed and
+        reconstructed in one go and sent to Gadgetron only once.
+        processor          : AcquisitionDataProcessor
+        return_acquisitions: if True, the processed acquisitions are kept
+                             and returned by get_processed_acquisitions()
+                             (takes a separate processing session unless
+                             the chain runs in-process)
+        '''
+        assert isinstance(processor, AcquisitionDataProcessor)
+        _setParameter(self.handle, 'reconstructor', 'preprocessor', \
+            processor.handle)
+        _set_int_par(self.handle, 'reconstructor', 'return_acquisitions', \
+            int(return_acquisitions))
+    def get_processed_acquisitions(self):
+        '''
+        Returns AcquisitionData processed by the preprocessor in the last
+        reconstruction (see set_preprocessor).
+        '''
+        acquisitions = AcquisitionData()
+        acquisitions.handle = _parameterHandle\
+            (self.handle, 'reconstructor', 'processed_acquisitions')
+        return acquisitions
     def process(self):
         '''
         Processes the input with the gadget chain.
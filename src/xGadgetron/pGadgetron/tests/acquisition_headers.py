@@ -0,0 +1,121 @@
+'''
+Acquisition headers export and import tests
+'''
+
+## CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+## Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+##
+## This is software developed for the Collaborative Computational
+## Project in Positron Emission Tomography and Magnetic Resonance imaging
+## (http://www.ccppetmr.ac.uk/).
+##
+## Licensed under the Apache License, Version 2.0 (the "License");
+##   you may not use this file except in compliance with the License.
+##   You may obtain a copy of the License at
+##       http://www.apache.org/licenses/LICENSE-2.0
+##   Unless required by applicable law or agreed to in writing, software
+##   distributed under the License is distributed on an "AS IS" BASIS,
+##   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+##   See the License for the specific language governing permissions and
+##   limitations under the License.
+
+from pGadgetron import *
+
+def test_failed(ntest, expected, actual, abstol, reltol):
+    if abs(expected - actual) < abstol + reltol*expected:
+        print('+++ test %d passed' % ntest)
+        return 0
+    else:
+        print('+++ test %d failed' % ntest)
+        return 1
+
+# copy of acquisition data made in-process, stored as set by
+# AcquisitionData.set_storage_scheme
+def copy_of(acq_data):
+    ap = AcquisitionDataProcessor()
+    ap.set_native(True)
+    return ap.process(acq_data)
+
+# number of acquisitions whose header fields read one by one differ from
+# those in the numpy headers
+def headers_mismatches(acq_data, headers):
+    mismatches = 0
+    for i in range(acq_data.number()):
+        acq = acq_data.acquisition(i)
+        h = headers[i]
+        if acq.flags() != h['flags'] or \
+           acq.get_number_of_samples() != h['number_of_samples'] or \
+           acq.active_channels() != h['active_channels'] or \
+           acq.trajectory_dimensions() != h['trajectory_dimensions'] or \
+           acq.idx_kspace_encode_step_1() != \
+           h['idx']['kspace_encode_step_1'] or \
+           acq.idx_slice() != h['idx']['slice'] or \
+           acq.idx_repetition() != h['idx']['repetition']:
+            mismatches += 1
+    return mismatches
+
+def main():
+
+    failed = 0
+    ntest = 0
+
+    data_path = mr_data_path()
+    input_data = AcquisitionData(data_path + '/simulated_MR_2D_cartesian.h5')
+
+    for scheme in ('memory', 'file'):
+        AcquisitionData.set_storage_scheme(scheme)
+        acq_data = copy_of(input_data)
+        na = acq_data.number()
+        data = acq_data.as_array('all')
+
+        # the numpy layout of the headers must match ISMRMRD's: fields
+        # before, in the middle of and after the arrays of the header agree
+        # with those read one acquisition at a time
+        headers = acq_data.get_headers()
+        ntest += 1
+        failed += test_failed(ntest, 0, headers_mismatches(acq_data, headers),\
+                              0.5, 0)
+
+        # headers set from numpy are read back unchanged, up to the last
+        # field, while the data stay the same
+        headers['idx']['slice'] = numpy.arange(na) % 3
+        headers['idx']['repetition'] = numpy.arange(na) % 2
+        headers['user_int'][:, 0] = numpy.arange(na)
+        headers['user_float'][:, 7] = numpy.arange(na)*0.5
+        acq_data.set_headers(headers)
+        new_headers = acq_data.get_headers()
+        ntest += 1
+        failed += test_failed(ntest, 1, \
+            int(new_headers.tobytes() == headers.tobytes()), 0.5, 0)
+        ntest += 1
+        failed += test_failed(ntest, 0, \
+            headers_mismatches(acq_data, new_headers), 0.5, 0)
+        ntest += 1
+        failed += test_failed(ntest, 0, \
+            abs(acq_data.as_array('all') - data).max(), 1e-30, 0)
+
+        # wrong number of headers is refused
+        ntest += 1
+        try:
+            acq_data.set_headers(headers[1:])
+            print('+++ test %d failed' % ntest)
+            failed += 1
+        except error:
+            print('+++ test %d passed' % ntest)
+
+    if failed == 0:
+        print('all tests passed')
+    else:
+        print('%d tests failed' % failed)
+    return failed
+
+try:
+    failed = main()
+    print('done')
+    if failed != 0:
+        sys.exit(failed)
+
+except error as err:
+    # display error information
+    print('??? %s' % err.value)
+    sys.exit(-1)
@@ -0,0 +1,112 @@
+'''
+Images storage tests: images stored in one block behave as images stored
+separately, and copies of images can be changed independently
+'''
+
+## CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+## Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+##
+## This is software developed for the Collaborative Computational
+## Project in Positron Emission Tomography and Magnetic Resonance imaging
+## (http://www.ccppetmr.ac.uk/).
+##
+## Licensed under the Apache License, Version 2.0 (the "License");
+##   you may not use this file except in compliance with the License.
+##   You may obtain a copy of the License at
+##       http://www.apache.org/licenses/LICENSE-2.0
+##   Unless required by applicable law or agreed to in writing, software
+##   distributed under the License is distributed on an "AS IS" BASIS,
+##   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+##   See the License for the specific language governing permissions and
+##   limitations under the License.
+
+from pGadgetron import *
+
+def test_failed(ntest, expected, actual, abstol, reltol):
+    if abs(expected - actual) < abstol + reltol*expected:
+        print('+++ test %d passed' % ntest)
+        return 0
+    else:
+        print('+++ test %d failed' % ntest)
+        return 1
+
+# maximal difference between two arrays relative to the largest value
+def rel_diff(u, v):
+    return abs(u - v).max()/max(abs(u).max(), abs(v).max(), 1e-30)
+
+# copy of images made in-process, stored as set by
+# ImageData.set_storage_scheme
+def copy_of(images):
+    ip = ImageDataProcessor()
+    ip.set_native(True)
+    return ip.process(images)
+
+def main():
+
+    failed = 0
+    eps = 1e-5
+    ntest = 0
+
+    data_path = mr_data_path()
+    acq_data = AcquisitionData(data_path + '/simulated_MR_2D_cartesian.h5')
+    recon = FullySampledReconstructor()
+    recon.set_input(acq_data)
+    recon.process()
+    images = recon.get_output()
+    data = images.as_array()
+    numpy.random.seed(1)
+    other = numpy.random.randn(*data.shape) + 1j*numpy.random.randn(*data.shape)
+    a = 2 - 1j
+    b = 0.5 + 3j
+
+    results = {}
+    for scheme in ('memory', 'block'):
+        ImageData.set_storage_scheme(scheme)
+        x = copy_of(images)
+        y = copy_of(images)
+        # export of values copied in, import of new values
+        ntest += 1
+        failed += test_failed(ntest, 0, rel_diff(x.as_array(), data), eps, 0)
+        y.fill(other)
+        ntest += 1
+        failed += test_failed(ntest, 0, rel_diff(y.as_array(), other), eps, 0)
+        # changing a copy leaves the original unchanged
+        ntest += 1
+        failed += test_failed(ntest, 0, rel_diff(images.as_array(), data), \
+                              1e-30, 0)
+        z = x*a + y*b
+        ntest += 1
+        failed += test_failed(ntest, 0, \
+            rel_diff(z.as_array(), a*data + b*other), eps, 0)
+        ntest += 1
+        failed += test_failed(ntest, numpy.linalg.norm(data), x.norm(), \
+                              0, eps)
+        results[scheme] = (z.as_array(), x.dot(y), z.norm())
+    ImageData.set_storage_scheme('memory')
+
+    # bulk operations on blocks agree with those on separate images
+    z, dot, norm = results['memory']
+    z_block, dot_block, norm_block = results['block']
+    ntest += 1
+    failed += test_failed(ntest, 0, rel_diff(z_block, z), eps, 0)
+    ntest += 1
+    failed += test_failed(ntest, 0, abs(dot_block - dot), eps*abs(dot), 0)
+    ntest += 1
+    failed += test_failed(ntest, norm, norm_block, 0, eps)
+
+    if failed == 0:
+        print('all tests passed')
+    else:
+        print('%d tests failed' % failed)
+    return failed
+
+try:
+    failed = main()
+    print('done')
+    if failed != 0:
+        sys.exit(failed)
+
+except error as err:
+    # display error information
+    print('??? %s' % err.value)
+    sys.exit(-1)
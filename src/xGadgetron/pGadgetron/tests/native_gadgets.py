@@ -0,0 +1,203 @@
+'''
+Native gadgets tests: chains run in-process must give the same results
+as Gadgetron
+'''
+
+## CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+## Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+##
+## This is software developed for the Collaborative Computational
+## Project in Positron Emission Tomography and Magnetic Resonance imaging
+## (http://www.ccppetmr.ac.uk/).
+##
+## Licensed under the Apache License, Version 2.0 (the "License");
+##   you may not use this file except in compliance with the License.
+##   You may obtain a copy of the License at
+##       http://www.apache.org/licenses/LICENSE-2.0
+##   Unless required by applicable law or agreed to in writing, software
+##   distributed under the License is distributed on an "AS IS" BASIS,
+##   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+##   See the License for the specific language governing permissions and
+##   limitations under the License.
+
+from pGadgetron import *
+
+def test_failed(ntest, expected, actual, abstol, reltol):
+    if abs(expected - actual) < abstol + reltol*expected:
+        print('+++ test %d passed' % ntest)
+        return 0
+    else:
+        print('+++ test %d failed' % ntest)
+        return 1
+
+# maximal difference between two arrays relative to the largest value
+def rel_diff(u, v):
+    return abs(u - v).max()/max(abs(u).max(), abs(v).max(), 1e-30)
+
+# ISMRMRD_ACQ_IS_NOISE_MEASUREMENT flag bit
+ISMRMRD_ACQ_IS_NOISE_MEASUREMENT = 1 << 18
+
+# unitary Fourier transform with the origin in the middle of the array
+def centred_fft(u):
+    n = u.shape[-1]
+    return numpy.fft.fftshift(numpy.fft.fft(numpy.fft.ifftshift(u)))/n**0.5
+
+def process_acquisitions(acq_data, gadgets, native):
+    ap = AcquisitionDataProcessor(gadgets)
+    ap.set_native(native)
+    return ap.process(acq_data)
+
+def process_images(images, gadgets, native):
+    ip = ImageDataProcessor(gadgets)
+    ip.set_native(native)
+    return ip.process(images)
+
+def main():
+
+    failed = 0
+    eps = 1e-4
+    ntest = 0
+
+    data_path = mr_data_path()
+    acq_data = AcquisitionData(data_path + '/simulated_MR_2D_cartesian.h5')
+
+    # chains of gadgets with native implementations give the same output
+    # in-process as on the server
+    gadgets = ['RemoveROOversamplingGadget']
+    native = process_acquisitions(acq_data, gadgets, True)
+    server = process_acquisitions(acq_data, gadgets, False)
+    ntest += 1
+    failed += test_failed(ntest, 0, \
+        rel_diff(native.as_array(), server.as_array()), eps, 0)
+    ntest += 1
+    failed += test_failed(ntest, 0, \
+        abs(native.get_headers()['number_of_samples'].astype(numpy.int32) - \
+            server.get_headers()['number_of_samples']).max(), 0.5, 0)
+
+    recon = FullySampledReconstructor()
+    recon.set_input(server)
+    recon.process()
+    images = recon.get_output()
+    gadgets = ['ExtractGadget', 'FloatToShortGadget']
+    native = process_images(images, gadgets, True)
+    server = process_images(images, gadgets, False)
+    ntest += 1
+    failed += test_failed(ntest, images.number(), native.number(), 0.5, 0)
+    ntest += 1
+    failed += test_failed(ntest, 0, \
+        rel_diff(native.as_array(), server.as_array()), eps, 0)
+
+    # readout oversampling removal halves the numbers of samples, the centre
+    # sample and the samples to discard, and keeps intact a signal confined
+    # to the central half of the readout field of view
+    headers = acq_data.get_headers()
+    processed = process_acquisitions\
+        (acq_data, ['RemoveROOversamplingGadget'], True)
+    new_headers = processed.get_headers()
+    for field in ('number_of_samples', 'center_sample', \
+                  'discard_pre', 'discard_post'):
+        ntest += 1
+        failed += test_failed(ntest, 0, abs(headers[field]//2 - \
+            new_headers[field].astype(numpy.int32)).max(), 0.5, 0)
+    na, nc, ns = acq_data.dimensions()
+    ms = ns//2
+    width = ns/32.0
+    x = numpy.arange(ns) - ns//2
+    y = numpy.arange(ms) - ms//2
+    # Gaussians centred in image space in k-space
+    u = centred_fft(numpy.exp(-(x/width)**2))
+    v = centred_fft(numpy.exp(-(y/width)**2))
+    signal = process_acquisitions(acq_data, [], True)
+    signal.fill(numpy.tile(u, (na, nc, 1)))
+    processed = process_acquisitions\
+        (signal, ['RemoveROOversamplingGadget'], True)
+    ntest += 1
+    failed += test_failed(ntest, 0, \
+        rel_diff(processed.as_array(), numpy.tile(v, (na, nc, 1))), eps, 0)
+
+    # noise pre-whitening removes noise readouts and makes the coil noise
+    # covariance of other readouts with the same noise statistics a multiple
+    # of the identity
+    numpy.random.seed(1)
+    noisy = process_acquisitions(acq_data, [], True)
+    na = noisy.number()
+    nn = na//4
+    headers = noisy.get_headers()
+    nc = int(headers['active_channels'][0])
+    ns = int(headers['number_of_samples'][0])
+    mixing = numpy.eye(nc) + 0.3*(numpy.random.randn(nc, nc) + \
+                                  1j*numpy.random.randn(nc, nc))
+    noise = (numpy.random.randn(na, ns, nc) + \
+             1j*numpy.random.randn(na, ns, nc))/2**0.5
+    noisy.fill(numpy.dot(noise, mixing.T).transpose(0, 2, 1))
+    headers['flags'][:nn] = ISMRMRD_ACQ_IS_NOISE_MEASUREMENT
+    noisy.set_headers(headers)
+    whitened = process_acquisitions(noisy, ['NoiseAdjustGadget'], True)
+    ntest += 1
+    failed += test_failed(ntest, na - nn, whitened.number(), 0.5, 0)
+    data = whitened.as_array('all').transpose(1, 0, 2).reshape(nc, -1)
+    cov = numpy.dot(data, data.conj().T)/data.shape[1]
+    cov /= numpy.diag(cov).real.mean()
+    ntest += 1
+    failed += test_failed(ntest, 0, abs(cov - numpy.eye(nc)).max(), 0.05, 0)
+
+    # extraction gives the magnitude, real part, imaginary part and phase
+    # of each image in this order, in series offset by 0, 1000, 2000, 3000
+    parts = (abs, numpy.real, numpy.imag, numpy.angle)
+    cmplx = images.as_array()
+    series = images.get_headers()['image_series_index'].astype(numpy.int32)
+    ni = images.number()
+    extracted = process_images(images, ['ExtractGadget(extract_mask=15)'], \
+                               True)
+    ntest += 1
+    failed += test_failed(ntest, 4*ni, extracted.number(), 0.5, 0)
+    data = extracted.as_array()
+    new_series = extracted.get_headers()['image_series_index']
+    for t in range(4):
+        ntest += 1
+        failed += test_failed(ntest, 0, \
+            rel_diff(data[t::4], parts[t](cmplx)), eps, 0)
+        ntest += 1
+        failed += test_failed(ntest, 0, \
+            abs(new_series[t::4] - series - 1000*t).max(), 0.5, 0)
+
+    # conversion to unsigned short shifts all but magnitude images by the
+    # offset, maps phase from [-pi, pi] to [0, 2*offset], rounds and clamps
+    # to [min, max]
+    vmin = 10
+    vmax = 200
+    offset = 100
+    parts = extracted.as_array()
+    scale = numpy.ones((4, 1, 1, 1), dtype = numpy.float32)
+    shift = numpy.full((4, 1, 1, 1), offset, dtype = numpy.float32)
+    scale[3] = numpy.float32(offset/numpy.pi)
+    shift[0] = 0
+    expected = parts.reshape((ni, 4) + parts.shape[1:]).transpose(1, 0, 2, 3)
+    expected = numpy.floor(numpy.clip(expected*scale + shift + 0.5, \
+        vmin, vmax)).transpose(1, 0, 2, 3).reshape(parts.shape)
+    converted = process_images(extracted, ['FloatToShortGadget' + \
+        '(min_intensity=%d,max_intensity=%d,intensity_offset=%d)' % \
+        (vmin, vmax, offset)], True)
+    data = converted.as_array()
+    ntest += 1
+    failed += test_failed(ntest, 0, abs(data - expected).max(), 1.5, 0)
+    ntest += 1
+    failed += test_failed(ntest, 1, \
+        int(data.min() >= vmin and data.max() <= vmax), 0.5, 0)
+
+    if failed == 0:
+        print('all tests passed')
+    else:
+        print('%d tests failed' % failed)
+    return failed
+
+try:
+    failed = main()
+    print('done')
+    if failed != 0:
+        sys.exit(failed)
+
+except error as err:
+    # display error information
+    print('??? %s' % err.value)
+    sys.exit(-1)
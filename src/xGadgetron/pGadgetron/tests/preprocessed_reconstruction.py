@@ -0,0 +1,100 @@
+'''
+Reconstruction with preprocessing tests: preprocessing gadgets put in
+front of the reconstruction give the same results as a separate
+preprocessing
+'''
+
+## CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+## Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+##
+## This is software developed for the Collaborative Computational
+## Project in Positron Emission Tomography and Magnetic Resonance imaging
+## (http://www.ccppetmr.ac.uk/).
+##
+## Licensed under the Apache License, Version 2.0 (the "License");
+##   you may not use this file except in compliance with the License.
+##   You may obtain a copy of the License at
+##       http://www.apache.org/licenses/LICENSE-2.0
+##   Unless required by applicable law or agreed to in writing, software
+##   distributed under the License is distributed on an "AS IS" BASIS,
+##   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+##   See the License for the specific language governing permissions and
+##   limitations under the License.
+
+from pGadgetron import *
+
+def test_failed(ntest, expected, actual, abstol, reltol):
+    if abs(expected - actual) < abstol + reltol*expected:
+        print('+++ test %d passed' % ntest)
+        return 0
+    else:
+        print('+++ test %d failed' % ntest)
+        return 1
+
+# maximal difference between two arrays relative to the largest value
+def rel_diff(u, v):
+    return abs(u - v).max()/max(abs(u).max(), abs(v).max(), 1e-30)
+
+def reconstruct(acq_data, preprocessor = None, return_acquisitions = False):
+    recon = FullySampledReconstructor()
+    if preprocessor is not None:
+        recon.set_preprocessor(preprocessor, return_acquisitions)
+    recon.set_input(acq_data)
+    recon.process()
+    return recon
+
+def main():
+
+    failed = 0
+    eps = 1e-4
+    ntest = 0
+
+    data_path = mr_data_path()
+    acq_data = AcquisitionData(data_path + '/simulated_MR_2D_cartesian.h5')
+    gadgets = ['NoiseAdjustGadget', \
+               'AsymmetricEchoAdjustROGadget', \
+               'RemoveROOversamplingGadget']
+
+    # explicit chain: preprocessing followed by reconstruction of its output
+    processed = AcquisitionDataProcessor(gadgets).process(acq_data)
+    images = reconstruct(processed).get_output()
+
+    # preprocessing gadgets in front of the reconstruction gadgets
+    recon = reconstruct(acq_data, AcquisitionDataProcessor(gadgets))
+    prefixed = recon.get_output()
+    ntest += 1
+    failed += test_failed(ntest, images.number(), prefixed.number(), 0.5, 0)
+    ntest += 1
+    failed += test_failed(ntest, 0, \
+        rel_diff(images.as_array(), prefixed.as_array()), eps, 0)
+
+    # the same, keeping the preprocessed acquisitions
+    recon = reconstruct(acq_data, AcquisitionDataProcessor(gadgets), True)
+    prefixed = recon.get_output()
+    acquisitions = recon.get_processed_acquisitions()
+    ntest += 1
+    failed += test_failed(ntest, 0, \
+        rel_diff(images.as_array(), prefixed.as_array()), eps, 0)
+    ntest += 1
+    failed += test_failed(ntest, processed.number(), acquisitions.number(), \
+                          0.5, 0)
+    ntest += 1
+    failed += test_failed(ntest, 0, rel_diff(processed.as_array('all'), \
+        acquisitions.as_array('all')), eps, 0)
+
+    if failed == 0:
+        print('all tests passed')
+    else:
+        print('%d tests failed' % failed)
+    return failed
+
+try:
+    failed = main()
+    print('done')
+    if failed != 0:
+        sys.exit(failed)
+
+except error as err:
+    # display error information
+    print('??? %s' % err.value)
+    sys.exit(-1)
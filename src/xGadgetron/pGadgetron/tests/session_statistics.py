@@ -0,0 +1,120 @@
+'''
+Client-server session and acquisitions streaming statistics tests
+'''
+
+## CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+## Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+##
+## This is software developed for the Collaborative Computational
+## Project in Positron Emission Tomography and Magnetic Resonance imaging
+## (http://www.ccppetmr.ac.uk/).
+##
+## Licensed under the Apache License, Version 2.0 (the "License");
+##   you may not use this file except in compliance with the License.
+##   You may obtain a copy of the License at
+##       http://www.apache.org/licenses/LICENSE-2.0
+##   Unless required by applicable law or agreed to in writing, software
+##   distributed under the License is distributed on an "AS IS" BASIS,
+##   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+##   See the License for the specific language governing permissions and
+##   limitations under the License.
+
+from pGadgetron import *
+
+def test_failed(ntest, expected, actual, abstol, reltol):
+    if abs(expected - actual) < abstol + reltol*expected:
+        print('+++ test %d passed' % ntest)
+        return 0
+    else:
+        print('+++ test %d failed' % ntest)
+        return 1
+
+# number of violated conditions the statistics of any session must satisfy
+def session_inconsistencies(stats):
+    conditions = (
+        stats.connect_time >= 0,
+        stats.config_time >= 0,
+        stats.write_blocked_time >= 0,
+        stats.read_blocked_time >= 0,
+        stats.bytes_received >= 0,
+        0 <= stats.first_result_latency <= stats.last_result_latency)
+    return conditions.count(False)
+
+def main():
+
+    failed = 0
+    ntest = 0
+
+    data_path = mr_data_path()
+    acq_data = AcquisitionData(data_path + '/simulated_MR_2D_cartesian.h5')
+    na = acq_data.number()
+    # bytes of acquisition data (complex float samples)
+    data_bytes = acq_data.as_array('all').size*8
+
+    # every acquisition is sent, besides the configuration and parameters,
+    # and every processed acquisition is received
+    ap = AcquisitionDataProcessor(['RemoveROOversamplingGadget'])
+    processed = ap.process(acq_data)
+    stats = ap.session_statistics()
+    print(stats)
+    ntest += 1
+    failed += test_failed(ntest, 0, session_inconsistencies(stats), 0.5, 0)
+    ntest += 1
+    failed += test_failed(ntest, 1, int(stats.messages_sent > na), 0.5, 0)
+    ntest += 1
+    failed += test_failed(ntest, 1, int(stats.bytes_sent > data_bytes), \
+                          0.5, 0)
+    ntest += 1
+    failed += test_failed(ntest, processed.number(), \
+                          stats.messages_received, 0.5, 0)
+    ntest += 1
+    failed += test_failed(ntest, 1, \
+        int(stats.bytes_received > processed.as_array('all').size*8), 0.5, 0)
+
+    # acquisitions are streamed to the server in batches read ahead
+    stats = ap.streaming_statistics()
+    print(stats)
+    ntest += 1
+    failed += test_failed(ntest, na, stats.acquisitions, 0.5, 0)
+    ntest += 1
+    failed += test_failed(ntest, 1, \
+        int(1 <= stats.batches <= stats.acquisitions), 0.5, 0)
+    ntest += 1
+    failed += test_failed(ntest, 1, \
+        int(0 <= stats.mean_queue_depth <= stats.max_queue_depth), 0.5, 0)
+    ntest += 1
+    failed += test_failed(ntest, 1, int(stats.reader_stalls >= 0 and \
+        stats.sender_stalls >= 0 and stats.reader_stall_time >= 0 and \
+        stats.sender_stall_time >= 0), 0.5, 0)
+
+    # reconstruction receives one message per image
+    recon = FullySampledReconstructor()
+    recon.set_input(processed)
+    recon.process()
+    images = recon.get_output()
+    stats = recon.session_statistics()
+    ntest += 1
+    failed += test_failed(ntest, 0, session_inconsistencies(stats), 0.5, 0)
+    ntest += 1
+    failed += test_failed(ntest, images.number(), stats.messages_received, \
+                          0.5, 0)
+    ntest += 1
+    failed += test_failed(ntest, processed.number(), \
+        recon.streaming_statistics().acquisitions, 0.5, 0)
+
+    if failed == 0:
+        print('all tests passed')
+    else:
+        print('%d tests failed' % failed)
+    return failed
+
+try:
+    failed = main()
+    print('done')
+    if failed != 0:
+        sys.exit(failed)
+
+except error as err:
+    # display error information
+    print('??? %s' % err.value)
+    sys.exit(-1)
@@ -143,6 +143,8 @@ void* cSTIR_parameter(const void* ptr, const char* obj, const char* name)
 			(handle, name);
 		if (boost::iequals(obj, "RayTracingMatrix"))
 			return cSTIR_rayTracingMatrixParameter(handle, name);
+		else if (boost::iequals(obj, "AcquisitionModel"))
+			return cSTIR_acquisitionModelParameter(handle, name);
 		else if (boost::iequals(obj, "AcqModUsingMatrix"))
 			return cSTIR_acqModUsingMatrixParameter(handle, name);
 		if (boost::iequals(obj, "GeneralisedPrior"))
@@ -262,6 +264,8 @@ cSTIR_setAcquisitionsStorageScheme(const char* scheme)
 	try {
 		if (scheme[0] == 'f' || strcmp(scheme, "default") == 0)
 			PETAcquisitionDataInFile::set_as_template();
+		else if (boost::iequals(scheme, "mapped"))
+			PETAcquisitionDataInMappedFile::set_as_template();
 		else
 			PETAcquisitionDataInMemory::set_as_template();
 		return (void*)new DataHandle;
@@ -269,6 +273,33 @@ cSTIR_setAcquisitionsStorageScheme(const char* scheme)
 	CATCH;
 }
 
+extern "C"
+void* cSTIR_setAcquisitionsScratchDirectory(const char* dir)
+{
+	try {
+		PETAcquisitionDataInMappedFile::set_scratch_directory(dir);
+		return (void*)new DataHandle;
+	}
+	CATCH;
+}
+
+extern "C"
+void* cSTIR_setAcquisitionsStreamingBudget(int mbytes)
+{
+	try {
+		if (mbytes < 0) {
+			ExecutionStatus status("streaming budget must not be negative", 
+				__FILE__, __LINE__);
+			DataHandle* handle = new DataHandle;
+			handle->set(0, &status);
+			return (void*)handle;
+		}
+		PETAcquisitionData::set_streaming_budget(size_t(mbytes) << 20);
+		return (void*)new DataHandle;
+	}
+	CATCH;
+}
+
 extern "C"
 void* cSTIR_acquisitionsDataFromTemplate(void* ptr_t)
 {
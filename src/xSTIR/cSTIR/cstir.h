@@ -49,6 +49,8 @@ extern "C" {
 
 	// Acquisition data methods
 	void* cSTIR_setAcquisitionsStorageScheme(const char* scheme);
+	void* cSTIR_setAcquisitionsScratchDirectory(const char* dir);
+	void* cSTIR_setAcquisitionsStreamingBudget(int mbytes);
 	void* cSTIR_acquisitionsDataFromTemplate(void* ptr_t);
 	void* cSTIR_getAcquisitionsDimensions(const void* ptr_acq, PTR_INT ptr_dim);
 	void* cSTIR_getAcquisitionsData(const void* ptr_acq, PTR_FLOAT ptr_data);
@@ -170,9 +170,16 @@ cSTIR_setRayTracingMatrixParameter
 {
 	RayTracingMatrix& matrix = 
 		objectFromHandle<RayTracingMatrix>(hp);
-	int value = dataFromHandle<int>(hv);
 	if (boost::iequals(name, "num_tangential_LORs"))
-		matrix.set_num_tangential_LORs(value);
+		matrix.set_num_tangential_LORs(dataFromHandle<int>(hv));
+	else if (boost::iequals(name, "disk_cache_directory"))
+		matrix.set_disk_cache_directory(charDataFromDataHandle(hv));
+	else if (boost::iequals(name, "row_cache_budget")) {
+		int mbytes = dataFromHandle<int>(hv);
+		if (mbytes < 0)
+			return wrongIntParameterValue(name, mbytes, __FILE__, __LINE__);
+		matrix.set_row_cache_budget(size_t(mbytes) << 20);
+	}
 	else
 		return parameterNotFound(name, __FILE__, __LINE__);
 	return new DataHandle;
@@ -185,6 +192,24 @@ cSTIR_rayTracingMatrixParameter(const DataHandle* handle, const char* name)
 		objectFromHandle<RayTracingMatrix>(handle);
 	if (boost::iequals(name, "num_tangential_LORs"))
 		return dataHandle<int>(matrix.get_num_tangential_LORs());
+	if (boost::iequals(name, "disk_cache_directory"))
+		return charDataHandleFromCharData
+		(matrix.disk_cache_directory().c_str());
+	if (boost::iequals(name, "disk_cache_rows"))
+		return dataHandle<int>((int)matrix.disk_cache_rows());
+	const MatrixRowCache& cache = matrix.row_cache();
+	if (boost::iequals(name, "row_cache_budget"))
+		return dataHandle<int>((int)(cache.budget() >> 20));
+	if (boost::iequals(name, "row_cache_hits"))
+		return dataHandle<double>((double)cache.hits());
+	if (boost::iequals(name, "row_cache_misses"))
+		return dataHandle<double>((double)cache.misses());
+	if (boost::iequals(name, "row_cache_evictions"))
+		return dataHandle<double>((double)cache.evictions());
+	if (boost::iequals(name, "row_cache_rows"))
+		return dataHandle<int>((int)cache.rows());
+	if (boost::iequals(name, "row_cache_memory"))
+		return dataHandle<double>((double)cache.memory());
 	return parameterNotFound(name, __FILE__, __LINE__);
 }
 
@@ -201,11 +226,23 @@ cSTIR_setAcquisitionModelParameter
 		am.set_normalisation(objectSptrFromHandle<PETAcquisitionData>(hv));
 	else if (boost::iequals(name, "bin_efficiency"))
 		am.set_bin_efficiency(objectSptrFromHandle<PETAcquisitionData>(hv));
+	else if (boost::iequals(name, "num_threads"))
+		am.set_num_threads(dataFromHandle<int>(hv));
 	else
 		return parameterNotFound(name, __FILE__, __LINE__);
 	return new DataHandle;
 }
 
+void*
+cSTIR_acquisitionModelParameter(DataHandle* hp, const char* name)
+{
+	AcqMod3DF& am = objectFromHandle< AcqMod3DF >(hp);
+	if (boost::iequals(name, "num_threads"))
+		return dataHandle<int>(am.num_threads());
+	else
+		return parameterNotFound(name, __FILE__, __LINE__);
+}
+
 void*
 cSTIR_setAcqModUsingMatrixParameter
 (DataHandle* hm, const char* name, const DataHandle* hv)
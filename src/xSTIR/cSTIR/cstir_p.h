@@ -47,6 +47,9 @@ void*
 cSTIR_setAcquisitionModelParameter
 (DataHandle* hp, const char* name, const DataHandle* hv);
 
+void*
+cSTIR_acquisitionModelParameter(DataHandle* hp, const char* name);
+
 void*
 cSTIR_setAcqModUsingMatrixParameter
 (DataHandle* hp, const char* name, const DataHandle* hv);
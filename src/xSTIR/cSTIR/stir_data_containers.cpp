@@ -18,32 +18,479 @@ limitations under the License.
 
 */
 
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "stir_data_containers.h"
 
 using stir::shared_ptr;
 
 shared_ptr<PETAcquisitionData> PETAcquisitionData::_template;
+size_t PETAcquisitionData::_streaming_budget = size_t(512) << 20;
+
+static std::string
+default_scratch_directory_()
+{
+	const char* dir = getenv("TMPDIR");
+	if (dir && dir[0])
+		return dir;
+#ifdef _WIN32
+	return ".";
+#else
+	return "/tmp";
+#endif
+}
+
+std::string PETAcquisitionDataInMappedFile::_scratch_dir =
+	default_scratch_directory_();
+
+float*
+MappedFloatBlockStream::map_(size_t n, const std::string& dir)
+{
+#ifdef _WIN32
+	throw LocalisedException
+		("memory-mapped acquisition data not supported on this platform",
+		__FILE__, __LINE__);
+#else
+	// mkstemp() creates a file of a new unique name
+	std::string templ = dir + "/sirf_XXXXXX";
+	std::vector<char> filename(templ.begin(), templ.end());
+	filename.push_back(0);
+	int fd = mkstemp(&filename[0]);
+	if (fd < 0)
+		throw LocalisedException
+		(("cannot create scratch file in " + dir).c_str(),
+		__FILE__, __LINE__);
+	// no directory entry from now on: the system deletes the file when it is
+	// unmapped, whichever way the process terminates
+	unlink(&filename[0]);
+	size_t size = std::max(n, (size_t)1)*sizeof(float);
+	// disk blocks are reserved now, so that a full disk is reported here
+	// rather than by SIGBUS when a page is first written
+#ifdef __APPLE__
+	int err = ftruncate(fd, size) == 0 ? 0 : errno;
+#else
+	int err = posix_fallocate(fd, 0, size);
+#endif
+	if (err != 0) {
+		close(fd);
+		throw LocalisedException
+			(("cannot allocate scratch file in " + dir + ": " + 
+			strerror(err)).c_str(), __FILE__, __LINE__);
+	}
+	void* ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED)
+		throw LocalisedException("cannot map scratch file to memory",
+		__FILE__, __LINE__);
+	// segments and whole blocks are mostly traversed in order
+	madvise(ptr, size, MADV_SEQUENTIAL);
+	return (float*)ptr;
+#endif
+}
+
+MappedFloatBlockStream::~MappedFloatBlockStream()
+{
+#ifndef _WIN32
+	munmap(data(), std::max(size(), (size_t)1)*sizeof(float));
+#endif
+}
+
+/*
+threads kept for the parallel work of acquisition models and data
+containers; a call takes as many as it needs, the calling one included, 
+and more are started when a call needs more than there are
+*/
+class ThreadPool {
+public:
+	typedef std::function<void(int)> Task;
+
+	static ThreadPool& instance()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+	// runs task(0), ..., task(n - 1) and waits for all to finish
+	void run(int n, const Task& task)
+	{
+		std::shared_ptr<Job> job(new Job(n, task));
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			while ((int)threads_.size() < n - 1)
+				threads_.push_back
+				(std::thread(&ThreadPool::work_, this));
+			jobs_.push_back(job);
+		}
+		cv_.notify_all();
+		job->work();
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			std::deque<std::shared_ptr<Job> >::iterator it =
+				std::find(jobs_.begin(), jobs_.end(), job);
+			if (it != jobs_.end())
+				jobs_.erase(it);
+		}
+		job->wait();
+	}
+
+private:
+	struct Job {
+		Job(int n, const Task& task) :
+			task(task), n(n), next(0), done(0), errors(n)
+		{}
+		// runs the parts not yet taken by other threads
+		void work()
+		{
+			for (int i = next++; i < n; i = next++) {
+				try {
+					task(i);
+				}
+				catch (...) {
+					errors[i] = std::current_exception();
+				}
+				std::lock_guard<std::mutex> lock(mutex);
+				if (++done == n)
+					cv.notify_all();
+			}
+		}
+		// waits for all parts to finish, rethrows the first exception
+		void wait()
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cv.wait(lock, [this]() { return done == n; });
+			}
+			for (int i = 0; i < n; i++)
+				if (errors[i])
+					std::rethrow_exception(errors[i]);
+		}
+		Task task;
+		int n;
+		std::atomic<int> next;
+		int done;
+		std::vector<std::exception_ptr> errors;
+		std::mutex mutex;
+		std::condition_variable cv;
+	};
+
+	ThreadPool() : stop_(false) {}
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		cv_.notify_all();
+		for (size_t t = 0; t < threads_.size(); t++)
+			threads_[t].join();
+	}
+	void work_()
+	{
+		for (;;) {
+			std::shared_ptr<Job> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				cv_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+				if (stop_)
+					return;
+				job = jobs_.front();
+				if (job->next >= job->n) {
+					// all parts taken, the caller waits for them
+					jobs_.pop_front();
+					continue;
+				}
+			}
+			job->work();
+		}
+	}
+
+	std::vector<std::thread> threads_;
+	std::deque<std::shared_ptr<Job> > jobs_;
+	bool stop_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+};
+
+void
+SIRFUtilities::run_threads(int n, std::function<void(int)> work)
+{
+	if (n < 2)
+		work(0);
+	else
+		ThreadPool::instance().run(n, work);
+}
+
+// number of threads to share n values between
+static size_t
+num_threads_(size_t n)
+{
+	const size_t min_values_per_thread = 1 << 16;
+	size_t nt = std::thread::hardware_concurrency();
+	if (nt > n / min_values_per_thread)
+		nt = n / min_values_per_thread;
+	return nt < 1 ? 1 : nt;
+}
+
+// runs f on the ranges of a partition of [0, n) in parallel
+static void
+parallel_for_(size_t n, std::function<void(size_t, size_t)> f)
+{
+	size_t nt = num_threads_(n);
+	SIRFUtilities::run_threads((int)nt, [&](int t)
+	{
+		f(t*n / nt, (t + 1)*n / nt);
+	});
+}
+
+// sums the values of f on the ranges of a partition of [0, n) computed 
+// in parallel
+static double
+parallel_sum_(size_t n, std::function<double(size_t, size_t)> f)
+{
+	size_t nt = num_threads_(n);
+	std::vector<double> parts(nt);
+	SIRFUtilities::run_threads((int)nt, [&](int t)
+	{
+		parts[t] = f(t*n / nt, (t + 1)*n / nt);
+	});
+	double s = 0;
+	for (size_t t = 0; t < nt; t++)
+		s += parts[t];
+	return s;
+}
+
+/*
+performs the disk input/output of stream_segments() on one thread that 
+lives as long as the process, one task at a time in the order queued
+*/
+class SegmentsIO {
+public:
+	static SegmentsIO& instance()
+	{
+		static SegmentsIO io;
+		return io;
+	}
+	~SegmentsIO()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_cv.notify_one();
+		_thread.join();
+	}
+	// the future becomes ready (or rethrows the error task raised) 
+	// when task is done
+	std::shared_future<void> queue(std::function<void()> task)
+	{
+		std::shared_ptr<std::packaged_task<void()> > sptr_task
+			(new std::packaged_task<void()>(task));
+		std::shared_future<void> done = sptr_task->get_future().share();
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_tasks.push_back(sptr_task);
+		}
+		_cv.notify_one();
+		return done;
+	}
+private:
+	bool _stop;
+	std::deque<std::shared_ptr<std::packaged_task<void()> > > _tasks;
+	std::mutex _mutex;
+	std::condition_variable _cv;
+	// started last, when the above are ready
+	std::thread _thread;
+
+	SegmentsIO() : _stop(false), _thread(&SegmentsIO::run_, this) {}
+	void run_()
+	{
+		for (;;) {
+			std::shared_ptr<std::packaged_task<void()> > sptr_task;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_cv.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+				if (_tasks.empty())
+					return;
+				sptr_task = _tasks.front();
+				_tasks.pop_front();
+			}
+			(*sptr_task)();
+		}
+	}
+};
+
+// true if both data are blocks of the same layout, so that they can be
+// processed value by value
+static bool
+same_size_blocks_(const ProjDataInBlock* x, const ProjDataInBlock* y)
+{
+	return x && y && x->size() == y->size() &&
+		*x->get_proj_data_info_sptr() == *y->get_proj_data_info_sptr();
+}
+
+void
+PETAcquisitionData::stream_segments(PETAcquisitionData* ptr_out,
+	const std::vector<const PETAcquisitionData*>& in, SegmentsOperation f)
+{
+	// all segments shared by the output and input data, in the order 
+	// 0, 1, -1, 2, -2, ...
+	int n = ptr_out ? ptr_out->get_max_segment_num() : INT_MAX;
+	for (size_t i = 0; i < in.size(); i++)
+		n = std::min(n, in[i]->get_max_segment_num());
+	std::vector<int> segments;
+	for (int s = 0; s <= n; s++) {
+		segments.push_back(s);
+		if (s != 0)
+			segments.push_back(-s);
+	}
+	size_t nseg = segments.size();
+	if (nseg == 0)
+		return;
+
+	shared_ptr<ProjDataInfo> sptr_pdi =
+		(ptr_out ? ptr_out : in[0])->get_proj_data_info_sptr();
+	size_t nsets = in.size() + (ptr_out ? 1 : 0);
+	size_t sino_size = sizeof(float)*
+		sptr_pdi->get_num_views()*sptr_pdi->get_num_tangential_poss();
+	size_t budget = _streaming_budget;
+
+	// segments of all data for one segment number
+	struct Segments {
+		std::vector<SegmentBySinogram<float> > in;
+		std::shared_ptr<SegmentBySinogram<float> > out;
+		std::shared_future<void> io;
+		size_t bytes;
+	};
+
+	// disk input/output is done by one task at a time, in the order 
+	// the tasks are queued, so the last one queued is the last one done
+	std::shared_future<void> last_io;
+	auto queue_io = [&last_io](std::function<void()> task)
+	{
+		last_io = SegmentsIO::instance().queue(task);
+		return last_io;
+	};
+
+	std::deque<std::shared_ptr<Segments> > reads;
+	std::deque<std::shared_ptr<Segments> > writes;
+	// makes sure no input/output is under way when exiting on error
+	struct IOWaiter {
+		std::shared_future<void>& io;
+		~IOWaiter()
+		{
+			if (io.valid())
+				io.wait();
+		}
+	} io_waiter = { last_io };
+	size_t held = 0; // bytes of segments read or being read and not written
+	size_t next = 0; // next segment to read
+	auto read_next = [&]()
+	{
+		int s = segments[next++];
+		std::shared_ptr<Segments> sptr_segs(new Segments);
+		sptr_segs->bytes = nsets*sino_size*sptr_pdi->get_num_axial_poss(s);
+		held += sptr_segs->bytes;
+		Segments* ptr_segs = sptr_segs.get();
+		sptr_segs->io = queue_io([=]()
+		{
+			for (size_t i = 0; i < in.size(); i++)
+				ptr_segs->in.push_back(in[i]->get_segment_by_sinogram(s));
+			if (ptr_out)
+				ptr_segs->out.reset(new SegmentBySinogram<float>
+				(ptr_out->get_empty_segment_by_sinogram(s)));
+		});
+		reads.push_back(sptr_segs);
+	};
+	auto retire_write = [&]()
+	{
+		writes.front()->io.get();
+		held -= writes.front()->bytes;
+		writes.pop_front();
+	};
+
+	for (size_t i = 0; i < nseg; i++) {
+		if (next == i)
+			read_next();
+		std::shared_ptr<Segments> sptr_segs = reads.front();
+		reads.pop_front();
+		sptr_segs->io.get();
+
+		// prefetch the next segments while these are processed, 
+		// if the memory budget allows
+		while (!writes.empty() && writes.front()->io.wait_for
+			(std::chrono::seconds(0)) == std::future_status::ready)
+			retire_write();
+		if (next < nseg) {
+			size_t bytes = nsets*sino_size*
+				sptr_pdi->get_num_axial_poss(segments[next]);
+			while (!writes.empty() && held + bytes > budget)
+				retire_write();
+			if (held + bytes <= budget)
+				read_next();
+		}
+
+		f(sptr_segs->out.get(), sptr_segs->in);
+		sptr_segs->in.clear();
+
+		if (ptr_out) {
+			Segments* ptr_segs = sptr_segs.get();
+			sptr_segs->io = queue_io([=]()
+			{
+				ptr_out->set_segment(*ptr_segs->out);
+			});
+			writes.push_back(sptr_segs);
+		}
+		else
+			held -= sptr_segs->bytes;
+	}
+	while (!writes.empty())
+		retire_write();
+}
 
 float
 PETAcquisitionData::norm()
 {
+	ProjDataInBlock* ptr_block = data_block();
+	if (ptr_block) {
+		const float* u = ptr_block->get_data_ptr();
+		double t = parallel_sum_(ptr_block->size(), [u](size_t i0, size_t i1)
+		{
+			double t = 0.0;
+			for (size_t i = i0; i < i1; i++)
+				t += double(u[i])*u[i];
+			return t;
+		});
+		return sqrt((float)t);
+	}
+
 	double t = 0.0;
-	for (int s = 0; s <= get_max_segment_num(); ++s)
+	stream_segments(0, { this }, [&t](SegmentBySinogram<float>*,
+		std::vector<SegmentBySinogram<float> >& segs)
 	{
-		SegmentBySinogram<float> seg = get_segment_by_sinogram(s);
 		SegmentBySinogram<float>::full_iterator seg_iter;
-		for (seg_iter = seg.begin_all(); seg_iter != seg.end_all();) {
+		for (seg_iter = segs[0].begin_all(); seg_iter != segs[0].end_all();) {
 			double r = *seg_iter++;
 			t += r*r;
 		}
-		if (s != 0) {
-			seg = get_segment_by_sinogram(-s);
-			for (seg_iter = seg.begin_all(); seg_iter != seg.end_all();) {
-				double r = *seg_iter++;
-				t += r*r;
-			}
-		}
-	}
+	});
 	return sqrt((float)t);
 }
 
@@ -51,43 +498,56 @@ void
 PETAcquisitionData::mult(float a, const aDataContainer<float>& a_x)
 {
 	PETAcquisitionData& x = (PETAcquisitionData&)a_x;
-	int n = get_max_segment_num();
-	int nx = x.get_max_segment_num();
-	for (int s = 0; s <= n && s <= nx; ++s)
+	ProjDataInBlock* ptr_block = data_block();
+	ProjDataInBlock* ptr_block_x = x.data_block();
+	if (same_size_blocks_(ptr_block, ptr_block_x)) {
+		float* v = ptr_block->get_data_ptr();
+		const float* u = ptr_block_x->get_data_ptr();
+		parallel_for_(ptr_block->size(), [=](size_t i0, size_t i1)
+		{
+			for (size_t i = i0; i < i1; i++)
+				v[i] = float(a*double(u[i]));
+		});
+		return;
+	}
+	stream_segments(this, { &x }, [a](SegmentBySinogram<float>* seg,
+		std::vector<SegmentBySinogram<float> >& segs)
 	{
-		SegmentBySinogram<float> seg = get_empty_segment_by_sinogram(s);
-		SegmentBySinogram<float> sx = x.get_segment_by_sinogram(s);
+		SegmentBySinogram<float>& sx = segs[0];
 		SegmentBySinogram<float>::full_iterator seg_iter;
 		SegmentBySinogram<float>::full_iterator sx_iter;
-		for (seg_iter = seg.begin_all(), sx_iter = sx.begin_all();
-			seg_iter != seg.end_all() && sx_iter != sx.end_all();
+		for (seg_iter = seg->begin_all(), sx_iter = sx.begin_all();
+			seg_iter != seg->end_all() && sx_iter != sx.end_all();
 			/*empty*/) {
 			*seg_iter++ = float(a*double(*sx_iter++));
 		}
-		set_segment(seg);
-		if (s != 0) {
-			seg = get_empty_segment_by_sinogram(-s);
-			sx = x.get_segment_by_sinogram(-s);
-			for (seg_iter = seg.begin_all(), sx_iter = sx.begin_all();
-				seg_iter != seg.end_all() && sx_iter != sx.end_all();
-				/*empty*/)
-				*seg_iter++ = float(a*double(*sx_iter++));
-			set_segment(seg);
-		}
-	}
+	});
 }
 
 float
 PETAcquisitionData::dot(const aDataContainer<float>& a_x)
 {
 	PETAcquisitionData& x = (PETAcquisitionData&)a_x;
-	int n = get_max_segment_num();
-	int nx = x.get_max_segment_num();
+	ProjDataInBlock* ptr_block = data_block();
+	ProjDataInBlock* ptr_block_x = x.data_block();
+	if (same_size_blocks_(ptr_block, ptr_block_x)) {
+		const float* v = ptr_block->get_data_ptr();
+		const float* u = ptr_block_x->get_data_ptr();
+		double t = parallel_sum_(ptr_block->size(), [=](size_t i0, size_t i1)
+		{
+			double t = 0.0;
+			for (size_t i = i0; i < i1; i++)
+				t += v[i]*double(u[i]);
+			return t;
+		});
+		return (float)t;
+	}
 	double t = 0;
-	for (int s = 0; s <= n && s <= nx; ++s)
+	stream_segments(0, { this, &x }, [&t](SegmentBySinogram<float>*,
+		std::vector<SegmentBySinogram<float> >& segs)
 	{
-		SegmentBySinogram<float> seg = get_segment_by_sinogram(s);
-		SegmentBySinogram<float> sx = x.get_segment_by_sinogram(s);
+		SegmentBySinogram<float>& seg = segs[0];
+		SegmentBySinogram<float>& sx = segs[1];
 		SegmentBySinogram<float>::full_iterator seg_iter;
 		SegmentBySinogram<float>::full_iterator sx_iter;
 		for (seg_iter = seg.begin_all(), sx_iter = sx.begin_all();
@@ -95,15 +555,7 @@ PETAcquisitionData::dot(const aDataContainer<float>& a_x)
 			/*empty*/) {
 			t += (*seg_iter++)*double(*sx_iter++);
 		}
-		if (s != 0) {
-			seg = get_segment_by_sinogram(-s);
-			sx = x.get_segment_by_sinogram(-s);
-			for (seg_iter = seg.begin_all(), sx_iter = sx.begin_all();
-				seg_iter != seg.end_all() && sx_iter != sx.end_all();
-				/*empty*/)
-				t += (*seg_iter++)*double(*sx_iter++);
-		}
-	}
+	});
 	return (float)t;
 }
 
@@ -111,32 +563,29 @@ void
 PETAcquisitionData::inv(float amin, const aDataContainer<float>& a_x)
 {
 	PETAcquisitionData& x = (PETAcquisitionData&)a_x;
-	int n = get_max_segment_num();
-	int nx = x.get_max_segment_num();
-	for (int s = 0; s <= n && s <= nx; ++s)
+	ProjDataInBlock* ptr_block = data_block();
+	ProjDataInBlock* ptr_block_x = x.data_block();
+	if (same_size_blocks_(ptr_block, ptr_block_x)) {
+		float* v = ptr_block->get_data_ptr();
+		const float* u = ptr_block_x->get_data_ptr();
+		parallel_for_(ptr_block->size(), [=](size_t i0, size_t i1)
+		{
+			for (size_t i = i0; i < i1; i++)
+				v[i] = float(1.0 / std::max(amin, u[i]));
+		});
+		return;
+	}
+	stream_segments(this, { &x }, [amin](SegmentBySinogram<float>* seg,
+		std::vector<SegmentBySinogram<float> >& segs)
 	{
-		//std::cout << "processing segment " << s << std::endl;
-		SegmentBySinogram<float> seg = get_empty_segment_by_sinogram(s);
-		SegmentBySinogram<float> sx = x.get_segment_by_sinogram(s);
+		SegmentBySinogram<float>& sx = segs[0];
 		SegmentBySinogram<float>::full_iterator seg_iter;
 		SegmentBySinogram<float>::full_iterator sx_iter;
-		for (seg_iter = seg.begin_all(), sx_iter = sx.begin_all();
-			seg_iter != seg.end_all() && sx_iter != sx.end_all();
+		for (seg_iter = seg->begin_all(), sx_iter = sx.begin_all();
+			seg_iter != seg->end_all() && sx_iter != sx.end_all();
 			/*empty*/)
 			*seg_iter++ = float(1.0 / std::max(amin, *sx_iter++));
-		set_segment(seg);
-		if (s != 0) {
-			//std::cout << "processing segment " << -s << std::endl;
-			seg = get_empty_segment_by_sinogram(-s);
-			sx = x.get_segment_by_sinogram(-s);
-			for (seg_iter = seg.begin_all(), sx_iter = sx.begin_all();
-				seg_iter != seg.end_all() && sx_iter != sx.end_all();
-				/*empty*/) {
-				*seg_iter++ = float(1.0 / std::max(amin, *sx_iter++));
-			}
-			set_segment(seg);
-		}
-	}
+	});
 }
 
 void
@@ -147,39 +596,37 @@ float b, const aDataContainer<float>& a_y
 {
 	PETAcquisitionData& x = (PETAcquisitionData&)a_x;
 	PETAcquisitionData& y = (PETAcquisitionData&)a_y;
-	int n = get_max_segment_num();
-	int nx = x.get_max_segment_num();
-	int ny = y.get_max_segment_num();
-	for (int s = 0; s <= n && s <= nx && s <= ny; ++s)
+	ProjDataInBlock* ptr_block = data_block();
+	ProjDataInBlock* ptr_block_x = x.data_block();
+	ProjDataInBlock* ptr_block_y = y.data_block();
+	if (same_size_blocks_(ptr_block, ptr_block_x) &&
+		same_size_blocks_(ptr_block, ptr_block_y)) {
+		float* w = ptr_block->get_data_ptr();
+		const float* u = ptr_block_x->get_data_ptr();
+		const float* v = ptr_block_y->get_data_ptr();
+		parallel_for_(ptr_block->size(), [=](size_t i0, size_t i1)
+		{
+			for (size_t i = i0; i < i1; i++)
+				w[i] = float(a*double(u[i]) + b*double(v[i]));
+		});
+		return;
+	}
+	stream_segments(this, { &x, &y }, [a, b](SegmentBySinogram<float>* seg,
+		std::vector<SegmentBySinogram<float> >& segs)
 	{
-		SegmentBySinogram<float> seg = get_empty_segment_by_sinogram(s);
-		SegmentBySinogram<float> sx = x.get_segment_by_sinogram(s);
-		SegmentBySinogram<float> sy = y.get_segment_by_sinogram(s);
+		SegmentBySinogram<float>& sx = segs[0];
+		SegmentBySinogram<float>& sy = segs[1];
 		SegmentBySinogram<float>::full_iterator seg_iter;
 		SegmentBySinogram<float>::full_iterator sx_iter;
 		SegmentBySinogram<float>::full_iterator sy_iter;
-		for (seg_iter = seg.begin_all(),
+		for (seg_iter = seg->begin_all(),
 			sx_iter = sx.begin_all(), sy_iter = sy.begin_all();
-			seg_iter != seg.end_all() &&
+			seg_iter != seg->end_all() &&
 			sx_iter != sx.end_all() && sy_iter != sy.end_all();
 		/*empty*/) {
 			*seg_iter++ = float(a*double(*sx_iter++) + b*double(*sy_iter++));
 		}
-		set_segment(seg);
-		if (s != 0) {
-			seg = get_empty_segment_by_sinogram(-s);
-			sx = x.get_segment_by_sinogram(-s);
-			sy = y.get_segment_by_sinogram(-s);
-			for (seg_iter = seg.begin_all(),
-				sx_iter = sx.begin_all(), sy_iter = sy.begin_all();
-				seg_iter != seg.end_all() &&
-				sx_iter != sx.end_all() && sy_iter != sy.end_all();
-			/*empty*/) {
-				*seg_iter++ = float(a*double(*sx_iter++) + b*double(*sy_iter++));
-			}
-			set_segment(seg);
-		}
-	}
+	});
 }
 
 float
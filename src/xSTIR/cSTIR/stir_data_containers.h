@@ -21,10 +21,14 @@ limitations under the License.
 #ifndef STIR_DATA_CONTAINER_TYPES
 #define STIR_DATA_CONTAINER_TYPES
 
+#include <limits.h>
 #include <stdlib.h>
 
 #include <chrono>
 #include <fstream>
+#include <functional>
+#include <iostream>
+#include <vector>
 
 #include "cstir_shared_ptr.h"
 #include "data_handle.h"
@@ -50,6 +54,10 @@ public:
 		sprintf(buff, "tmp_%d_%lld", calls, ms);
 		return std::string(buff);
 	}
+	// runs work(0), ..., work(n - 1) in parallel on threads kept for the
+	// whole process, the calling one included, and waits for all to finish,
+	// rethrowing the first exception raised
+	static void run_threads(int n, std::function<void(int)> work);
 };
 
 class ProjDataFile : public ProjDataInterfile {
@@ -73,6 +81,130 @@ public:
 	}
 };
 
+/*!
+\brief Stream reading and writing a block of floats.
+*/
+class FloatBlockStream : public std::iostream {
+public:
+	FloatBlockStream(size_t n) : std::iostream(0), 
+		_block(n, 0.0f), _data(_block.data()), _size(n),
+		_buffer((char*)_data, n*sizeof(float))
+	{
+		rdbuf(&_buffer);
+	}
+	virtual ~FloatBlockStream() {}
+	float* data() { return _data; }
+	const float* data() const { return _data; }
+	size_t size() const { return _size; }
+
+protected:
+	// stream over a block of n floats owned by the derived class
+	FloatBlockStream(float* data, size_t n) : std::iostream(0),
+		_data(data), _size(n), _buffer((char*)_data, n*sizeof(float))
+	{
+		rdbuf(&_buffer);
+	}
+
+private:
+	class Buffer : public std::streambuf {
+	public:
+		Buffer(char* begin, size_t size)
+		{
+			setg(begin, begin, begin + size);
+			setp(begin, begin + size);
+		}
+	protected:
+		virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+			std::ios_base::openmode which)
+		{
+			if (dir == std::ios_base::cur)
+				off += (which & std::ios_base::in ? gptr() : pptr()) - eback();
+			else if (dir == std::ios_base::end)
+				off += egptr() - eback();
+			return seekpos(pos_type(off), which);
+		}
+		virtual pos_type seekpos(pos_type sp, std::ios_base::openmode which)
+		{
+			off_type pos = sp;
+			if (pos < 0 || pos > egptr() - eback())
+				return pos_type(off_type(-1));
+			if (which & std::ios_base::in)
+				setg(eback(), eback() + pos, egptr());
+			if (which & std::ios_base::out) {
+				setp(pbase(), epptr());
+				// pbump takes int
+				for (off_type left = pos; left > 0; left -= INT_MAX)
+					pbump(left > INT_MAX ? INT_MAX : (int)left);
+			}
+			return sp;
+		}
+	};
+
+	std::vector<float> _block;
+	float* _data;
+	size_t _size;
+	Buffer _buffer;
+};
+
+/*!
+\brief Stream reading and writing a block of floats mapped to a scratch file.
+
+The file is removed from the directory as soon as it is mapped, so that the
+system deletes it even if the process terminates abnormally. The pages are
+written to the file rather than to swap, so the block may exceed 
+the physical memory.
+*/
+class MappedFloatBlockStream : public FloatBlockStream {
+public:
+	MappedFloatBlockStream(size_t n, const std::string& dir) :
+		FloatBlockStream(map_(n, dir), n)
+	{}
+	~MappedFloatBlockStream();
+private:
+	static float* map_(size_t n, const std::string& dir);
+};
+
+/*!
+\brief Projection data in memory, stored in one contiguous block of floats.
+
+Used instead of ProjDataInMemory, which does not give access to its buffer.
+*/
+class ProjDataInBlock : public ProjDataFromStream {
+public:
+	ProjDataInBlock(shared_ptr<ExamInfo> exam_info_sptr,
+		shared_ptr<ProjDataInfo> proj_data_info_sptr) :
+		ProjDataInBlock(exam_info_sptr, proj_data_info_sptr,
+		shared_ptr<FloatBlockStream>
+		(new FloatBlockStream(num_values(*proj_data_info_sptr))))
+	{}
+	// sptr_stream must have num_values(*proj_data_info_sptr) floats
+	ProjDataInBlock(shared_ptr<ExamInfo> exam_info_sptr,
+		shared_ptr<ProjDataInfo> proj_data_info_sptr,
+		shared_ptr<FloatBlockStream> sptr_stream) :
+		ProjDataFromStream(exam_info_sptr, proj_data_info_sptr,
+		sptr_stream, 0, Segment_AxialPos_View_TangPos),
+		_block(sptr_stream.get())
+	{}
+	float* get_data_ptr() { return _block->data(); }
+	const float* get_data_ptr() const { return _block->data(); }
+	size_t size() const { return _block->size(); }
+
+	static size_t num_values(const ProjDataInfo& pdi)
+	{
+		size_t n = 0;
+		for (int s = pdi.get_min_segment_num(); 
+			s <= pdi.get_max_segment_num(); s++)
+			n += pdi.get_num_axial_poss(s);
+		n *= pdi.get_num_views();
+		n *= pdi.get_num_tangential_poss();
+		return n;
+	}
+
+private:
+	// the stream is also held by ProjDataFromStream
+	FloatBlockStream* _block;
+};
+
 class PETAcquisitionData : public aDataContainer < float > {
 public:
 	virtual ~PETAcquisitionData() {}
@@ -154,13 +286,40 @@ public:
 	virtual void clear_stream() = 0;
 	virtual void close_stream() = 0;
 
+	// the block of all values if the data are stored in one, 0 otherwise
+	ProjDataInBlock* data_block() const
+	{
+		return dynamic_cast<ProjDataInBlock*>(_data.get());
+	}
+
 	// ProjData casts
 	operator ProjData&() { return *data(); }
 	operator const ProjData&() const { return *data(); }
 
+	// memory (in bytes) that stream_segments() may use for segments read 
+	// ahead or waiting to be written
+	static void set_streaming_budget(size_t bytes)
+	{
+		_streaming_budget = bytes;
+	}
+	static size_t streaming_budget() { return _streaming_budget; }
+
 protected:
+	typedef std::function<void(SegmentBySinogram<float>* out,
+		std::vector<SegmentBySinogram<float> >& in)> SegmentsOperation;
+
+	/*
+	applies f to the segments of the input data segment by segment, storing
+	the result (if ptr_out is not 0) in the respective segment of *ptr_out;
+	the next segments are read and the previous result written by a 
+	background thread while f is working
+	*/
+	static void stream_segments(PETAcquisitionData* ptr_out,
+		const std::vector<const PETAcquisitionData*>& in, SegmentsOperation f);
+
 	//static std::string _storage_scheme;
 	static shared_ptr<PETAcquisitionData> _template;
+	static size_t _streaming_budget;
 	shared_ptr<ProjData> _data;
 };
 
@@ -242,7 +401,7 @@ public:
 	PETAcquisitionDataInMemory(const ProjData& pd)
 	{
 		_data = shared_ptr<ProjData>
-			(new ProjDataInMemory(pd.get_exam_info_sptr(),
+			(new ProjDataInBlock(pd.get_exam_info_sptr(),
 			pd.get_proj_data_info_sptr()));
 	}
 
@@ -274,6 +433,61 @@ public:
 	void close_stream()	{}
 };
 
+/*!
+\brief Acquisition data stored in one block of memory mapped to a scratch 
+file.
+
+Combines the direct access of PETAcquisitionDataInMemory with the capacity
+of PETAcquisitionDataInFile: the system pages the data in and out of the
+file as needed.
+*/
+class PETAcquisitionDataInMappedFile : public PETAcquisitionData {
+public:
+	PETAcquisitionDataInMappedFile() {}
+	PETAcquisitionDataInMappedFile(const ProjData& pd)
+	{
+		shared_ptr<ProjDataInfo> sptr_pdi = pd.get_proj_data_info_sptr();
+		_data = shared_ptr<ProjData>
+			(new ProjDataInBlock(pd.get_exam_info_sptr(), sptr_pdi,
+			shared_ptr<FloatBlockStream>(new MappedFloatBlockStream
+			(ProjDataInBlock::num_values(*sptr_pdi), _scratch_dir))));
+	}
+
+	static void init() { PETAcquisitionDataInFile::init(); }
+	static void set_as_template()
+	{
+		init();
+		_template.reset(new PETAcquisitionDataInMappedFile);
+	}
+	static void set_scratch_directory(const std::string& dir)
+	{
+		_scratch_dir = dir;
+	}
+
+	PETAcquisitionData* same_acquisition_data(const ProjData& pd)
+	{
+		PETAcquisitionData* ptr_ad = new PETAcquisitionDataInMappedFile(pd);
+		return ptr_ad;
+	}
+	shared_ptr<PETAcquisitionData> new_acquisition_data()
+	{
+		init();
+		return shared_ptr<PETAcquisitionData>
+			(_template->same_acquisition_data(*data()));
+	}
+	aDataContainer<float>* new_data_container()
+	{
+		init();
+		return _template->same_acquisition_data(*data());
+	}
+
+	void clear_stream() {}
+	void close_stream()	{}
+
+private:
+	static std::string _scratch_dir;
+};
+
 class PETImageData : public aDataContainer<float> {
 public:
 	PETImageData(){}
@@ -36,6 +36,7 @@ limitations under the License.
 #include "stir/IO/read_from_file.h"
 #include "stir/OSMAPOSL/OSMAPOSLReconstruction.h"
 #include "stir/OSSPS/OSSPSReconstruction.h"
+#include "stir/ProjDataFromStream.h"
 #include "stir/ProjDataInfoCylindrical.h"
 #include "stir/ProjDataInMemory.h"
 #include "stir/ProjDataInterfile.h"
@@ -73,7 +74,6 @@ PoissonLogLhLinModMean3DF;
 typedef PoissonLogLikelihoodWithLinearModelForMeanAndProjData<Image3DF>
 PoissonLogLhLinModMeanProjData3DF;
 typedef ProjectorByBinPairUsingProjMatrixByBin ProjectorPairUsingMatrix;
-typedef ProjMatrixByBinUsingRayTracing RayTracingMatrix;
 typedef GeneralisedPrior<Image3DF> Prior3DF;
 typedef QuadraticPrior<float> QuadPrior3DF;
 typedef DataProcessor<Image3DF> DataProcessor3DF;
@@ -19,6 +19,29 @@ limitations under the License.
 
 */
 
+#include <limits.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "stir_types.h"
 #include "stir_x.h"
 
@@ -44,6 +67,7 @@ PETAcquisitionModel::set_up(
 	shared_ptr<Image3DF> sptr_image)
 {
 	Succeeded s = Succeeded::no;
+	share_matrix_();
 	if (sptr_projectors_.get()) {
 		s = sptr_projectors_->set_up
 			(sptr_acq->get_proj_data_info_sptr(), sptr_image);
@@ -53,6 +77,76 @@ PETAcquisitionModel::set_up(
 	return s;
 }
 
+// adds y to x in the same way as PETAcquisitionData::axpby(1, x, 1, y)
+static void
+add_viewgrams_(RelatedViewgrams<float>& x, const RelatedViewgrams<float>& y)
+{
+	RelatedViewgrams<float>::iterator x_iter = x.begin();
+	RelatedViewgrams<float>::const_iterator y_iter = y.begin();
+	for (; x_iter != x.end() && y_iter != y.end(); ++x_iter, ++y_iter) {
+		Viewgram<float>::full_iterator xv_iter = x_iter->begin_all();
+		Viewgram<float>::const_full_iterator yv_iter = y_iter->begin_all();
+		for (; xv_iter != x_iter->end_all() && yv_iter != y_iter->end_all();
+			++xv_iter, ++yv_iter)
+			*xv_iter = float(double(*xv_iter) + double(*yv_iter));
+	}
+}
+
+// the view-segment numbers of the basic related viewgrams
+static std::vector<ViewSegmentNumbers>
+basic_view_segment_numbers_(const ProjData& pd,
+	const DataSymmetriesForViewSegmentNumbers& symmetries)
+{
+	std::vector<ViewSegmentNumbers> vs_nums;
+	for (int s = pd.get_min_segment_num(); s <= pd.get_max_segment_num(); s++)
+		for (int v = pd.get_min_view_num(); v <= pd.get_max_view_num(); v++) {
+			ViewSegmentNumbers vs(v, s);
+			if (symmetries.is_basic(vs))
+				vs_nums.push_back(vs);
+		}
+	return vs_nums;
+}
+
+// row cache budget (in bytes) given to a RayTracingMatrix that is to be
+// shared by several threads and has none
+static const size_t SHARED_MATRIX_ROW_CACHE_BUDGET = size_t(256) << 20;
+
+/*
+the row cache of ProjMatrixByBin is only locked when STIR is built with
+OpenMP, hence a matrix using it must not be shared by several threads;
+the row cache of RayTracingMatrix is locked, and is given a budget when
+the number of threads or the matrix is set
+*/
+void
+PETAcquisitionModel::share_matrix_()
+{
+	if (num_threads_ < 2)
+		return;
+	ProjectorPairUsingMatrix* ptr_pair =
+		dynamic_cast<ProjectorPairUsingMatrix*>(sptr_projectors_.get());
+	if (!ptr_pair)
+		return;
+	RayTracingMatrix* ptr_matrix = dynamic_cast<RayTracingMatrix*>
+		(ptr_pair->get_proj_matrix_sptr().get());
+	if (ptr_matrix && ptr_matrix->row_cache().budget() == 0)
+		ptr_matrix->set_row_cache_budget(SHARED_MATRIX_ROW_CACHE_BUDGET);
+}
+
+int
+PETAcquisitionModel::projection_threads_() const
+{
+	if (num_threads_ < 2)
+		return 1;
+	ProjectorPairUsingMatrix* ptr_pair =
+		dynamic_cast<ProjectorPairUsingMatrix*>(sptr_projectors_.get());
+	if (!ptr_pair)
+		return num_threads_;
+	shared_ptr<ProjMatrixByBin> sptr_matrix = ptr_pair->get_proj_matrix_sptr();
+	if (sptr_matrix.get() && sptr_matrix->is_cache_enabled())
+		return 1;
+	return num_threads_;
+}
+
 shared_ptr<PETAcquisitionData>
 PETAcquisitionModel::forward(const Image3DF& image)
 {
@@ -61,56 +155,812 @@ PETAcquisitionModel::forward(const Image3DF& image)
 
 	shared_ptr<ProjData> sptr_fd = sptr_ad->data();
 
-	sptr_projectors_->get_forward_projector_sptr()->forward_project
-		(*sptr_fd, image);
-
-	if (sptr_add_.get()) {
-		std::cout << "additive term added...";
-		sptr_ad->axpby(1.0, *sptr_ad, 1.0, *sptr_add_);
-		std::cout << "ok\n";
-	}
-	else
-		std::cout << "no additive term added\n";
+	shared_ptr<ProjData> sptr_add;
+	if (sptr_add_.get())
+		sptr_add = sptr_add_->data();
+	shared_ptr<ProjData> sptr_background;
+	if (sptr_background_.get())
+		sptr_background = sptr_background_->data();
+	bool normalise = 
+		sptr_normalisation_.get() && !sptr_normalisation_->is_trivial();
+	std::cout << "forward projecting";
+	if (sptr_add.get())
+		std::cout << ", adding additive term";
+	if (normalise)
+		std::cout << ", applying normalisation";
+	if (sptr_background.get())
+		std::cout << ", adding background term";
+	std::cout << "...";
 
 	clear_stream();
-	if (sptr_normalisation_.get() && !sptr_normalisation_->is_trivial()) {
-		std::cout << "normalisation applied...";
-		sptr_normalisation_->undo(*sptr_fd, 0, 1);
-		//sptr_normalisation_->apply(*sptr_fd, 0, 1);
-		std::cout << "ok\n";
-	}
-	else
-		std::cout << "no normalisation applied\n";
 
-	if (sptr_background_.get()) {
-		std::cout << "background term added...";
-		sptr_ad->axpby(1.0, *sptr_ad, 1.0, *sptr_background_);
-		std::cout << "ok\n";
-	}
-	else
-		std::cout << "no background term added\n";
+	// all terms are applied to each group of related viewgrams right after
+	// it is projected, and the result is stored just once;
+	// the groups are shared between the projection threads, and
+	// the data reading and writing, which is not thread-safe, is serialised
+	shared_ptr<ForwardProjectorByBin> sptr_fp =
+		sptr_projectors_->get_forward_projector_sptr();
+	shared_ptr<DataSymmetriesForViewSegmentNumbers> sptr_symmetries
+		(sptr_projectors_->get_symmetries_used()->clone());
+	std::vector<ViewSegmentNumbers> vs_nums =
+		basic_view_segment_numbers_(*sptr_fd, *sptr_symmetries);
+	std::mutex io_mutex;
+	std::atomic<size_t> next(0);
+	SIRFUtilities::run_threads(projection_threads_(), [&](int)
+	{
+		for (size_t i; (i = next++) < vs_nums.size();) {
+			std::unique_lock<std::mutex> lock(io_mutex);
+			RelatedViewgrams<float> viewgrams = 
+				sptr_fd->get_empty_related_viewgrams(vs_nums[i], sptr_symmetries);
+			lock.unlock();
+			sptr_fp->forward_project(viewgrams, image);
+			lock.lock();
+			if (sptr_add.get())
+				add_viewgrams_(viewgrams, sptr_add->get_related_viewgrams
+				(vs_nums[i], sptr_symmetries));
+			if (normalise)
+				sptr_normalisation_->undo(viewgrams, 0, 1);
+			if (sptr_background.get())
+				add_viewgrams_(viewgrams, sptr_background->get_related_viewgrams
+				(vs_nums[i], sptr_symmetries));
+			sptr_fd->set_related_viewgrams(viewgrams);
+		}
+	});
+	std::cout << "ok\n";
 
 	return sptr_ad;
 }
 
 shared_ptr<Image3DF> 
-PETAcquisitionModel::backward(ProjData& ad)
+PETAcquisitionModel::backward(const ProjData& ad)
 {
 	shared_ptr<Image3DF> sptr_im(sptr_image_template_->clone());
 	sptr_im->fill(0.0);
 
-	if (sptr_normalisation_.get() && !sptr_normalisation_->is_trivial()) {
-		std::cout << "applying normalisation...";
-		std::cout << "ok\n";
-		sptr_normalisation_->undo(ad, 0, 1);
-		std::cout << "backprojecting...";
-		sptr_projectors_->get_back_projector_sptr()->back_project(*sptr_im, ad);
-		std::cout << "ok\n";
+	shared_ptr<BackProjectorByBin> sptr_bp =
+		sptr_projectors_->get_back_projector_sptr();
+	bool normalise =
+		sptr_normalisation_.get() && !sptr_normalisation_->is_trivial();
+	int nt = projection_threads_();
+	if (!normalise && nt < 2) {
+		sptr_bp->back_project(*sptr_im, ad);
+		return sptr_im;
 	}
+
+	if (normalise)
+		std::cout << "applying normalisation and backprojecting...";
 	else
-		sptr_projectors_->get_back_projector_sptr()->back_project
-		(*sptr_im, ad);
+		std::cout << "backprojecting...";
+	// normalisation is applied to copies of the related viewgrams
+	// as they are read, leaving ad unchanged;
+	// each thread backprojects into an image of its own, 
+	// and the images are added up pairwise at the end
+	shared_ptr<DataSymmetriesForViewSegmentNumbers> sptr_symmetries
+		(sptr_projectors_->get_symmetries_used()->clone());
+	std::vector<ViewSegmentNumbers> vs_nums =
+		basic_view_segment_numbers_(ad, *sptr_symmetries);
+	nt = std::max(1, std::min(nt, (int)vs_nums.size()));
+	std::vector<shared_ptr<Image3DF> > images(nt);
+	images[0] = sptr_im;
+	for (int t = 1; t < nt; t++) {
+		images[t].reset(sptr_image_template_->clone());
+		images[t]->fill(0.0);
+	}
+	std::mutex io_mutex;
+	std::atomic<size_t> next(0);
+	SIRFUtilities::run_threads(nt, [&](int t)
+	{
+		for (size_t i; (i = next++) < vs_nums.size();) {
+			std::unique_lock<std::mutex> lock(io_mutex);
+			RelatedViewgrams<float> viewgrams =
+				ad.get_related_viewgrams(vs_nums[i], sptr_symmetries);
+			if (normalise)
+				sptr_normalisation_->undo(viewgrams, 0, 1);
+			lock.unlock();
+			sptr_bp->back_project(*images[t], viewgrams);
+		}
+	});
+	for (int step = 1; step < nt; step *= 2) {
+		int npairs = (nt - step + 2 * step - 1) / (2 * step);
+		SIRFUtilities::run_threads(npairs, [&](int p)
+		{
+			int t = 2 * step * p;
+			*images[t] += *images[t + step];
+		});
+	}
+	std::cout << "ok\n";
 
 	return sptr_im;
 }
 
+bool
+FileInMemory::open(const std::string& filename)
+{
+	close();
+#ifndef _WIN32
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	void* ptr = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (ptr == MAP_FAILED)
+		return false;
+	_data = (const char*)ptr;
+	_size = st.st_size;
+	_mapped = true;
+	// accessed in no particular order
+	madvise(ptr, _size, MADV_RANDOM);
+#else
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	if (!file)
+		return false;
+	_buffer.assign(std::istreambuf_iterator<char>(file), 
+		std::istreambuf_iterator<char>());
+	if (_buffer.empty())
+		return false;
+	_data = &_buffer[0];
+	_size = _buffer.size();
+#endif
+	return true;
+}
+
+void
+FileInMemory::close()
+{
+#ifndef _WIN32
+	if (_mapped)
+		munmap((void*)_data, _size);
+#endif
+	std::vector<char>().swap(_buffer);
+	_data = 0;
+	_size = 0;
+	_mapped = false;
+}
+
+/*
+Disk cache file layout (native byte order):
+	magic "SIRFRTM1"
+	key length (8 bytes), key
+	number of rows (8 bytes)
+	for each row: bin key (8 bytes), offset of its elements from the start 
+	of the elements data (8 bytes), number of elements (4 bytes), 4 unused
+	bytes
+	elements data: for each element 3 coordinates (2 bytes each) and 
+	the value (4 bytes)
+*/
+static const char RTM_MAGIC[] = "SIRFRTM1";
+static const size_t RTM_MAGIC_SIZE = 8;
+static const size_t RTM_INDEX_ENTRY_SIZE = 24;
+static const size_t RTM_ELEM_SIZE = 3 * sizeof(short) + sizeof(float);
+// memory (in bytes) for the rows to be added to the cache file if the row
+// cache budget is not set
+static const size_t RTM_NEW_ROWS_MEMORY = size_t(256) << 20;
+// approximate memory taken by a row to be added besides its elements
+static const size_t RTM_NEW_ROW_OVERHEAD = 64;
+
+template<typename T>
+static void
+put_(std::ostream& s, T v)
+{
+	s.write((const char*)&v, sizeof(T));
+}
+
+template<typename T>
+static void
+put_(std::vector<char>& b, T v)
+{
+	const char* ptr = (const char*)&v;
+	b.insert(b.end(), ptr, ptr + sizeof(T));
+}
+
+template<typename T>
+static T
+get_(const char*& ptr)
+{
+	T v;
+	memcpy(&v, ptr, sizeof(T));
+	ptr += sizeof(T);
+	return v;
+}
+
+// FNV-1a
+static unsigned long long
+hash_(const std::string& s)
+{
+	unsigned long long h = 14695981039346656037ULL;
+	for (size_t i = 0; i < s.size(); i++) {
+		h ^= (unsigned char)s[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+unsigned long long
+xSTIR_RayTracingMatrix::bin_key_(const Bin& bin)
+{
+	unsigned long long s = (unsigned short)(bin.segment_num() + 0x8000);
+	unsigned long long v = (unsigned short)(bin.view_num() + 0x8000);
+	unsigned long long a = (unsigned short)(bin.axial_pos_num() + 0x8000);
+	unsigned long long t = (unsigned short)(bin.tangential_pos_num() + 0x8000);
+	return (s << 48) | (v << 32) | (a << 16) | t;
+}
+
+xSTIR_RayTracingMatrix::~xSTIR_RayTracingMatrix()
+{
+	try {
+		save_disk_cache();
+	}
+	catch (...) {
+		std::cout << "failed to save ray tracing matrix cache "
+			<< cache_file_ << '\n';
+	}
+}
+
+void
+xSTIR_RayTracingMatrix::set_up
+(const shared_ptr<ProjDataInfo>& proj_data_info_ptr,
+const shared_ptr<DiscretisedDensity<3, float> >& density_info_ptr)
+{
+	save_disk_cache();
+	disk_cache_.close();
+	disk_index_.clear();
+	disk_rows_ = 0;
+	cache_file_.clear();
+
+	ProjMatrixByBinUsingRayTracing::set_up
+		(proj_data_info_ptr, density_info_ptr);
+
+	row_cache_.clear();
+	const Voxels3DF* ptr_voxels =
+		dynamic_cast<const Voxels3DF*>(density_info_ptr.get());
+	if (ptr_voxels)
+		row_cache_.set_grid(ptr_voxels->get_min_z(), ptr_voxels->get_max_z(),
+		ptr_voxels->get_min_y(), ptr_voxels->get_max_y(),
+		ptr_voxels->get_min_x(), ptr_voxels->get_max_x());
+	else
+		row_cache_.set_grid(0, -1, 0, -1, 0, -1);
+	enable_cache(row_cache_.budget() == 0);
+
+	// the ray tracing itself is private to the base class, so a plain
+	// ray tracing matrix with the same parameters computes the rows
+	std::istringstream parameters(parameter_info());
+	sptr_calculator_.reset(new ProjMatrixByBinUsingRayTracing);
+	sptr_calculator_->parse(parameters);
+	sptr_calculator_->enable_cache(false);
+	sptr_calculator_->set_up(proj_data_info_ptr, density_info_ptr);
+
+	if (disk_cache_dir_.empty())
+		return;
+
+	const DiscretisedDensity<3, float>& density = *density_info_ptr;
+	std::ostringstream key;
+	key << std::setprecision(9);
+	key << parameter_info() << proj_data_info_ptr->parameter_info();
+	CartesianCoordinate3D<float> origin = density.get_origin();
+	key << "origin " << origin.z() << ' ' << origin.y() << ' ' << origin.x();
+	key << "\nz range " << density.get_min_index() << ' '
+		<< density.get_max_index();
+	if (ptr_voxels) {
+		CartesianCoordinate3D<float> size = ptr_voxels->get_voxel_size();
+		key << "\nvoxel size " << size.z() << ' ' << size.y() << ' '
+			<< size.x();
+		key << "\ny range " << ptr_voxels->get_min_y() << ' '
+			<< ptr_voxels->get_max_y();
+		key << "\nx range " << ptr_voxels->get_min_x() << ' '
+			<< ptr_voxels->get_max_x();
+	}
+	key << "\ntangential LORs " << get_num_tangential_LORs() << '\n';
+	cache_key_ = key.str();
+
+	std::ostringstream filename;
+	filename << disk_cache_dir_ << "/rtm_" << std::hex << std::setw(16)
+		<< std::setfill('0') << hash_(cache_key_) << ".bin";
+	cache_file_ = filename.str();
+	load_disk_cache_();
+}
+
+void
+xSTIR_RayTracingMatrix::load_disk_cache_()
+{
+	disk_index_.clear();
+	disk_rows_ = 0;
+	if (!disk_cache_.open(cache_file_))
+		return;
+	const char* ptr = disk_cache_.data();
+	const char* end = ptr + disk_cache_.size();
+
+	// a file for another key with the same hash, or a damaged one, 
+	// is ignored and will be overwritten
+	size_t header_size = RTM_MAGIC_SIZE + 2 * sizeof(unsigned long long);
+	if (disk_cache_.size() < header_size + cache_key_.size() ||
+		memcmp(ptr, RTM_MAGIC, RTM_MAGIC_SIZE) != 0) {
+		disk_cache_.close();
+		return;
+	}
+	ptr += RTM_MAGIC_SIZE;
+	unsigned long long key_size = get_<unsigned long long>(ptr);
+	if (key_size != cache_key_.size() ||
+		memcmp(ptr, cache_key_.data(), key_size) != 0) {
+		disk_cache_.close();
+		return;
+	}
+	ptr += key_size;
+	unsigned long long nrows = get_<unsigned long long>(ptr);
+	if ((unsigned long long)(end - ptr) / RTM_INDEX_ENTRY_SIZE < nrows) {
+		disk_cache_.close();
+		return;
+	}
+	const char* rows = ptr + nrows * RTM_INDEX_ENTRY_SIZE;
+	unsigned long long rows_size = end - rows;
+	for (unsigned long long i = 0; i < nrows; i++) {
+		unsigned long long bin_key = get_<unsigned long long>(ptr);
+		RowLocation row;
+		row.offset = get_<unsigned long long>(ptr);
+		row.size = get_<unsigned int>(ptr);
+		ptr += sizeof(unsigned int);
+		if (row.offset > rows_size ||
+			(rows_size - row.offset) / RTM_ELEM_SIZE < row.size) {
+			disk_index_.clear();
+			disk_cache_.close();
+			return;
+		}
+		disk_index_[bin_key] = row;
+	}
+	disk_rows_ = rows;
+}
+
+void
+xSTIR_RayTracingMatrix::save_disk_cache()
+{
+	std::lock_guard<std::mutex> lock(new_rows_mutex_);
+	if (cache_file_.empty() || new_rows_.empty())
+		return;
+
+	// old and new rows, sorted by bin
+	std::map<unsigned long long, std::pair<const char*, unsigned int> > rows;
+	std::unordered_map<unsigned long long, RowLocation>::const_iterator i;
+	for (i = disk_index_.begin(); i != disk_index_.end(); ++i)
+		rows[i->first] = std::make_pair
+		(disk_rows_ + i->second.offset, i->second.size);
+	std::map<unsigned long long, std::vector<char> >::const_iterator j;
+	for (j = new_rows_.begin(); j != new_rows_.end(); ++j)
+		rows[j->first] = std::make_pair
+		(j->second.data(), (unsigned int)(j->second.size() / RTM_ELEM_SIZE));
+
+	// written to a new file that then replaces the old one, so that 
+	// an interrupted save leaves no broken cache file
+#ifdef _WIN32
+	std::string filename = cache_file_ + "." + SIRFUtilities::scratch_file_name();
+#else
+	// mkstemp() creates a file of a new unique name
+	std::string templ = cache_file_ + ".XXXXXX";
+	std::vector<char> name(templ.begin(), templ.end());
+	name.push_back(0);
+	int fd = mkstemp(&name[0]);
+	if (fd < 0) {
+		std::cout << "failed to save ray tracing matrix cache "
+			<< cache_file_ << '\n';
+		return;
+	}
+	// mkstemp() makes it readable by the owner only, unlike an ordinary file
+	fchmod(fd, 0644);
+	close(fd);
+	std::string filename(&name[0]);
+#endif
+	std::ofstream file(filename.c_str(), std::ios::binary | std::ios::trunc);
+	file.write(RTM_MAGIC, RTM_MAGIC_SIZE);
+	put_<unsigned long long>(file, cache_key_.size());
+	file.write(cache_key_.data(), cache_key_.size());
+	put_<unsigned long long>(file, rows.size());
+	std::map<unsigned long long, std::pair<const char*, unsigned int> >::
+		const_iterator k;
+	unsigned long long offset = 0;
+	for (k = rows.begin(); k != rows.end(); ++k) {
+		put_<unsigned long long>(file, k->first);
+		put_<unsigned long long>(file, offset);
+		put_<unsigned int>(file, k->second.second);
+		put_<unsigned int>(file, 0);
+		offset += k->second.second * RTM_ELEM_SIZE;
+	}
+	for (k = rows.begin(); k != rows.end(); ++k)
+		file.write(k->second.first, k->second.second * RTM_ELEM_SIZE);
+	file.close();
+	if (!file) {
+		std::remove(filename.c_str());
+		std::cout << "failed to save ray tracing matrix cache "
+			<< cache_file_ << '\n';
+		return;
+	}
+	disk_cache_.close();
+#ifdef _WIN32
+	std::remove(cache_file_.c_str());
+#endif
+	if (std::rename(filename.c_str(), cache_file_.c_str()) != 0) {
+		std::remove(filename.c_str());
+		std::cout << "failed to save ray tracing matrix cache "
+			<< cache_file_ << '\n';
+	}
+	new_rows_.clear();
+	new_rows_memory_ = 0;
+	load_disk_cache_();
+}
+
+bool
+xSTIR_RayTracingMatrix::read_disk_cache_row_
+(unsigned long long key, ProjMatrixElemsForOneBin& elems) const
+{
+	bool found = false;
+	const char* ptr = 0;
+	unsigned int size = 0;
+
+	std::unordered_map<unsigned long long, RowLocation>::const_iterator i =
+		disk_index_.find(key);
+	if (i != disk_index_.end()) {
+		found = true;
+		ptr = disk_rows_ + i->second.offset;
+		size = i->second.size;
+	}
+	else if (!cache_file_.empty()) {
+		std::lock_guard<std::mutex> lock(new_rows_mutex_);
+		std::map<unsigned long long, std::vector<char> >::const_iterator j =
+			new_rows_.find(key);
+		if (j != new_rows_.end()) {
+			found = true;
+			ptr = j->second.data();
+			size = (unsigned int)(j->second.size() / RTM_ELEM_SIZE);
+		}
+	}
+	if (!found)
+		return false;
+	elems.reserve(size);
+	for (unsigned int e = 0; e < size; e++) {
+		int c1 = get_<short>(ptr);
+		int c2 = get_<short>(ptr);
+		int c3 = get_<short>(ptr);
+		float v = get_<float>(ptr);
+		elems.push_back(ProjMatrixElemsForOneBinValue
+			(Coordinate3D<int>(c1, c2, c3), v));
+	}
+	return true;
+}
+
+void
+xSTIR_RayTracingMatrix::add_disk_cache_row_
+(unsigned long long key, const ProjMatrixElemsForOneBin& elems) const
+{
+	if (cache_file_.empty())
+		return;
+	// the rows to be added stay in memory until save_disk_cache(), 
+	// those that do not fit are not saved
+	size_t max_memory = row_cache_.budget() > 0 ? 
+		row_cache_.budget() : RTM_NEW_ROWS_MEMORY;
+	size_t memory = elems.size() * RTM_ELEM_SIZE + RTM_NEW_ROW_OVERHEAD;
+	{
+		std::lock_guard<std::mutex> lock(new_rows_mutex_);
+		if (new_rows_memory_ + memory > max_memory)
+			return;
+	}
+
+	std::vector<char> row;
+	row.reserve(elems.size() * RTM_ELEM_SIZE);
+	ProjMatrixElemsForOneBin::const_iterator e;
+	for (e = elems.begin(); e != elems.end(); ++e) {
+		int c[3] = { e->coord1(), e->coord2(), e->coord3() };
+		for (int k = 0; k < 3; k++) {
+			if (c[k] < SHRT_MIN || c[k] > SHRT_MAX)
+				return; // does not fit, will be recomputed when needed
+			put_<short>(row, (short)c[k]);
+		}
+		put_<float>(row, e->get_value());
+	}
+	std::lock_guard<std::mutex> lock(new_rows_mutex_);
+	// another thread may have stored this row and be reading it
+	std::vector<char>& stored_row = new_rows_[key];
+	if (stored_row.empty()) {
+		stored_row.swap(row);
+		new_rows_memory_ += memory;
+	}
+}
+
+void
+xSTIR_RayTracingMatrix::calculate_proj_matrix_elems_for_one_bin
+(ProjMatrixElemsForOneBin& elems) const
+{
+	const Bin bin = elems.get_bin();
+	unsigned long long key = bin_key_(bin);
+	bool use_row_cache = row_cache_.budget() > 0;
+	if (use_row_cache && row_cache_.get(key, elems))
+		return;
+	if (!read_disk_cache_row_(key, elems)) {
+		sptr_calculator_->get_proj_matrix_elems_for_one_bin(elems, bin);
+		add_disk_cache_row_(key, elems);
+	}
+	if (use_row_cache)
+		row_cache_.put(key, elems);
+}
+
+void
+xSTIR_RayTracingMatrix::set_row_cache_budget(size_t bytes)
+{
+	row_cache_.set_budget(bytes);
+	enable_cache(bytes == 0);
+	if (bytes > 0)
+		clear_cache();
+}
+
+// IEEE half precision conversions, rounding to nearest even
+static unsigned short
+float_to_half_(float f)
+{
+	unsigned int x;
+	memcpy(&x, &f, sizeof(x));
+	unsigned int sign = (x >> 16) & 0x8000;
+	int exp = (x >> 23) & 0xFF;
+	unsigned int mant = x & 0x7FFFFF;
+	if (exp == 0xFF) // infinity or NaN
+		return sign | 0x7C00 | (mant ? 0x200 : 0);
+	exp += 15 - 127;
+	if (exp >= 31) // too large
+		return sign | 0x7C00;
+	unsigned int shift = 13;
+	if (exp <= 0) { // subnormal
+		if (exp < -10)
+			return sign;
+		mant |= 0x800000;
+		shift = 14 - exp;
+		exp = 0;
+	}
+	unsigned int h = (exp << 10) + (mant >> shift);
+	unsigned int rest = mant & ((1u << shift) - 1);
+	unsigned int half = 1u << (shift - 1);
+	if (rest > half || (rest == half && (h & 1)))
+		h++; // may carry into the exponent, which is correct
+	return sign | h;
+}
+
+static float
+half_to_float_(unsigned short h)
+{
+	unsigned int sign = (h & 0x8000) << 16;
+	int exp = (h >> 10) & 0x1F;
+	unsigned int mant = h & 0x3FF;
+	unsigned int x;
+	if (exp == 0x1F)
+		x = sign | 0x7F800000 | (mant << 13);
+	else if (exp > 0)
+		x = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+	else if (mant == 0)
+		x = sign;
+	else { // subnormal
+		exp = 1;
+		while (!(mant & 0x400)) {
+			mant <<= 1;
+			exp--;
+		}
+		x = sign | ((exp + 127 - 15) << 23) | ((mant & 0x3FF) << 13);
+	}
+	float f;
+	memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+void
+MatrixRowCache::set_budget(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	budget_ = bytes;
+	evict_(0);
+}
+
+void
+MatrixRowCache::set_grid(int min_z, int max_z, int min_y, int max_y,
+	int min_x, int max_x)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	min_z_ = min_z;
+	min_y_ = min_y;
+	min_x_ = min_x;
+	nz_ = max_z - min_z + 1;
+	ny_ = max_y - min_y + 1;
+	nx_ = max_x - min_x + 1;
+	double size = double(nz_) * ny_ * nx_;
+	// linear indices must fit into 32 bits
+	grid_ok_ = max_z >= min_z && max_y >= min_y && max_x >= min_x &&
+		size < 4294967296.0;
+}
+
+void
+MatrixRowCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	rows_.clear();
+	index_.clear();
+	memory_ = 0;
+	hits_ = 0;
+	misses_ = 0;
+	evictions_ = 0;
+}
+
+bool
+MatrixRowCache::get(unsigned long long key, ProjMatrixElemsForOneBin& elems)
+{
+	// the row is copied under the lock and decoded after, so that
+	// the threads using the cache do not wait for each other's decoding
+	std::vector<unsigned short> code;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::unordered_map<unsigned long long, RowList::iterator>::iterator i =
+			index_.find(key);
+		if (i == index_.end()) {
+			misses_++;
+			return false;
+		}
+		hits_++;
+		RowList::iterator row = i->second;
+		if (row->uses < UINT_MAX)
+			row->uses++;
+		rows_.splice(rows_.begin(), rows_, row);
+		code = row->code;
+	}
+	decode_(code, elems);
+	return true;
+}
+
+void
+MatrixRowCache::put(unsigned long long key, ProjMatrixElemsForOneBin& elems)
+{
+	Row row;
+	row.key = key;
+	row.uses = 1;
+	if (!encode_(elems, row.code))
+		return;
+	// the caller gets the row as get() will return it, so that every use 
+	// of the row sees the same rounded weights
+	elems.erase();
+	decode_(row.code, elems);
+	size_t size = row_memory_(row);
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (size > budget_ || index_.count(key))
+		return;
+	evict_(size);
+	rows_.push_front(Row());
+	rows_.front().key = key;
+	rows_.front().uses = 1;
+	rows_.front().code.swap(row.code);
+	index_[key] = rows_.begin();
+	memory_ += size;
+}
+
+void
+MatrixRowCache::evict_(size_t bytes)
+{
+	// second chance: a row used since it was last considered for eviction
+	// goes back to the front with its use count halved, so that rows used
+	// often in the past but not recently eventually leave the cache
+	while (!rows_.empty() && memory_ + bytes > budget_) {
+		RowList::iterator row = --rows_.end();
+		if (row->uses > 1) {
+			row->uses /= 2;
+			rows_.splice(rows_.begin(), rows_, row);
+			continue;
+		}
+		memory_ -= row_memory_(*row);
+		index_.erase(row->key);
+		rows_.erase(row);
+		evictions_++;
+	}
+}
+
+unsigned long long
+MatrixRowCache::hits() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return hits_;
+}
+
+unsigned long long
+MatrixRowCache::misses() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return misses_;
+}
+
+unsigned long long
+MatrixRowCache::evictions() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return evictions_;
+}
+
+size_t
+MatrixRowCache::rows() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return rows_.size();
+}
+
+size_t
+MatrixRowCache::memory() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return memory_;
+}
+
+size_t
+MatrixRowCache::row_memory_(const Row& row)
+{
+	// list node, index entry and code
+	const size_t overhead = 4 * sizeof(void*) + 
+		sizeof(unsigned long long) + sizeof(RowList::iterator);
+	return sizeof(Row) + overhead + 
+		row.code.capacity() * sizeof(unsigned short);
+}
+
+bool
+MatrixRowCache::encode_(const ProjMatrixElemsForOneBin& elems,
+	std::vector<unsigned short>& code) const
+{
+	if (!grid_ok_)
+		return false;
+	std::vector<std::pair<unsigned int, float> > voxels;
+	voxels.reserve(elems.size());
+	ProjMatrixElemsForOneBin::const_iterator e;
+	for (e = elems.begin(); e != elems.end(); ++e) {
+		int z = e->coord1() - min_z_;
+		int y = e->coord2() - min_y_;
+		int x = e->coord3() - min_x_;
+		if (z < 0 || (unsigned int)z >= nz_ || y < 0 || (unsigned int)y >= ny_ ||
+			x < 0 || (unsigned int)x >= nx_)
+			return false;
+		voxels.push_back(std::make_pair
+			((z * ny_ + y) * nx_ + x, e->get_value()));
+	}
+	std::sort(voxels.begin(), voxels.end());
+
+	code.clear();
+	code.reserve(2 * voxels.size());
+	unsigned int prev = 0;
+	for (size_t i = 0; i < voxels.size(); i++) {
+		unsigned int index = voxels[i].first;
+		unsigned int inc = index - prev;
+		if (inc < 0xFFFF)
+			code.push_back((unsigned short)inc);
+		else {
+			code.push_back(0xFFFF);
+			code.push_back((unsigned short)(index >> 16));
+			code.push_back((unsigned short)(index & 0xFFFF));
+		}
+		code.push_back(float_to_half_(voxels[i].second));
+		prev = index;
+	}
+	std::vector<unsigned short>(code).swap(code); // no spare capacity
+	return true;
+}
+
+void
+MatrixRowCache::decode_(const std::vector<unsigned short>& code,
+	ProjMatrixElemsForOneBin& elems) const
+{
+	unsigned int nyx = ny_ * nx_;
+	unsigned int index = 0;
+	size_t i = 0;
+	while (i < code.size()) {
+		if (code[i] == 0xFFFF) {
+			index = ((unsigned int)code[i + 1] << 16) | code[i + 2];
+			i += 3;
+		}
+		else
+			index += code[i++];
+		float v = half_to_float_(code[i++]);
+		int z = index / nyx;
+		int y = (index % nyx) / nx_;
+		int x = index % nx_;
+		elems.push_back(ProjMatrixElemsForOneBinValue
+			(Coordinate3D<int>(z + min_z_, y + min_y_, x + min_x_), v));
+	}
+}
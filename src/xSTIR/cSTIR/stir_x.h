@@ -23,6 +23,13 @@ limitations under the License.
 
 #include <stdlib.h>
 
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "stir_data_containers.h"
 #include "stir_types.h"
 
@@ -33,6 +40,7 @@ using stir::shared_ptr;
 
 class PETAcquisitionModel {
 public:
+	PETAcquisitionModel() : num_threads_(1) {}
 	~PETAcquisitionModel()
 	{
 		sptr_projectors_.reset();
@@ -46,6 +54,7 @@ public:
 	void set_projectors(shared_ptr<ProjectorByBinPair> sptr_projectors)
 	{
 		sptr_projectors_ = sptr_projectors;
+		share_matrix_();
 	}
 	shared_ptr<ProjectorByBinPair> projectors_sptr()
 	{
@@ -104,6 +113,20 @@ public:
 			sptr_norm_->close_stream();
 	}
 
+	// number of threads sharing the related viewgrams in forward and
+	// backward projection; with more than one, a RayTracingMatrix without
+	// a row cache budget is given one (see set_row_cache_budget()), and
+	// other projection matrices that cache rows are used by one thread
+	void set_num_threads(int num_threads)
+	{
+		num_threads_ = num_threads > 0 ? num_threads : 1;
+		share_matrix_();
+	}
+	int num_threads() const
+	{
+		return num_threads_;
+	}
+
 	virtual Succeeded set_up(
 		shared_ptr<PETAcquisitionData> sptr_acq,
 		shared_ptr<Image3DF> sptr_image);
@@ -111,7 +134,7 @@ public:
 	shared_ptr<PETAcquisitionData>
 		forward(const Image3DF& image);
 
-	shared_ptr<Image3DF> backward(ProjData& ad);
+	shared_ptr<Image3DF> backward(const ProjData& ad);
 
 protected:
 	shared_ptr<ProjectorByBinPair> sptr_projectors_;
@@ -121,6 +144,12 @@ protected:
 	shared_ptr<PETAcquisitionData> sptr_background_;
 	shared_ptr<BinNormalisation> sptr_normalisation_;
 	shared_ptr<PETAcquisitionData> sptr_norm_;
+	int num_threads_;
+
+	// lets the projection matrix, if any, be shared by num_threads_ threads
+	void share_matrix_();
+	// number of threads the projection can be shared between
+	int projection_threads_() const;
 };
 
 class PETAcquisitionModelUsingMatrix : public PETAcquisitionModel {
@@ -134,6 +163,7 @@ class PETAcquisitionModelUsingMatrix : public PETAcquisitionModel {
 		sptr_matrix_ = sptr_matrix;
 		((ProjectorPairUsingMatrix*)this->sptr_projectors_.get())->
 			set_proj_matrix_sptr(sptr_matrix);
+		share_matrix_();
 	}
 	shared_ptr<ProjMatrixByBin> matrix_sptr()
 	{
@@ -157,6 +187,177 @@ typedef PETAcquisitionModel AcqMod3DF;
 typedef PETAcquisitionModelUsingMatrix AcqModUsingMatrix3DF;
 typedef shared_ptr<AcqMod3DF> sptrAcqMod3DF;
 
+/*!
+\brief Read-only view of a file, mapped to memory where supported.
+*/
+class FileInMemory {
+public:
+	FileInMemory() : _data(0), _size(0), _mapped(false) {}
+	~FileInMemory() { close(); }
+	// returns false if the file cannot be opened
+	bool open(const std::string& filename);
+	void close();
+	const char* data() const { return _data; }
+	size_t size() const { return _size; }
+private:
+	FileInMemory(const FileInMemory&);
+	FileInMemory& operator=(const FileInMemory&);
+	const char* _data;
+	size_t _size;
+	bool _mapped;
+	std::vector<char> _buffer;
+};
+
+/*!
+\brief Projection matrix rows cache with a memory budget.
+
+Rows are stored compactly: the voxels of a row are sorted by their linear
+index in the image grid and coded by 16-bit index increments (larger jumps
+take two more 16-bit words), and the weights are rounded to 16-bit floats.
+When a new row does not fit into the budget, rows are evicted from the least
+recently used end, except that a row used more than once since it was last
+there is moved back to the other end with its use count halved.
+*/
+class MatrixRowCache {
+public:
+	MatrixRowCache() : budget_(0), grid_ok_(false)
+	{
+		clear();
+	}
+	// memory budget in bytes, 0 for no caching
+	void set_budget(size_t bytes);
+	size_t budget() const
+	{
+		return budget_;
+	}
+	// the image grid containing all voxels of the rows to be cached
+	void set_grid(int min_z, int max_z, int min_y, int max_y,
+		int min_x, int max_x);
+	// removes all rows and resets the statistics
+	void clear();
+	// returns false if the row for the key is not in the cache
+	bool get(unsigned long long key, ProjMatrixElemsForOneBin& elems);
+	// also replaces the row in elems with the one get() will return,
+	// unless the row cannot be cached because it is not in the grid
+	void put(unsigned long long key, ProjMatrixElemsForOneBin& elems);
+
+	unsigned long long hits() const;
+	unsigned long long misses() const;
+	unsigned long long evictions() const;
+	size_t rows() const;
+	// memory used (in bytes)
+	size_t memory() const;
+
+private:
+	struct Row {
+		unsigned long long key;
+		unsigned int uses;
+		std::vector<unsigned short> code;
+	};
+	typedef std::list<Row> RowList;
+
+	static size_t row_memory_(const Row& row);
+	bool encode_(const ProjMatrixElemsForOneBin& elems,
+		std::vector<unsigned short>& code) const;
+	void decode_(const std::vector<unsigned short>& code,
+		ProjMatrixElemsForOneBin& elems) const;
+	// evicts rows until bytes more fit into the budget
+	void evict_(size_t bytes);
+
+	size_t budget_;
+	bool grid_ok_;
+	int min_z_, min_y_, min_x_;
+	unsigned int nz_, ny_, nx_;
+	mutable std::mutex mutex_;
+	RowList rows_; // most recently used first
+	std::unordered_map<unsigned long long, RowList::iterator> index_;
+	size_t memory_;
+	unsigned long long hits_;
+	unsigned long long misses_;
+	unsigned long long evictions_;
+};
+
+/*!
+\brief Ray tracing matrix that keeps the rows it computes in a file.
+
+If the disk cache directory is set, set_up() looks there for a file named
+after a hash of everything the matrix rows depend on (acquisition geometry,
+image grid and ray tracing parameters, including num_tangential_LORs) and
+maps it to memory: the rows found in it are not computed again. Only the
+rows for basic bins are stored, the others are obtained via symmetries.
+New rows are added to the file by save_disk_cache(), which is called by
+the next set_up() and by the destructor. Until then they are kept in 
+memory, up to the row cache budget or, if it is not set, 256 MB; rows 
+computed after that are not saved.
+
+If the row cache budget is set, the rows are kept in a MatrixRowCache 
+instead of the unlimited cache of ProjMatrixByBin.
+*/
+class xSTIR_RayTracingMatrix : public ProjMatrixByBinUsingRayTracing {
+public:
+	xSTIR_RayTracingMatrix() : disk_rows_(0), new_rows_memory_(0) {}
+	~xSTIR_RayTracingMatrix();
+
+	void set_disk_cache_directory(const std::string& dir)
+	{
+		disk_cache_dir_ = dir;
+	}
+	const std::string& disk_cache_directory() const
+	{
+		return disk_cache_dir_;
+	}
+	// number of rows read from the disk cache file by set_up()
+	size_t disk_cache_rows() const
+	{
+		return disk_index_.size();
+	}
+	// adds the rows computed since set_up() to the disk cache file
+	void save_disk_cache();
+
+	// memory budget in bytes for the row cache, 0 to use the cache 
+	// of ProjMatrixByBin
+	void set_row_cache_budget(size_t bytes);
+	const MatrixRowCache& row_cache() const
+	{
+		return row_cache_;
+	}
+
+	virtual void set_up(const shared_ptr<ProjDataInfo>& proj_data_info_ptr,
+		const shared_ptr<DiscretisedDensity<3, float> >& density_info_ptr);
+
+private:
+	struct RowLocation {
+		unsigned long long offset;
+		unsigned int size;
+	};
+
+	virtual void calculate_proj_matrix_elems_for_one_bin
+		(ProjMatrixElemsForOneBin& elems) const;
+
+	static unsigned long long bin_key_(const Bin& bin);
+	void load_disk_cache_();
+	// gets the row from the disk cache or the rows to be added to it
+	bool read_disk_cache_row_(unsigned long long key,
+		ProjMatrixElemsForOneBin& elems) const;
+	void add_disk_cache_row_(unsigned long long key,
+		const ProjMatrixElemsForOneBin& elems) const;
+
+	std::string disk_cache_dir_;
+	std::string cache_key_;
+	std::string cache_file_;
+	// computes the rows missing from the cache
+	shared_ptr<ProjMatrixByBinUsingRayTracing> sptr_calculator_;
+	FileInMemory disk_cache_;
+	const char* disk_rows_;
+	std::unordered_map<unsigned long long, RowLocation> disk_index_;
+	mutable std::mutex new_rows_mutex_;
+	mutable std::map<unsigned long long, std::vector<char> > new_rows_;
+	mutable size_t new_rows_memory_; // bytes, approximately
+	mutable MatrixRowCache row_cache_;
+};
+
+typedef xSTIR_RayTracingMatrix RayTracingMatrix;
+
 class xSTIR_GeneralisedPrior3DF : public GeneralisedPrior < Image3DF > {
 public:
 	bool post_process() {
@@ -32,6 +32,23 @@ classdef AcquisitionData < mSTIR.DataContainer
             mUtilities.check_status('AcquisitionData', h);
             mUtilities.delete(h)
         end
+        function set_scratch_directory(dir)
+%***SIRF*** Sets the directory for the files backing acquisition data
+%         stored with the 'mapped' scheme (default: $TMPDIR or /tmp).
+            h = calllib...
+                ('mstir', 'mSTIR_setAcquisitionsScratchDirectory', dir);
+            mUtilities.check_status('AcquisitionData', h);
+            mUtilities.delete(h)
+        end
+        function set_streaming_budget(mbytes)
+%***SIRF*** Sets the memory (in megabytes) that algebraic operations
+%         on file-stored acquisition data may use for segments read
+%         ahead or waiting to be written; 0 disables reading ahead.
+            h = calllib...
+                ('mstir', 'mSTIR_setAcquisitionsStreamingBudget', mbytes);
+            mUtilities.check_status('AcquisitionData', h);
+            mUtilities.delete(h)
+        end
     end
     methods
         function self = AcquisitionData(arg)
@@ -75,6 +75,17 @@ classdef AcquisitionModel < handle
             mSTIR.setParameter(self.handle_, 'AcquisitionModel', ...
                 'bin_efficiency', bin_eff, 'h');
         end
+        function set_num_threads(self, n)
+%***SIRF*** set_num_threads(n) sets the number of threads that share
+%         the projection work; the projectors must support concurrent use.
+            mSTIR.setParameter(self.handle_, 'AcquisitionModel', ...
+                'num_threads', n, 'i');
+        end
+        function n = get_num_threads(self)
+%***SIRF*** Returns the number of threads that share the projection work.
+            n = mSTIR.parameter(self.handle_, 'AcquisitionModel', ...
+                'num_threads', 'i');
+        end
         function set_up(self, acq_templ, img_templ)
 %***SIRF*** sets up the object with appropriate geometric information.
 %         This function needs to be called before performing forward- or 
@@ -42,6 +42,42 @@ classdef RayTracingMatrix < handle
             mSTIR.setParameter...
                 (self.handle_, self.name, 'num_tangential_LORs', num, 'i')
         end
+        function set_disk_cache_directory(self, dir)
+%***SIRF*** Sets the directory where the computed matrix rows are stored
+%         between sessions, so that a matrix set up for the same geometry
+%         and parameters does not compute them again; an empty string
+%         (default) disables the disk cache.
+            mSTIR.setParameter...
+                (self.handle_, self.name, 'disk_cache_directory', dir, 'c')
+        end
+        function value = get_disk_cache_rows(self)
+%***SIRF*** Returns the number of matrix rows found in the disk cache when
+%         this matrix was set up.
+            value = mSTIR.parameter...
+                (self.handle_, self.name, 'disk_cache_rows', 'i');
+        end
+        function set_row_cache_budget(self, mbytes)
+%***SIRF*** Sets the memory (in Mbytes) for keeping the computed matrix 
+%         rows, which are then stored compactly with weights rounded to 
+%         half precision, the least used rows making room for new ones;
+%         0 (default) keeps all rows at full precision.
+            mSTIR.setParameter...
+                (self.handle_, self.name, 'row_cache_budget', mbytes, 'i')
+        end
+        function stats = get_row_cache_statistics(self)
+%***SIRF*** Returns a structure with the row cache memory budget (Mbytes),
+%         the numbers of hits, misses and evictions since set up, and the
+%         number of rows and memory (bytes) currently in the cache.
+            stats.budget = mSTIR.parameter...
+                (self.handle_, self.name, 'row_cache_budget', 'i');
+            items = {'hits', 'misses', 'evictions', 'memory'};
+            for i = 1 : numel(items)
+                stats.(items{i}) = mSTIR.parameter...
+                    (self.handle_, self.name, ['row_cache_' items{i}], 'd');
+            end
+            stats.rows = mSTIR.parameter...
+                (self.handle_, self.name, 'row_cache_rows', 'i');
+        end
 %         function value = get_num_tangential_LORs(self)
 %             value = mSTIR.parameter...
 %                 (self.handle_, self.name, 'num_tangential_LORs', 'i');
@@ -5,5 +5,7 @@ function value = parameter(handle, set, name, type)
         value = calllib('miutilities', 'mIntDataFromHandle', hv);
     elseif strcmp(type, 'f')
         value = calllib('miutilities', 'mFloatDataFromHandle', hv);
+    elseif strcmp(type, 'd')
+        value = calllib('miutilities', 'mDoubleDataFromHandle', hv);
     end
 end
\ No newline at end of file
@@ -63,6 +63,12 @@ EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelBwd(void* ptr_am, void* ptr_ad) {
 EXPORTED_FUNCTION 	void* mSTIR_setAcquisitionsStorageScheme(const char* scheme) {
 	return cSTIR_setAcquisitionsStorageScheme(scheme);
 }
+EXPORTED_FUNCTION 	void* mSTIR_setAcquisitionsScratchDirectory(const char* dir) {
+	return cSTIR_setAcquisitionsScratchDirectory(dir);
+}
+EXPORTED_FUNCTION 	void* mSTIR_setAcquisitionsStreamingBudget(int mbytes) {
+	return cSTIR_setAcquisitionsStreamingBudget(mbytes);
+}
 EXPORTED_FUNCTION 	void* mSTIR_acquisitionsDataFromTemplate(void* ptr_t) {
 	return cSTIR_acquisitionsDataFromTemplate(ptr_t);
 }
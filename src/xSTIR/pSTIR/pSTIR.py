@@ -90,6 +90,12 @@ def _float_par(handle, set, par):
     value = pyiutil.floatDataFromHandle(h)
     pyiutil.deleteDataHandle(h)
     return value
+def _double_par(handle, set, par):
+    h = pystir.cSTIR_parameter(handle, set, par)
+    check_status(h, inspect.stack()[1])
+    value = pyiutil.doubleDataFromHandle(h)
+    pyiutil.deleteDataHandle(h)
+    return value
 def _getParameterHandle(hs, set, par):
     handle = pystir.cSTIR_parameter(hs, set, par)
     check_status(handle, inspect.stack()[1])
@@ -595,6 +601,48 @@ class RayTracingMatrix:
         Returns the number of LORs for each bin in the sinogram.
         '''
         return _int_par(self.handle, self.name, 'num_tangential_LORs')
+    def set_disk_cache_directory(self, dir):
+        '''
+        Sets the directory where the computed matrix rows are stored
+        between sessions, so that a matrix set up for the same geometry
+        and parameters does not compute them again; an empty string
+        (default) disables the disk cache.
+        '''
+        _set_char_par(self.handle, self.name, 'disk_cache_directory', dir)
+        return self
+    def get_disk_cache_directory(self):
+        '''
+        Returns the directory where the computed matrix rows are stored.
+        '''
+        return _char_par(self.handle, self.name, 'disk_cache_directory')
+    def get_disk_cache_rows(self):
+        '''
+        Returns the number of matrix rows found in the disk cache when
+        this matrix was set up.
+        '''
+        return _int_par(self.handle, self.name, 'disk_cache_rows')
+    def set_row_cache_budget(self, mbytes):
+        '''
+        Sets the memory (in Mbytes) for keeping the computed matrix rows,
+        which are then stored compactly with weights rounded to half
+        precision, the least used rows making room for new ones;
+        0 (default) keeps all rows at full precision.
+        '''
+        _set_int_par(self.handle, self.name, 'row_cache_budget', mbytes)
+        return self
+    def get_row_cache_statistics(self):
+        '''
+        Returns a dictionary with the row cache memory budget (Mbytes),
+        the numbers of hits, misses and evictions since set up, and the
+        number of rows and memory (bytes) currently in the cache.
+        '''
+        stats = {'budget': \
+            _int_par(self.handle, self.name, 'row_cache_budget')}
+        for item in ('hits', 'misses', 'evictions', 'memory'):
+            stats[item] = int(_double_par \
+                (self.handle, self.name, 'row_cache_' + item))
+        stats['rows'] = _int_par(self.handle, self.name, 'row_cache_rows')
+        return stats
 
 class AcquisitionData(DataContainer):
     '''Class for PET acquisition data.'''
@@ -628,7 +676,27 @@ class AcquisitionData(DataContainer):
             pyiutil.deleteDataHandle(self.handle)
     @staticmethod
     def set_storage_scheme(scheme):
+        '''
+        Sets the storage scheme for acquisition data created from templates:
+        'file' (default), 'memory' or 'mapped' (memory mapped to an unnamed
+        file in the scratch directory, see set_scratch_directory).
+        '''
         try_calling(pystir.cSTIR_setAcquisitionsStorageScheme(scheme))
+    @staticmethod
+    def set_scratch_directory(dir):
+        '''
+        Sets the directory for the files backing acquisition data stored
+        with the 'mapped' scheme (default: $TMPDIR or /tmp).
+        '''
+        try_calling(pystir.cSTIR_setAcquisitionsScratchDirectory(dir))
+    @staticmethod
+    def set_streaming_budget(mbytes):
+        '''
+        Sets the memory (in megabytes) that algebraic operations on 
+        file-stored acquisition data may use for segments read ahead
+        or waiting to be written; 0 disables reading ahead.
+        '''
+        try_calling(pystir.cSTIR_setAcquisitionsStreamingBudget(int(mbytes)))
     def same_object(self):
         return AcquisitionData()
     def create_uniform_image(self, value = 0):
@@ -790,6 +858,18 @@ class AcquisitionModel:
         assert_validity(bin_eff, AcquisitionData)
         _setParameter\
             (self.handle, 'AcquisitionModel', 'bin_efficiency', bin_eff.handle)
+    def set_num_threads(self, n):
+        '''
+        Sets the number of threads that share the projection work.
+        With more than one thread, a RayTracingMatrix without a row cache
+        budget is given one of 256 Mbytes (see set_row_cache_budget).
+        '''
+        _set_int_par(self.handle, 'AcquisitionModel', 'num_threads', n)
+    def get_num_threads(self):
+        '''
+        Returns the number of threads that share the projection work.
+        '''
+        return _int_par(self.handle, 'AcquisitionModel', 'num_threads')
     def forward(self, image):
         ''' 
         Returns the forward projection of x given by (F);
@@ -0,0 +1,241 @@
+''' pSTIR tests of acquisition data storage schemes and acquisition model
+performance options: the results must not depend on them
+'''
+
+## CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+## Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+##
+## This is software developed for the Collaborative Computational
+## Project in Positron Emission Tomography and Magnetic Resonance imaging
+## (http://www.ccppetmr.ac.uk/).
+##
+## Licensed under the Apache License, Version 2.0 (the "License");
+##   you may not use this file except in compliance with the License.
+##   You may obtain a copy of the License at
+##       http://www.apache.org/licenses/LICENSE-2.0
+##   Unless required by applicable law or agreed to in writing, software
+##   distributed under the License is distributed on an "AS IS" BASIS,
+##   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+##   See the License for the specific language governing permissions and
+##   limitations under the License.
+
+import math
+import os
+import shutil
+import tempfile
+
+from pSTIR import *
+
+def test_failed(ntest, expected, actual, abstol, reltol):
+    if abs(expected - actual) < abstol + reltol*abs(expected):
+        print('+++ test %d passed' % ntest)
+        return 0
+    else:
+        print('+++ test %d failed' % ntest)
+        return 1
+
+# maximal difference between two arrays relative to the largest value
+def rel_diff(u, v):
+    u = u.astype(numpy.float64)
+    v = v.astype(numpy.float64)
+    return abs(u - v).max()/max(abs(u).max(), abs(v).max(), 1e-30)
+
+# norm, dot product and axpby computed by acquisition data stored
+# with the current storage scheme
+def algebra(raw_data_file):
+    ad = AcquisitionData(raw_data_file)
+    x = ad.clone()
+    y = ad.get_uniform_copy(0.25)
+    z = x - y
+    return x.norm(), x.dot(y), z.as_array()
+
+def forward_and_backward(am, image, ad):
+    fwd = am.forward(image).as_array()
+    bwd = am.backward(ad).as_array()
+    return fwd, bwd
+
+def main():
+
+    failed = 0
+    eps = 1e-5
+    ntest = 0
+
+    # locate the input data file folder
+    data_path = petmr_data_path('pet')
+
+    # PET acquisition data to be read from this file
+    raw_data_file = existing_filepath(data_path, 'Utahscat600k_ca_seg4.hs')
+    ad = AcquisitionData(raw_data_file)
+    adata = ad.as_array().astype(numpy.float64)
+
+    # algebra on data in one block, on data streamed segment by segment,
+    # with and without reading ahead, and on data in memory mapped to
+    # scratch files must agree with numpy; scratch files are unnamed and
+    # never show in the scratch directory
+    s = math.sqrt((adata*adata).sum())
+    d = 0.25*adata.sum()
+    scratch_dir = tempfile.mkdtemp()
+    AcquisitionData.set_scratch_directory(scratch_dir)
+    try:
+        for scheme, budget in (('memory', 0), ('file', 0), ('file', 512), \
+                               ('mapped', 0)):
+            AcquisitionData.set_storage_scheme(scheme)
+            AcquisitionData.set_streaming_budget(budget)
+            n, t, z = algebra(raw_data_file)
+            ntest += 1
+            failed += test_failed(ntest, s, n, 0, eps)
+            ntest += 1
+            failed += test_failed(ntest, d, t, 0, eps)
+            ntest += 1
+            failed += test_failed(ntest, 0, rel_diff(z, adata - 0.25), eps, 0)
+        # while mapped data exists and after it is deleted
+        mapped = ad.clone()
+        ntest += 1
+        failed += test_failed(ntest, 0, len(os.listdir(scratch_dir)), 0.5, 0)
+        del mapped
+        ntest += 1
+        failed += test_failed(ntest, 0, len(os.listdir(scratch_dir)), 0.5, 0)
+    finally:
+        AcquisitionData.set_scratch_directory(tempfile.gettempdir())
+        shutil.rmtree(scratch_dir, ignore_errors = True)
+    # negative budget is refused
+    ntest += 1
+    try:
+        AcquisitionData.set_streaming_budget(-1)
+        print('+++ test %d failed' % ntest)
+        failed += 1
+    except error:
+        print('+++ test %d passed' % ntest)
+    AcquisitionData.set_streaming_budget(512)
+    AcquisitionData.set_storage_scheme('memory')
+
+    ad = AcquisitionData(raw_data_file)
+    image = ad.create_uniform_image(1.0)
+
+    matrix = RayTracingMatrix()
+    am = AcquisitionModelUsingMatrix(matrix)
+    am.set_up(ad, image)
+    gx = am.forward(image).as_array().astype(numpy.float64)
+
+    # the forward projection with all terms applied to each group of
+    # related viewgrams must equal the projection with the terms applied
+    # one after another to the whole data; normalisation by uniform bin
+    # efficiencies is multiplication by a factor, found from its effect
+    # on the plain projection
+    bin_eff = ad.get_uniform_copy(2.0)
+    am_n = AcquisitionModelUsingMatrix(matrix)
+    am_n.set_bin_efficiency(bin_eff)
+    am_n.set_up(ad, image)
+    nx = am_n.forward(image).as_array().astype(numpy.float64)
+    factor = nx.max()/gx.max()
+    add = ad.get_uniform_copy(0.5)
+    background = ad.clone()
+    am_f = AcquisitionModelUsingMatrix(matrix)
+    am_f.set_additive_term(add)
+    am_f.set_background_term(background)
+    am_f.set_bin_efficiency(bin_eff)
+    am_f.set_up(ad, image)
+    fwd = am_f.forward(image).as_array()
+    expected = factor*(gx + 0.5) + adata
+    ntest += 1
+    failed += test_failed(ntest, 0, rel_diff(fwd, expected), eps, 0)
+
+    # backward projection with normalisation must not change its input
+    y = ad.clone()
+    am_f.backward(y)
+    ntest += 1
+    failed += test_failed(ntest, 0, rel_diff(y.as_array(), adata), 1e-30, 0)
+
+    # one and several threads must agree; several threads share the matrix
+    # via its row cache, given a budget by set_num_threads, which rounds
+    # the weights to half precision
+    fwd1, bwd1 = forward_and_backward(am_f, image, ad)
+    am_f.set_num_threads(4)
+    fwd4, bwd4 = forward_and_backward(am_f, image, ad)
+    am_f.set_num_threads(1)
+    ntest += 1
+    failed += test_failed \
+        (ntest, 1, min(matrix.get_row_cache_statistics()['budget'], 1), 0.5, 0)
+    ntest += 1
+    failed += test_failed(ntest, 0, rel_diff(fwd1, fwd4), 1e-3, 0)
+    ntest += 1
+    failed += test_failed(ntest, 0, rel_diff(bwd1, bwd4), 1e-3, 0)
+
+    # matrix rows saved to the disk cache by one matrix must be found there
+    # by the next one set up for the same geometry, and give the same result
+    cache_dir = tempfile.mkdtemp()
+    try:
+        matrix_d = RayTracingMatrix()
+        matrix_d.set_disk_cache_directory(cache_dir)
+        am_d = AcquisitionModelUsingMatrix(matrix_d)
+        am_d.set_up(ad, image)
+        fwd_d = am_d.forward(image).as_array()
+        # the rows are saved when the matrix is deleted
+        del am_d
+        del matrix_d
+        matrix_d = RayTracingMatrix()
+        matrix_d.set_disk_cache_directory(cache_dir)
+        am_d = AcquisitionModelUsingMatrix(matrix_d)
+        am_d.set_up(ad, image)
+        ntest += 1
+        failed += test_failed \
+            (ntest, 1, min(matrix_d.get_disk_cache_rows(), 1), 0.5, 0)
+        ntest += 1
+        failed += test_failed \
+            (ntest, 0, rel_diff(am_d.forward(image).as_array(), fwd_d), eps, 0)
+        ntest += 1
+        failed += test_failed(ntest, 0, rel_diff(fwd_d, gx), eps, 0)
+        del am_d
+        del matrix_d
+    finally:
+        shutil.rmtree(cache_dir, ignore_errors = True)
+
+    # rows kept in the row cache have weights rounded to half precision,
+    # the same on every use, whether the rows are found in the cache,
+    # computed anew or evicted and computed again
+    for budget in (64, 1):
+        matrix_r = RayTracingMatrix()
+        matrix_r.set_row_cache_budget(budget)
+        am_r = AcquisitionModelUsingMatrix(matrix_r)
+        am_r.set_up(ad, image)
+        fwd_r1 = am_r.forward(image).as_array()
+        fwd_r2 = am_r.forward(image).as_array()
+        stats = matrix_r.get_row_cache_statistics()
+        ntest += 1
+        failed += test_failed(ntest, 0, rel_diff(fwd_r1, fwd_r2), 1e-30, 0)
+        ntest += 1
+        failed += test_failed(ntest, 0, rel_diff(fwd_r1, gx), 1e-3, 0)
+        ntest += 1
+        failed += test_failed(ntest, 1, min(stats['misses'], 1), 0.5, 0)
+        ntest += 1
+        if budget > 1:
+            failed += test_failed(ntest, 1, min(stats['hits'], 1), 0.5, 0)
+        else:
+            failed += test_failed(ntest, 1, min(stats['evictions'], 1), 0.5, 0)
+        ntest += 1
+        failed += test_failed \
+            (ntest, 1, int(stats['memory'] <= budget*1024*1024), 0.5, 0)
+    # negative budget is refused
+    ntest += 1
+    try:
+        RayTracingMatrix().set_row_cache_budget(-1)
+        print('+++ test %d failed' % ntest)
+        failed += 1
+    except error:
+        print('+++ test %d passed' % ntest)
+
+    return failed
+
+try:
+    failed = main()
+    if failed == 0:
+        print('all tests passed')
+        sys.exit(0)
+    else:
+        print('%d tests failed' % failed)
+        sys.exit(failed)
+
+except error as err:
+    # display error information
+    print('??? %s' % err.value)
+    sys.exit(-1)